@@ -1,4 +1,6 @@
 #include <stddef.h>
+#include <ctype.h>
+#include <stdarg.h>
 #include <sqlite3ext.h>
 #include "roaring.c"
 SQLITE_EXTENSION_INIT1
@@ -21,1219 +23,8307 @@ static void roaring64ArrayFreeFunc(int64_t *p){
   sqlite3_free(p);
 }
 
+#ifdef ROARING_SQLITE_MALLOC
+/*
+  routes the CRoaring allocations through sqlite3_malloc, so bitmaps count
+  towards sqlite3_memory_used() and the heap limits like the blobs do. the
+  hook is process wide and has to be in place before the first bitmap is
+  allocated, which is why it's a compile time option
+*/
+static void *roaringSqliteMalloc(size_t n){
+  return sqlite3_malloc64(n ? n : 1);
+}
+
+static void *roaringSqliteRealloc(void *p, size_t n){
+  return sqlite3_realloc64(p, n);
+}
+
+static void *roaringSqliteCalloc(size_t n, size_t size){
+  void *p;
+  if( size != 0 && n > SIZE_MAX / size ) return NULL;
+  p = roaringSqliteMalloc(n * size);
+  if( p != NULL ) memset(p, 0, n * size);
+  return p;
+}
+
+static void roaringSqliteFree(void *p){
+  sqlite3_free(p);
+}
+
+/*
+  sqlite3_malloc only promises 8 byte alignment, so the block is over
+  allocated and the pointer to free is stored right before the aligned one
+*/
+static void *roaringSqliteAlignedMalloc(size_t alignment, size_t n){
+  char *p;
+  char *pAligned;
+  if( n > SIZE_MAX - alignment - sizeof(void*) ) return NULL;
+  p = sqlite3_malloc64(n + alignment + sizeof(void*));
+  if( p == NULL ) return NULL;
+  pAligned = (char*)(((uintptr_t)(p + sizeof(void*)) + alignment - 1) & ~(uintptr_t)(alignment - 1));
+  ((void**)pAligned)[-1] = p;
+  return pAligned;
+}
+
+static void roaringSqliteAlignedFree(void *p){
+  if( p != NULL ) sqlite3_free(((void**)p)[-1]);
+}
+#endif
+
+/*
+  per connection arena for the bitmaps deserialized from function arguments,
+  which only live for one call. allocations are bumped from a single block
+  that is reused once they are all freed. those that don't fit go to the
+  heap and the block grows for the next round
+*/
+typedef struct RoaringArena RoaringArena;
+struct RoaringArena {
+  char *aBuf;               // block the allocations are bumped from
+  size_t nBuf;              // size of aBuf
+  size_t iOff;              // first free byte of aBuf
+  size_t nMiss;             // bytes sent to the heap since the last reset
+  int nLive;                // allocations from aBuf not freed yet
+  unsigned int nAlloc;      // allocations from aBuf ever made
+};
+
+#define ROARING_ARENA_MIN   (16 * 1024)
+#define ROARING_ARENA_MAX   (1024 * 1024)
+#define ROARING_ARENA_ALIGN 64
+
+#ifdef _MSC_VER
+#define ROARING_THREAD_LOCAL __declspec(thread)
+#else
+#define ROARING_THREAD_LOCAL __thread
+#endif
+
+// arena of the call that is deserializing or freeing its arguments
+static ROARING_THREAD_LOCAL RoaringArena *pRoaringArena = NULL;
+
+// the allocator in place before the arena hook was installed
+static roaring_memory_t roaringHeap;
+
+static int roaringArenaOwns(const RoaringArena *p, const void *pMem){
+  return p != NULL && p->aBuf != NULL
+    && (const char*)pMem >= p->aBuf && (const char*)pMem < p->aBuf + p->nBuf;
+}
+
+/*
+  once an allocation misses, the following ones go to the heap as well
+  until the arena is reset, so a bitmap whose first allocation is on the
+  heap is all on the heap
+*/
+static void *roaringArenaAlloc(RoaringArena *p, size_t nAlign, size_t n){
+  size_t iStart;
+  if( nAlign > ROARING_ARENA_ALIGN ) return NULL;
+  iStart = (p->iOff + nAlign - 1) & ~(nAlign - 1);
+  if( p->aBuf == NULL || p->nMiss > 0 || iStart > p->nBuf || n > p->nBuf - iStart ){
+    p->nMiss += n + nAlign;
+    return NULL;
+  }
+  p->iOff = iStart + n;
+  p->nLive++;
+  p->nAlloc++;
+  return p->aBuf + iStart;
+}
+
+static void roaringArenaReset(RoaringArena *p){
+  p->iOff = 0;
+  if( p->nMiss > 0 && p->nBuf < ROARING_ARENA_MAX ){
+    size_t nBuf = p->nBuf ? p->nBuf : ROARING_ARENA_MIN;
+    while( nBuf < p->nBuf + p->nMiss && nBuf < ROARING_ARENA_MAX ) nBuf *= 2;
+    if( nBuf > ROARING_ARENA_MAX ) nBuf = ROARING_ARENA_MAX;
+    if( p->aBuf != NULL ) roaringHeap.aligned_free(p->aBuf);
+    p->aBuf = roaringHeap.aligned_malloc(ROARING_ARENA_ALIGN, nBuf);
+    p->nBuf = p->aBuf ? nBuf : 0;
+  }
+  p->nMiss = 0;
+}
+
+static void roaringArenaFree(RoaringArena *p){
+  if( p->aBuf != NULL ) roaringHeap.aligned_free(p->aBuf);
+  memset(p, 0, sizeof(*p));
+}
+
+/*
+  routes the CRoaring allocations of the current thread to the arena until
+  roaringArenaLeave, the arena is reset on the way in when it's empty
+*/
+static RoaringArena *roaringArenaEnter(RoaringArena *p){
+  RoaringArena *pPrev = pRoaringArena;
+  if( p->nLive == 0 ) roaringArenaReset(p);
+  pRoaringArena = p;
+  return pPrev;
+}
+
+static void roaringArenaLeave(RoaringArena *pPrev){
+  pRoaringArena = pPrev;
+}
+
+static void *roaringHookMalloc(size_t n){
+  void *p = pRoaringArena ? roaringArenaAlloc(pRoaringArena, 16, n) : NULL;
+  return p ? p : roaringHeap.malloc(n);
+}
+
+static void *roaringHookCalloc(size_t n, size_t size){
+  void *p = NULL;
+  if( pRoaringArena && (size == 0 || n <= SIZE_MAX / size) ){
+    p = roaringArenaAlloc(pRoaringArena, 16, n * size);
+    if( p != NULL ) memset(p, 0, n * size);
+  }
+  return p ? p : roaringHeap.calloc(n, size);
+}
+
+static void *roaringHookRealloc(void *p, size_t n){
+  RoaringArena *pArena = pRoaringArena;
+  size_t nCopy;
+  void *pNew;
+  if( !roaringArenaOwns(pArena, p) ) return roaringHeap.realloc(p, n);
+  pNew = roaringHookMalloc(n);
+  if( pNew == NULL ) return NULL;
+  // the old size isn't kept, copying up to the end of the block covers it
+  nCopy = pArena->aBuf + pArena->nBuf - (char*)p;
+  memmove(pNew, p, n < nCopy ? n : nCopy);
+  pArena->nLive--;
+  return pNew;
+}
+
+static void roaringHookFree(void *p){
+  if( roaringArenaOwns(pRoaringArena, p) ){
+    pRoaringArena->nLive--;
+  }else{
+    roaringHeap.free(p);
+  }
+}
+
+static void *roaringHookAlignedMalloc(size_t nAlign, size_t n){
+  void *p = pRoaringArena ? roaringArenaAlloc(pRoaringArena, nAlign, n) : NULL;
+  return p ? p : roaringHeap.aligned_malloc(nAlign, n);
+}
+
+static void roaringHookAlignedFree(void *p){
+  if( roaringArenaOwns(pRoaringArena, p) ){
+    pRoaringArena->nLive--;
+  }else{
+    roaringHeap.aligned_free(p);
+  }
+}
+
+/*
+  installs the arena hook on top of the CRoaring allocator (or of
+  sqlite3_malloc). the hook is process wide, so this is done once, under
+  a static mutex as connections may load the extension concurrently
+*/
+static void roaringInitMemoryHook(void){
+  static int bInstalled = 0;
+  sqlite3_mutex *pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+  roaring_memory_t hook = {
+    .malloc = roaringHookMalloc,
+    .realloc = roaringHookRealloc,
+    .calloc = roaringHookCalloc,
+    .free = roaringHookFree,
+    .aligned_malloc = roaringHookAlignedMalloc,
+    .aligned_free = roaringHookAlignedFree,
+  };
+  sqlite3_mutex_enter(pMutex);
+  // a second copy of the hook would save the first as the heap and recurse
+  if( bInstalled || global_memory_hook.malloc == roaringHookMalloc ){
+    sqlite3_mutex_leave(pMutex);
+    return;
+  }
+#ifdef ROARING_SQLITE_MALLOC
+  roaringHeap.malloc = roaringSqliteMalloc;
+  roaringHeap.realloc = roaringSqliteRealloc;
+  roaringHeap.calloc = roaringSqliteCalloc;
+  roaringHeap.free = roaringSqliteFree;
+  roaringHeap.aligned_malloc = roaringSqliteAlignedMalloc;
+  roaringHeap.aligned_free = roaringSqliteAlignedFree;
+#else
+  roaringHeap = global_memory_hook;
+#endif
+  roaring_init_memory_hook(hook);
+  bInstalled = 1;
+  sqlite3_mutex_leave(pMutex);
+}
+
+/*
+  read only view over the header of a serialized bitmap, lets us answer
+  some questions straight from the blob without allocating anything
+*/
+typedef struct RoaringHeader RoaringHeader;
+struct RoaringHeader {
+  int layout;               // CROARING_SERIALIZATION_ARRAY_UINT32 or _CONTAINER
+  uint32_t nArray;          // element count (array layout)
+  const char *aArray;       // packed uint32 elements (array layout)
+  int nContainer;           // container count (container layout)
+  const char *aKeyCard;     // packed uint16 (key, cardinality - 1) pairs
+  const char *aRunFlags;    // one bit per run container, NULL if none
+  const char *aOffset;      // packed uint32 container offsets, NULL if none
+  const char *aPayload;     // first container (container layout)
+  const char *pBase;        // start of the portable bitmap, offsets count from here
+  const char *pEnd;         // end of the portable bitmap
+  size_t nByte;             // bytes occupied by the serialized bitmap
+};
+
+/*
+  parses a bitmap in the portable format (as written by
+  roaring_bitmap_portable_serialize), returns 0 if the buffer is not valid
+*/
+static int roaringPortableHeaderInit(RoaringHeader *h, const char *p, size_t n){
+  uint32_t cookie;
+  int32_t size;
+  const char *pHeader = p;
+  // checks the container payloads fit in the buffer, does not allocate
+  h->nByte = roaring_bitmap_portable_deserialize_size(p, n);
+  if( h->nByte == 0 ) return 0;
+  memcpy(&cookie, p, sizeof(cookie));
+  pHeader += sizeof(cookie);
+  h->aRunFlags = NULL;
+  if( (cookie & 0xFFFF) == SERIAL_COOKIE ){
+    size = (cookie >> 16) + 1;
+    h->aRunFlags = pHeader;
+    pHeader += (size + 7) / 8;
+  }else{
+    memcpy(&size, pHeader, sizeof(size));
+    pHeader += sizeof(size);
+  }
+  h->layout = CROARING_SERIALIZATION_CONTAINER;
+  h->nContainer = size;
+  h->aKeyCard = pHeader;
+  pHeader += 4 * (size_t)size;
+  // bitmaps with run containers omit the offsets below NO_OFFSET_THRESHOLD containers
+  h->aOffset = NULL;
+  if( h->aRunFlags == NULL || size >= NO_OFFSET_THRESHOLD ){
+    h->aOffset = pHeader;
+    pHeader += 4 * (size_t)size;
+  }
+  h->aPayload = pHeader;
+  h->pBase = p;
+  h->pEnd = p + h->nByte;
+  h->nArray = 0;
+  h->aArray = NULL;
+  return 1;
+}
+
+/*
+  parses a bitmap as written by roaring_bitmap_serialize, returns 0 if the
+  buffer is not valid
+*/
+static int roaringHeaderInit(RoaringHeader *h, const void *pIn, size_t nIn){
+  const char *p = (const char *)pIn;
+  if( p == NULL || nIn < 1 ) return 0;
+  if( p[0] == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    if( nIn < 1 + sizeof(uint32_t) ) return 0;
+    memset(h, 0, sizeof(*h));
+    memcpy(&h->nArray, p + 1, sizeof(uint32_t));
+    h->nByte = 1 + sizeof(uint32_t) + (uint64_t)h->nArray * sizeof(uint32_t);
+    if( nIn < h->nByte ) return 0;
+    h->layout = CROARING_SERIALIZATION_ARRAY_UINT32;
+    h->aArray = p + 1 + sizeof(uint32_t);
+    return 1;
+  }else if( p[0] == CROARING_SERIALIZATION_CONTAINER ){
+    if( !roaringPortableHeaderInit(h, p + 1, nIn - 1) ) return 0;
+    h->nByte += 1;
+    return 1;
+  }
+  return 0;
+}
+
+/*
+  number of high 16 bit keys in the header, for the array layout every
+  element counts as one key (equal keys are adjacent since it is sorted)
+*/
+static int roaringHeaderKeyCount(const RoaringHeader *h){
+  if( h->layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    return (int)h->nArray;
+  }
+  return h->nContainer;
+}
+
+static uint16_t roaringHeaderKey(const RoaringHeader *h, int i){
+  uint16_t key;
+  uint32_t x;
+  if( h->layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    memcpy(&x, h->aArray + 4 * i, sizeof(x));
+    return (uint16_t)(x >> 16);
+  }
+  memcpy(&key, h->aKeyCard + 4 * i, sizeof(key));
+  return key;
+}
+
+static uint32_t roaringHeaderCard(const RoaringHeader *h, int i){
+  uint16_t card;
+  memcpy(&card, h->aKeyCard + 4 * i + 2, sizeof(card));
+  return (uint32_t)card + 1;
+}
+
+static uint64_t roaringHeaderCardinality(const RoaringHeader *h){
+  uint64_t card = 0;
+  if( h->layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    return h->nArray;
+  }
+  for(int i=0; i < h->nContainer; i++){
+    card += roaringHeaderCard(h, i);
+  }
+  return card;
+}
+
+/*
+  sums the cardinalities of the 32 bit buckets of a bitmap as written by
+  roaring64_bitmap_portable_serialize, returns 0 if the buffer is not valid
+*/
+static int roaring64HeaderCardinality(const void *pIn, size_t nIn, uint64_t *pCard){
+  const char *p = (const char *)pIn;
+  uint64_t nBucket;
+  RoaringHeader h;
+  *pCard = 0;
+  if( p == NULL || nIn < sizeof(nBucket) ) return 0;
+  memcpy(&nBucket, p, sizeof(nBucket));
+  if( nBucket > UINT32_MAX ) return 0;
+  p += sizeof(nBucket);
+  nIn -= sizeof(nBucket);
+  for(uint64_t i=0; i < nBucket; i++){
+    // skip the high 32 bits of the bucket
+    if( nIn < sizeof(uint32_t) ) return 0;
+    p += sizeof(uint32_t);
+    nIn -= sizeof(uint32_t);
+    if( !roaringPortableHeaderInit(&h, p, nIn) ) return 0;
+    *pCard += roaringHeaderCardinality(&h);
+    p += h.nByte;
+    nIn -= h.nByte;
+  }
+  return 1;
+}
+
+/*
+  1 if the two headers share a high 16 bit key, bitmaps without a common
+  key cannot have a common element
+*/
+static int roaringHeaderKeysIntersect(const RoaringHeader *h1, const RoaringHeader *h2){
+  int n1 = roaringHeaderKeyCount(h1);
+  int n2 = roaringHeaderKeyCount(h2);
+  int i = 0, j = 0;
+  while( i < n1 && j < n2 ){
+    uint16_t k1 = roaringHeaderKey(h1, i);
+    uint16_t k2 = roaringHeaderKey(h2, j);
+    if( k1 == k2 ) return 1;
+    if( k1 < k2 ) i++; else j++;
+  }
+  return 0;
+}
+
+/*
+  1 if the bitmap has an element under one of the keys of the header
+*/
+static int roaringHeaderKeysIntersectBitmap(const RoaringHeader *h, const roaring_bitmap_t *r){
+  int n = roaringHeaderKeyCount(h);
+  for(int i=0; i < n; i++){
+    uint64_t key = roaringHeaderKey(h, i);
+    if( i > 0 && key == roaringHeaderKey(h, i - 1) ) continue;
+    if( roaring_bitmap_intersect_with_range(r, key << 16, (key + 1) << 16) ) return 1;
+  }
+  return 0;
+}
+
+/*
+  walks the 48 bit container keys (bucket high 32 bits and container high
+  16 bits) of a bitmap as written by roaring64_bitmap_portable_serialize,
+  the buckets are only validated as they are reached
+*/
+typedef struct Roaring64KeyCursor Roaring64KeyCursor;
+struct Roaring64KeyCursor {
+  const char *p;            // next bucket
+  size_t n;                 // bytes left after p
+  uint64_t nBucket;         // buckets left after p
+  uint32_t high;            // high 32 bits of the current bucket
+  RoaringHeader h;          // header of the current bucket
+  int i;                    // next container in the current bucket
+};
+
+static int roaring64KeyCursorInit(Roaring64KeyCursor *c, const void *pIn, size_t nIn){
+  memset(c, 0, sizeof(*c));
+  if( pIn == NULL || nIn < sizeof(c->nBucket) ) return 0;
+  memcpy(&c->nBucket, pIn, sizeof(c->nBucket));
+  if( c->nBucket > UINT32_MAX ) return 0;
+  c->p = (const char *)pIn + sizeof(c->nBucket);
+  c->n = nIn - sizeof(c->nBucket);
+  return 1;
+}
+
+/*
+  moves to the next bucket, 1 on success, 0 at the end and -1 if the
+  buffer is not valid
+*/
+static int roaring64KeyCursorBucket(Roaring64KeyCursor *c){
+  if( c->nBucket == 0 ) return 0;
+  if( c->n < sizeof(c->high) ) return -1;
+  memcpy(&c->high, c->p, sizeof(c->high));
+  c->p += sizeof(c->high);
+  c->n -= sizeof(c->high);
+  if( !roaringPortableHeaderInit(&c->h, c->p, c->n) ) return -1;
+  c->p += c->h.nByte;
+  c->n -= c->h.nByte;
+  c->nBucket--;
+  c->i = 0;
+  return 1;
+}
+
+/*
+  1 with the next key in *pKey, 0 at the end and -1 if the buffer is not valid
+*/
+static int roaring64KeyCursorNext(Roaring64KeyCursor *c, uint64_t *pKey){
+  int rc;
+  while( c->i >= c->h.nContainer ){
+    if( (rc = roaring64KeyCursorBucket(c)) <= 0 ) return rc;
+  }
+  *pKey = ((uint64_t)c->high << 16) | roaringHeaderKey(&c->h, c->i++);
+  return 1;
+}
+
+/*
+  index of the container holding key (container layout), -1 if none
+*/
+static int roaringHeaderFind(const RoaringHeader *h, uint16_t key){
+  int lo = 0, hi = h->nContainer - 1;
+  while( lo <= hi ){
+    int mid = (lo + hi) / 2;
+    uint16_t k = roaringHeaderKey(h, mid);
+    if( k == key ) return mid;
+    if( k < key ) lo = mid + 1; else hi = mid - 1;
+  }
+  return -1;
+}
+
+static int roaringHeaderIsRun(const RoaringHeader *h, int i){
+  return h->aRunFlags != NULL && (h->aRunFlags[i / 8] & (1 << (i % 8))) != 0;
+}
+
+static size_t roaringHeaderContainerSize(const RoaringHeader *h, int i, const char *pC){
+  uint16_t nRun;
+  if( roaringHeaderIsRun(h, i) ){
+    memcpy(&nRun, pC, sizeof(nRun));
+    return sizeof(nRun) + 4 * (size_t)nRun;
+  }
+  if( roaringHeaderCard(h, i) > DEFAULT_MAX_SIZE ){
+    return BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+  }
+  return 2 * (size_t)roaringHeaderCard(h, i);
+}
+
+/*
+  payload of container i, NULL if the stored offset points outside of the
+  bitmap. without offsets the containers before i are skipped one by one,
+  the header init already checked that they fit
+*/
+static const char *roaringHeaderContainer(const RoaringHeader *h, int i){
+  const char *pC = h->aPayload;
+  uint32_t off;
+  if( h->aOffset != NULL ){
+    memcpy(&off, h->aOffset + 4 * i, sizeof(off));
+    if( off < (size_t)(h->aPayload - h->pBase) ) return NULL;
+    if( off + sizeof(uint16_t) > (size_t)(h->pEnd - h->pBase) ) return NULL;
+    pC = h->pBase + off;
+    if( roaringHeaderContainerSize(h, i, pC) > (size_t)(h->pEnd - pC) ) return NULL;
+    return pC;
+  }
+  for(int k=0; k < i; k++){
+    pC += roaringHeaderContainerSize(h, k, pC);
+  }
+  return pC;
+}
+
+/*
+  1 if container i (payload at pC) holds the low 16 bits of a value
+*/
+static int roaringHeaderContainerContains(
+  const RoaringHeader *h,
+  int i,
+  const char *pC,
+  uint16_t low
+){
+  uint16_t v, nRun, start, length;
+  int lo = 0, hi;
+  if( roaringHeaderIsRun(h, i) ){
+    // runs are (start, length - 1) pairs, find the last one starting before low
+    memcpy(&nRun, pC, sizeof(nRun));
+    pC += sizeof(nRun);
+    hi = (int)nRun - 1;
+    while( lo <= hi ){
+      int mid = (lo + hi) / 2;
+      memcpy(&start, pC + 4 * mid, sizeof(start));
+      if( start <= low ) lo = mid + 1; else hi = mid - 1;
+    }
+    if( hi < 0 ) return 0;
+    memcpy(&start, pC + 4 * hi, sizeof(start));
+    memcpy(&length, pC + 4 * hi + 2, sizeof(length));
+    return low - start <= length;
+  }
+  if( roaringHeaderCard(h, i) > DEFAULT_MAX_SIZE ){
+    // little endian 64 bit words, i.e. bit n is in byte n / 8
+    return (pC[low >> 3] >> (low & 7)) & 1;
+  }
+  hi = (int)roaringHeaderCard(h, i) - 1;
+  while( lo <= hi ){
+    int mid = (lo + hi) / 2;
+    memcpy(&v, pC + 2 * mid, sizeof(v));
+    if( v == low ) return 1;
+    if( v < low ) lo = mid + 1; else hi = mid - 1;
+  }
+  return 0;
+}
+
+static uint64_t roaringHeaderBitsetWord(const char *pC, int i){
+  uint64_t w;
+  memcpy(&w, pC + 8 * i, sizeof(w));
+  return w;
+}
+
+/*
+  smallest (bMax is 0) or largest low 16 bits held by container i
+*/
+static uint16_t roaringHeaderContainerBound(const RoaringHeader *h, int i, const char *pC, int bMax){
+  uint16_t v, nRun, length;
+  if( roaringHeaderIsRun(h, i) ){
+    memcpy(&nRun, pC, sizeof(nRun));
+    pC += sizeof(nRun);
+    if( nRun == 0 ) return 0;
+    if( !bMax ){
+      memcpy(&v, pC, sizeof(v));
+      return v;
+    }
+    memcpy(&v, pC + 4 * (nRun - 1), sizeof(v));
+    memcpy(&length, pC + 4 * (nRun - 1) + 2, sizeof(length));
+    return v + length;
+  }
+  if( roaringHeaderCard(h, i) > DEFAULT_MAX_SIZE ){
+    if( !bMax ){
+      for(int k=0; k < BITSET_CONTAINER_SIZE_IN_WORDS; k++){
+        uint64_t w = roaringHeaderBitsetWord(pC, k);
+        if( w != 0 ) return 64 * k + roaring_trailing_zeroes(w);
+      }
+    }else{
+      for(int k=BITSET_CONTAINER_SIZE_IN_WORDS - 1; k >= 0; k--){
+        uint64_t w = roaringHeaderBitsetWord(pC, k);
+        if( w != 0 ) return 64 * k + 63 - roaring_leading_zeroes(w);
+      }
+    }
+    return 0;
+  }
+  memcpy(&v, pC + (bMax ? 2 * (roaringHeaderCard(h, i) - 1) : 0), sizeof(v));
+  return v;
+}
+
+/*
+  number of values of container i that are less than or equal to low
+*/
+static uint32_t roaringHeaderContainerRank(const RoaringHeader *h, int i, const char *pC, uint16_t low){
+  uint16_t v, nRun, start, length;
+  uint32_t rank = 0;
+  int lo = 0, hi;
+  if( roaringHeaderIsRun(h, i) ){
+    memcpy(&nRun, pC, sizeof(nRun));
+    pC += sizeof(nRun);
+    for(int k=0; k < nRun; k++){
+      memcpy(&start, pC + 4 * k, sizeof(start));
+      memcpy(&length, pC + 4 * k + 2, sizeof(length));
+      if( start > low ) break;
+      if( low - start <= length ) return rank + (low - start) + 1;
+      rank += (uint32_t)length + 1;
+    }
+    return rank;
+  }
+  if( roaringHeaderCard(h, i) > DEFAULT_MAX_SIZE ){
+    for(int k=0; k < low / 64; k++){
+      rank += roaring_hamming(roaringHeaderBitsetWord(pC, k));
+    }
+    // the bits up to and including low in its word
+    uint64_t w = roaringHeaderBitsetWord(pC, low / 64);
+    return rank + roaring_hamming(w & (UINT64_MAX >> (63 - low % 64)));
+  }
+  hi = (int)roaringHeaderCard(h, i);
+  while( lo < hi ){
+    int mid = (lo + hi) / 2;
+    memcpy(&v, pC + 2 * mid, sizeof(v));
+    if( v <= low ) lo = mid + 1; else hi = mid;
+  }
+  return (uint32_t)lo;
+}
+
+/*
+  low 16 bits of the n-th (0 based) value of container i, n must be less
+  than the container cardinality
+*/
+static uint16_t roaringHeaderContainerSelect(const RoaringHeader *h, int i, const char *pC, uint32_t n){
+  uint16_t v, nRun, start, length;
+  if( roaringHeaderIsRun(h, i) ){
+    memcpy(&nRun, pC, sizeof(nRun));
+    pC += sizeof(nRun);
+    for(int k=0; k < nRun; k++){
+      memcpy(&start, pC + 4 * k, sizeof(start));
+      memcpy(&length, pC + 4 * k + 2, sizeof(length));
+      if( n <= length ) return start + n;
+      n -= (uint32_t)length + 1;
+    }
+    return 0;
+  }
+  if( roaringHeaderCard(h, i) > DEFAULT_MAX_SIZE ){
+    for(int k=0; k < BITSET_CONTAINER_SIZE_IN_WORDS; k++){
+      uint64_t w = roaringHeaderBitsetWord(pC, k);
+      uint32_t c = roaring_hamming(w);
+      if( n >= c ){
+        n -= c;
+        continue;
+      }
+      // drop the n lowest set bits
+      while( n-- > 0 ) w &= w - 1;
+      return 64 * k + roaring_trailing_zeroes(w);
+    }
+    return 0;
+  }
+  memcpy(&v, pC + 2 * n, sizeof(v));
+  return v;
+}
+
+/*
+  membership tests straight on a serialized bitmap, the last container
+  looked up is kept so that probing sorted values skips the key search
+  while they share a container (the serialized counterpart of
+  roaring_bulk_context_t)
+*/
+typedef struct RoaringProbe RoaringProbe;
+struct RoaringProbe {
+  const RoaringHeader *h;
+  int bKey;                 // key and pContainer are set
+  uint16_t key;             // high 16 bits of the last value
+  int iContainer;           // container holding key, -1 if none
+  const char *pContainer;   // payload of that container
+};
+
+static void roaringProbeInit(RoaringProbe *p, const RoaringHeader *h){
+  memset(p, 0, sizeof(*p));
+  p->h = h;
+}
+
+/*
+  1 if the value is in the bitmap, 0 if not and -1 if the bitmap is not valid
+*/
+static int roaringProbeContains(RoaringProbe *p, uint32_t x){
+  const RoaringHeader *h = p->h;
+  uint16_t key = (uint16_t)(x >> 16);
+  if( h->layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    int lo = 0, hi = (int)h->nArray - 1;
+    uint32_t v;
+    while( lo <= hi ){
+      int mid = lo + (hi - lo) / 2;
+      memcpy(&v, h->aArray + 4 * mid, sizeof(v));
+      if( v == x ) return 1;
+      if( v < x ) lo = mid + 1; else hi = mid - 1;
+    }
+    return 0;
+  }
+  if( !p->bKey || p->key != key ){
+    p->bKey = 1;
+    p->key = key;
+    p->iContainer = roaringHeaderFind(h, key);
+    p->pContainer = NULL;
+    if( p->iContainer >= 0 ){
+      p->pContainer = roaringHeaderContainer(h, p->iContainer);
+      if( p->pContainer == NULL ){
+        p->bKey = 0;
+        return -1;
+      }
+    }
+  }
+  if( p->iContainer < 0 ) return 0;
+  return roaringHeaderContainerContains(h, p->iContainer, p->pContainer, (uint16_t)x);
+}
+
+/*
+  membership test on a bitmap as written by roaring64_bitmap_portable_serialize,
+  buckets are sorted so the walk stops at the first bucket past the value.
+  returns -1 if the buffer is not valid
+*/
+static int roaring64HeaderContains(const void *pIn, size_t nIn, uint64_t x){
+  const char *p = (const char *)pIn;
+  uint64_t nBucket;
+  uint32_t high;
+  RoaringHeader h;
+  RoaringProbe probe;
+  if( p == NULL || nIn < sizeof(nBucket) ) return -1;
+  memcpy(&nBucket, p, sizeof(nBucket));
+  if( nBucket > UINT32_MAX ) return -1;
+  p += sizeof(nBucket);
+  nIn -= sizeof(nBucket);
+  for(uint64_t i=0; i < nBucket; i++){
+    if( nIn < sizeof(high) ) return -1;
+    memcpy(&high, p, sizeof(high));
+    if( high > (x >> 32) ) return 0;
+    p += sizeof(high);
+    nIn -= sizeof(high);
+    if( !roaringPortableHeaderInit(&h, p, nIn) ) return -1;
+    if( high == (x >> 32) ){
+      roaringProbeInit(&probe, &h);
+      return roaringProbeContains(&probe, (uint32_t)x);
+    }
+    p += h.nByte;
+    nIn -= h.nByte;
+  }
+  return 0;
+}
+
+/*
+  smallest (bMax is 0) or largest value of a serialized bitmap, only the
+  first or last container is read. 1 if found, 0 if the bitmap is empty
+  and -1 if it is not valid
+*/
+static int roaringHeaderBound(const RoaringHeader *h, int bMax, uint32_t *pOut){
+  const char *pC;
+  int i;
+  if( h->layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    if( h->nArray == 0 ) return 0;
+    memcpy(pOut, h->aArray + 4 * (bMax ? h->nArray - 1 : 0), sizeof(*pOut));
+    return 1;
+  }
+  if( h->nContainer == 0 ) return 0;
+  i = bMax ? h->nContainer - 1 : 0;
+  pC = roaringHeaderContainer(h, i);
+  if( pC == NULL ) return -1;
+  *pOut = ((uint32_t)roaringHeaderKey(h, i) << 16) | roaringHeaderContainerBound(h, i, pC, bMax);
+  return 1;
+}
+
+/*
+  number of values less than or equal to x in *pRank, the cardinalities of
+  the containers before x come from the header so only the container of x
+  is read. returns -1 if the bitmap is not valid
+*/
+static int roaringHeaderRank(const RoaringHeader *h, uint32_t x, uint64_t *pRank){
+  uint16_t key = (uint16_t)(x >> 16);
+  const char *pC;
+  *pRank = 0;
+  if( h->layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    int lo = 0, hi = (int)h->nArray;
+    uint32_t v;
+    while( lo < hi ){
+      int mid = lo + (hi - lo) / 2;
+      memcpy(&v, h->aArray + 4 * mid, sizeof(v));
+      if( v <= x ) lo = mid + 1; else hi = mid;
+    }
+    *pRank = (uint64_t)lo;
+    return 0;
+  }
+  for(int i=0; i < h->nContainer; i++){
+    uint16_t k = roaringHeaderKey(h, i);
+    if( k > key ) break;
+    if( k < key ){
+      *pRank += roaringHeaderCard(h, i);
+      continue;
+    }
+    pC = roaringHeaderContainer(h, i);
+    if( pC == NULL ) return -1;
+    *pRank += roaringHeaderContainerRank(h, i, pC, (uint16_t)x);
+    break;
+  }
+  return 0;
+}
+
+/*
+  n-th (0 based) value of a serialized bitmap, the container is found from
+  the header cardinalities. 1 if found, 0 if n is past the last value and
+  -1 if the bitmap is not valid
+*/
+static int roaringHeaderSelect(const RoaringHeader *h, uint64_t n, uint32_t *pOut){
+  const char *pC;
+  if( h->layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    if( n >= h->nArray ) return 0;
+    memcpy(pOut, h->aArray + 4 * n, sizeof(*pOut));
+    return 1;
+  }
+  for(int i=0; i < h->nContainer; i++){
+    uint32_t card = roaringHeaderCard(h, i);
+    if( n >= card ){
+      n -= card;
+      continue;
+    }
+    pC = roaringHeaderContainer(h, i);
+    if( pC == NULL ) return -1;
+    *pOut = ((uint32_t)roaringHeaderKey(h, i) << 16) | roaringHeaderContainerSelect(h, i, pC, (uint32_t)n);
+    return 1;
+  }
+  return 0;
+}
+
+/*
+  walks the values of a serialized bitmap in place, only the container the
+  iterator is on gets read (the serialized counterpart of
+  roaring_uint32_iterator_t). the functions below return 1 when the
+  iterator is on a value, 0 past the last one and -1 if the bitmap is not
+  valid
+*/
+typedef struct RoaringHeaderIterator RoaringHeaderIterator;
+struct RoaringHeaderIterator {
+  const RoaringHeader *h;
+  int i;                    // current container, or element of the array layout
+  const char *pC;           // payload of container i
+  uint32_t k;               // position in pC: array index, run or bitset word
+  uint32_t n;               // offset in the current run
+  uint64_t w;               // bits of the current bitset word not visited yet
+  uint32_t current_value;
+};
+
+/*
+  current_value from the position in container i
+*/
+static void roaringHeaderIteratorSet(RoaringHeaderIterator *it){
+  const RoaringHeader *h = it->h;
+  uint16_t low;
+  if( roaringHeaderIsRun(h, it->i) ){
+    memcpy(&low, it->pC + sizeof(uint16_t) + 4 * it->k, sizeof(low));
+    low += it->n;
+  }else if( roaringHeaderCard(h, it->i) > DEFAULT_MAX_SIZE ){
+    low = 64 * it->k + roaring_trailing_zeroes(it->w);
+  }else{
+    memcpy(&low, it->pC + 2 * it->k, sizeof(low));
+  }
+  it->current_value = ((uint32_t)roaringHeaderKey(h, it->i) << 16) | low;
+}
+
+/*
+  moves to the first value of container i that is >= low, 0 if there is none
+*/
+static int roaringHeaderIteratorSeekIn(RoaringHeaderIterator *it, uint16_t low){
+  const RoaringHeader *h = it->h;
+  uint16_t v, nRun, length;
+  int lo = 0, hi;
+  if( roaringHeaderIsRun(h, it->i) ){
+    memcpy(&nRun, it->pC, sizeof(nRun));
+    // last run starting at or before low
+    hi = (int)nRun - 1;
+    while( lo <= hi ){
+      int mid = (lo + hi) / 2;
+      memcpy(&v, it->pC + sizeof(nRun) + 4 * mid, sizeof(v));
+      if( v <= low ) lo = mid + 1; else hi = mid - 1;
+    }
+    it->k = 0;
+    it->n = 0;
+    if( hi >= 0 ){
+      memcpy(&v, it->pC + sizeof(nRun) + 4 * hi, sizeof(v));
+      memcpy(&length, it->pC + sizeof(nRun) + 4 * hi + 2, sizeof(length));
+      it->k = hi;
+      if( low - v <= length ) it->n = low - v; else it->k++;
+    }
+    if( it->k >= nRun ) return 0;
+  }else if( roaringHeaderCard(h, it->i) > DEFAULT_MAX_SIZE ){
+    it->k = low / 64;
+    it->w = roaringHeaderBitsetWord(it->pC, it->k) & (UINT64_MAX << (low % 64));
+    while( it->w == 0 ){
+      if( ++it->k >= BITSET_CONTAINER_SIZE_IN_WORDS ) return 0;
+      it->w = roaringHeaderBitsetWord(it->pC, it->k);
+    }
+  }else{
+    hi = (int)roaringHeaderCard(h, it->i);
+    while( lo < hi ){
+      int mid = (lo + hi) / 2;
+      memcpy(&v, it->pC + 2 * mid, sizeof(v));
+      if( v < low ) lo = mid + 1; else hi = mid;
+    }
+    it->k = lo;
+    if( it->k >= roaringHeaderCard(h, it->i) ) return 0;
+  }
+  roaringHeaderIteratorSet(it);
+  return 1;
+}
+
+/*
+  moves to the next value of container i, 0 if it was the last one
+*/
+static int roaringHeaderIteratorNextIn(RoaringHeaderIterator *it){
+  const RoaringHeader *h = it->h;
+  uint16_t nRun, length;
+  if( roaringHeaderIsRun(h, it->i) ){
+    memcpy(&nRun, it->pC, sizeof(nRun));
+    memcpy(&length, it->pC + sizeof(nRun) + 4 * it->k + 2, sizeof(length));
+    if( it->n++ >= length ){
+      it->n = 0;
+      if( ++it->k >= nRun ) return 0;
+    }
+  }else if( roaringHeaderCard(h, it->i) > DEFAULT_MAX_SIZE ){
+    it->w &= it->w - 1;
+    while( it->w == 0 ){
+      if( ++it->k >= BITSET_CONTAINER_SIZE_IN_WORDS ) return 0;
+      it->w = roaringHeaderBitsetWord(it->pC, it->k);
+    }
+  }else{
+    if( ++it->k >= roaringHeaderCard(h, it->i) ) return 0;
+  }
+  roaringHeaderIteratorSet(it);
+  return 1;
+}
+
+/*
+  first value >= low in the containers from i on
+*/
+static int roaringHeaderIteratorFrom(RoaringHeaderIterator *it, int i, uint16_t low){
+  for(it->i=i; it->i < it->h->nContainer; it->i++, low=0){
+    it->pC = roaringHeaderContainer(it->h, it->i);
+    if( it->pC == NULL ) return -1;
+    if( roaringHeaderIteratorSeekIn(it, low) ) return 1;
+  }
+  return 0;
+}
+
+/*
+  moves to the first value >= x, the container is found from the keys so
+  the ones before it are never read
+*/
+static int roaringHeaderIteratorMove(RoaringHeaderIterator *it, uint32_t x){
+  const RoaringHeader *h = it->h;
+  uint16_t key = (uint16_t)(x >> 16);
+  int lo = 0, hi;
+  uint32_t v;
+  if( h->layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    hi = (int)h->nArray;
+    while( lo < hi ){
+      int mid = lo + (hi - lo) / 2;
+      memcpy(&v, h->aArray + 4 * mid, sizeof(v));
+      if( v < x ) lo = mid + 1; else hi = mid;
+    }
+    it->i = lo;
+    if( lo >= (int)h->nArray ) return 0;
+    memcpy(&it->current_value, h->aArray + 4 * lo, sizeof(it->current_value));
+    return 1;
+  }
+  // first container with a key >= key
+  hi = h->nContainer;
+  while( lo < hi ){
+    int mid = (lo + hi) / 2;
+    if( roaringHeaderKey(h, mid) < key ) lo = mid + 1; else hi = mid;
+  }
+  if( lo < h->nContainer && roaringHeaderKey(h, lo) == key ){
+    return roaringHeaderIteratorFrom(it, lo, (uint16_t)x);
+  }
+  return roaringHeaderIteratorFrom(it, lo, 0);
+}
+
+/*
+  the iterator is not on a value until it is first moved
+*/
+static void roaringHeaderIteratorInit(RoaringHeaderIterator *it, const RoaringHeader *h){
+  memset(it, 0, sizeof(*it));
+  it->h = h;
+}
+
+static int roaringHeaderIteratorAdvance(RoaringHeaderIterator *it){
+  const RoaringHeader *h = it->h;
+  if( h->layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    if( ++it->i >= (int)h->nArray ) return 0;
+    memcpy(&it->current_value, h->aArray + 4 * it->i, sizeof(it->current_value));
+    return 1;
+  }
+  if( roaringHeaderIteratorNextIn(it) ) return 1;
+  return roaringHeaderIteratorFrom(it, it->i + 1, 0);
+}
+
+static int roaring64HeaderBound(const void *pIn, size_t nIn, int bMax, uint64_t *pOut){
+  Roaring64KeyCursor c;
+  uint32_t low;
+  int rc, bFound = 0;
+  if( !roaring64KeyCursorInit(&c, pIn, nIn) ) return -1;
+  while( (rc = roaring64KeyCursorBucket(&c)) == 1 ){
+    rc = roaringHeaderBound(&c.h, bMax, &low);
+    if( rc < 0 ) return -1;
+    if( rc == 0 ) continue;
+    *pOut = ((uint64_t)c.high << 32) | low;
+    bFound = 1;
+    if( !bMax ) return 1;
+  }
+  return rc < 0 ? -1 : bFound;
+}
+
+static int roaring64HeaderRank(const void *pIn, size_t nIn, uint64_t x, uint64_t *pRank){
+  Roaring64KeyCursor c;
+  uint64_t rank;
+  int rc;
+  *pRank = 0;
+  if( !roaring64KeyCursorInit(&c, pIn, nIn) ) return -1;
+  while( (rc = roaring64KeyCursorBucket(&c)) == 1 ){
+    if( c.high > (x >> 32) ) break;
+    if( c.high < (x >> 32) ){
+      *pRank += roaringHeaderCardinality(&c.h);
+      continue;
+    }
+    if( roaringHeaderRank(&c.h, (uint32_t)x, &rank) < 0 ) return -1;
+    *pRank += rank;
+    break;
+  }
+  return rc < 0 ? -1 : 0;
+}
+
+static int roaring64HeaderSelect(const void *pIn, size_t nIn, uint64_t n, uint64_t *pOut){
+  Roaring64KeyCursor c;
+  uint32_t low;
+  int rc;
+  if( !roaring64KeyCursorInit(&c, pIn, nIn) ) return -1;
+  while( (rc = roaring64KeyCursorBucket(&c)) == 1 ){
+    uint64_t card = roaringHeaderCardinality(&c.h);
+    if( n >= card ){
+      n -= card;
+      continue;
+    }
+    if( roaringHeaderSelect(&c.h, n, &low) <= 0 ) return -1;
+    *pOut = ((uint64_t)c.high << 32) | low;
+    return 1;
+  }
+  return rc;
+}
+
+static void roaringStatisticsAdd(
+  roaring64_statistics_t *st,
+  int bRun,
+  uint32_t card,
+  size_t nByte
+){
+  st->n_containers++;
+  st->cardinality += card;
+  if( bRun ){
+    st->n_run_containers++;
+    st->n_values_run_containers += card;
+    st->n_bytes_run_containers += nByte;
+  }else if( card > DEFAULT_MAX_SIZE ){
+    st->n_bitset_containers++;
+    st->n_values_bitset_containers += card;
+    st->n_bytes_bitset_containers += nByte;
+  }else{
+    st->n_array_containers++;
+    st->n_values_array_containers += card;
+    st->n_bytes_array_containers += nByte;
+  }
+}
+
+/*
+  adds the container counts, values and bytes of a serialized bitmap to
+  the statistics (min and max are left alone). the container types and
+  cardinalities are in the header, only run containers have their run
+  count read. the values of the array layout are counted as the
+  containers they deserialize into
+*/
+static void roaringHeaderStatistics(const RoaringHeader *h, roaring64_statistics_t *st){
+  const char *pC = h->aPayload;
+  uint32_t x = 0, card = 0;
+  uint16_t key = 0;
+  if( h->layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    for(uint32_t i=0; i <= h->nArray; i++){
+      if( i < h->nArray ) memcpy(&x, h->aArray + 4 * i, sizeof(x));
+      if( card > 0 && (i == h->nArray || (x >> 16) != key) ){
+        size_t nByte = 2 * (size_t)card;
+        if( card > DEFAULT_MAX_SIZE ) nByte = BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+        roaringStatisticsAdd(st, 0, card, nByte);
+        card = 0;
+      }
+      if( i == h->nArray ) break;
+      key = (uint16_t)(x >> 16);
+      card++;
+    }
+    return;
+  }
+  // the containers follow each other, the header init checked they fit
+  for(int i=0; i < h->nContainer; i++){
+    size_t nByte = roaringHeaderContainerSize(h, i, pC);
+    roaringStatisticsAdd(st, roaringHeaderIsRun(h, i), roaringHeaderCard(h, i), nByte);
+    pC += nByte;
+  }
+}
+
+static int roaring64HeaderStatistics(const void *pIn, size_t nIn, roaring64_statistics_t *st){
+  Roaring64KeyCursor c;
+  int rc;
+  if( !roaring64KeyCursorInit(&c, pIn, nIn) ) return -1;
+  while( (rc = roaring64KeyCursorBucket(&c)) == 1 ){
+    roaringHeaderStatistics(&c.h, st);
+  }
+  return rc;
+}
+
+/*
+  leading byte of bitmaps written by rb_freeze, follows the values used by
+  roaring_bitmap_serialize (1 for a uint32 array, 2 for containers). the
+  frozen bitmap is padded to start at ROARING_FROZEN_OFFSET, so it's 8 byte
+  aligned whenever the blob is
+*/
+#define ROARING_SERIALIZATION_FROZEN 3
+#define ROARING_FROZEN_OFFSET 8
+
+/*
+  roaring_bitmap_frozen_view, but the buffer only has to be 8 byte aligned
+  instead of 32: sqlite's allocator hands out blobs 8 bytes past a malloc
+  boundary, so they would never qualify. the bitset words are the only
+  8 byte values and CRoaring reads them with unaligned simd loads
+*/
+static const roaring_bitmap_t *roaringFrozenView(const char *buf, size_t length){
+  int32_t nContainer, nBitset = 0, nRun = 0, nArray = 0;
+  size_t szBitset = 0, szRun = 0, szArray = 0;
+  const uint16_t *aKey, *aCount;
+  const uint8_t *aType;
+  uint32_t header;
+  char *arena;
+  roaring_bitmap_t *rb;
+  if( (uintptr_t)buf % 8 != 0 || length < 4 ) return NULL;
+  memcpy(&header, buf + length - 4, 4);
+  if( (header & 0x7FFF) != FROZEN_COOKIE ) return NULL;
+  nContainer = (int32_t)(header >> 15);
+  // every zone has an even size, so the keys and counts are 2 byte aligned
+  if( length < 4 + (size_t)nContainer * 5 || (length - 4 - (size_t)nContainer * 5) % 2 != 0 ) return NULL;
+  aKey = (const uint16_t*)(buf + length - 4 - nContainer * 5);
+  aCount = (const uint16_t*)(buf + length - 4 - nContainer * 3);
+  aType = (const uint8_t*)(buf + length - 4 - nContainer);
+  for(int32_t i = 0; i < nContainer; i++){
+    uint16_t count = aCount[i];
+    switch( aType[i] ){
+      case BITSET_CONTAINER_TYPE:
+        nBitset++;
+        szBitset += BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+        break;
+      case RUN_CONTAINER_TYPE:
+        nRun++;
+        szRun += count * sizeof(rle16_t);
+        break;
+      case ARRAY_CONTAINER_TYPE:
+        nArray++;
+        szArray += (count + 1) * sizeof(uint16_t);
+        break;
+      default:
+        return NULL;
+    }
+  }
+  if( length != szBitset + szRun + szArray + 5 * (size_t)nContainer + 4 ) return NULL;
+  arena = roaring_malloc(sizeof(roaring_bitmap_t)
+    + nContainer * sizeof(container_t*)
+    + nBitset * sizeof(bitset_container_t)
+    + nRun * sizeof(run_container_t)
+    + nArray * sizeof(array_container_t));
+  if( arena == NULL ) return NULL;
+  uint64_t *pBitset = (uint64_t*)buf;
+  rle16_t *pRun = (rle16_t*)(buf + szBitset);
+  uint16_t *pArray = (uint16_t*)(buf + szBitset + szRun);
+  rb = (roaring_bitmap_t*)arena_alloc(&arena, sizeof(roaring_bitmap_t));
+  rb->high_low_container.flags = ROARING_FLAG_FROZEN;
+  rb->high_low_container.allocation_size = nContainer;
+  rb->high_low_container.size = nContainer;
+  rb->high_low_container.keys = (uint16_t*)aKey;
+  rb->high_low_container.typecodes = (uint8_t*)aType;
+  rb->high_low_container.containers = (container_t**)arena_alloc(&arena, sizeof(container_t*) * nContainer);
+  for(int32_t i = 0; i < nContainer; i++){
+    uint16_t count = aCount[i];
+    if( aType[i] == BITSET_CONTAINER_TYPE ){
+      bitset_container_t *c = (bitset_container_t*)arena_alloc(&arena, sizeof(*c));
+      c->words = pBitset;
+      c->cardinality = count + 1;
+      pBitset += BITSET_CONTAINER_SIZE_IN_WORDS;
+      rb->high_low_container.containers[i] = c;
+    }else if( aType[i] == RUN_CONTAINER_TYPE ){
+      run_container_t *c = (run_container_t*)arena_alloc(&arena, sizeof(*c));
+      c->capacity = count;
+      c->n_runs = count;
+      c->runs = pRun;
+      pRun += count;
+      rb->high_low_container.containers[i] = c;
+    }else{
+      array_container_t *c = (array_container_t*)arena_alloc(&arena, sizeof(*c));
+      c->capacity = count + 1;
+      c->cardinality = count + 1;
+      c->array = pArray;
+      pArray += count + 1;
+      rb->high_low_container.containers[i] = c;
+    }
+  }
+  return rb;
+}
+
+/*
+  a read only bitmap taken from a blob, frozen blobs are used in place
+  while the other layouts are deserialized
+*/
+typedef struct RoaringView RoaringView;
+struct RoaringView {
+  const roaring_bitmap_t *rb;
+  char *pCopy;              // aligned copy of a misaligned frozen blob
+  int bBorrowed;            // rb is a view over memory owned by sqlite
+  int bShared;              // rb is owned by aux data or a pointer value
+  int bArena;               // rb was allocated in the connection's arena
+};
+
+static void roaringViewFree(RoaringView *v){
+  if( !v->bShared ){
+    if( v->rb != NULL ) roaring_bitmap_free(v->rb);
+    if( v->pCopy != NULL ) roaring_aligned_free(v->pCopy);
+  }
+  memset(v, 0, sizeof(*v));
+}
+
+static void roaringViewDestroy(RoaringView *v){
+  roaringViewFree(v);
+  sqlite3_free(v);
+}
+
+static int roaringViewInit(RoaringView *v, const void *pIn, size_t nIn){
+  const char *p = (const char *)pIn;
+  memset(v, 0, sizeof(*v));
+  if( p == NULL || nIn < 1 ) return 0;
+  if( p[0] != ROARING_SERIALIZATION_FROZEN ){
+    v->rb = roaring_bitmap_deserialize_safe(p, nIn);
+    return v->rb != NULL;
+  }
+  if( nIn < ROARING_FROZEN_OFFSET + sizeof(uint32_t) ) return 0;
+  p += ROARING_FROZEN_OFFSET;
+  nIn -= ROARING_FROZEN_OFFSET;
+  if( (uintptr_t)p % 8 != 0 ){
+    // sqlite makes no alignment promise for blobs, view an aligned copy
+    v->pCopy = roaring_aligned_malloc(32, nIn);
+    if( v->pCopy == NULL ) return 0;
+    memcpy(v->pCopy, p, nIn);
+    p = v->pCopy;
+  }else{
+    v->bBorrowed = 1;
+  }
+  v->rb = roaringFrozenView(p, nIn);
+  if( v->rb == NULL ){
+    roaringViewFree(v);
+    return 0;
+  }
+  return 1;
+}
+
+/*
+  deserializes a blob into a bitmap that can be modified, accepts all the
+  layouts including frozen ones
+*/
+static roaring_bitmap_t *roaringDeserialize(const void *pIn, size_t nIn){
+  const char *p = (const char *)pIn;
+  RoaringView v;
+  roaring_bitmap_t *r;
+  if( p == NULL || nIn < 1 ) return NULL;
+  if( p[0] != ROARING_SERIALIZATION_FROZEN ){
+    return roaring_bitmap_deserialize_safe(p, nIn);
+  }
+  if( !roaringViewInit(&v, p, nIn) ) return NULL;
+  r = roaring_bitmap_copy(v.rb);
+  roaringViewFree(&v);
+  return r;
+}
+
+/*
+  bitmaps can be passed between functions as pointer values instead of
+  blobs, which saves a serialize/deserialize round trip per nested call.
+  rb_ptr() turns a blob into a pointer, functions that get a pointer
+  argument return a pointer, and rb_blob() serializes it back
+*/
+#define ROARING_POINTER_TYPE "rbitmap"
+#define ROARING64_POINTER_TYPE "rbitmap64"
+
+/*
+  rb_cached() returns entries of the connection's bitmap cache as pointers
+  of their own type. entries are reference counted, so one that is evicted
+  while a statement still holds it is freed when the last pointer goes
+*/
+#define ROARING_CACHED_POINTER_TYPE "rbitmap_cached"
+
+typedef struct RoaringCacheEntry RoaringCacheEntry;
+struct RoaringCacheEntry {
+  void *pBitmap;                /* roaring_bitmap_t or roaring64_bitmap_t */
+  int bWide;                    /* true for a 64 bit bitmap */
+  int nRef;                     /* pointer values, plus one while cached */
+  char *zDb;                    /* schema name, NULL if not given */
+  char *zTab;                   /* table name, allocated with the entry */
+  char *zCol;                   /* column name, empty if not given */
+  sqlite3_int64 iRowid;
+  sqlite3_int64 nByte;          /* size of the blob it was read from */
+  sqlite3_uint64 iCheck;        /* hash of the blob it was read from */
+  unsigned int iHash;
+  RoaringCacheEntry *pHashNext;
+  RoaringCacheEntry *pLruPrev;  /* more recently used */
+  RoaringCacheEntry *pLruNext;  /* less recently used */
+};
+
+static roaring_bitmap_t *roaringValuePointer(sqlite3_value *pVal){
+  RoaringCacheEntry *p = (RoaringCacheEntry*)sqlite3_value_pointer(pVal, ROARING_CACHED_POINTER_TYPE);
+  if( p != NULL ){
+    return p->bWide ? NULL : (roaring_bitmap_t*)p->pBitmap;
+  }
+  return (roaring_bitmap_t*)sqlite3_value_pointer(pVal, ROARING_POINTER_TYPE);
+}
+
+static roaring64_bitmap_t *roaring64ValuePointer(sqlite3_value *pVal){
+  RoaringCacheEntry *p = (RoaringCacheEntry*)sqlite3_value_pointer(pVal, ROARING_CACHED_POINTER_TYPE);
+  if( p != NULL ){
+    return p->bWide ? (roaring64_bitmap_t*)p->pBitmap : NULL;
+  }
+  return (roaring64_bitmap_t*)sqlite3_value_pointer(pVal, ROARING64_POINTER_TYPE);
+}
+
+/*
+  read only bitmap from either a pointer or a blob value
+*/
+static int roaringValueView(RoaringView *v, sqlite3_value *pVal){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  roaring_bitmap_t *p = roaringValuePointer(pVal);
+  if( p != NULL ){
+    memset(v, 0, sizeof(*v));
+    v->rb = p;
+    v->bShared = 1;
+    return 1;
+  }
+  pIn = sqlite3_value_blob(pVal);
+  nIn = sqlite3_value_bytes(pVal);
+  return roaringViewInit(v, pIn, nIn);
+}
+
+/*
+  bitmap that can be modified from either a pointer or a blob value
+*/
+static roaring_bitmap_t *roaringValueDeserialize(sqlite3_value *pVal){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  roaring_bitmap_t *p = roaringValuePointer(pVal);
+  if( p != NULL ){
+    return roaring_bitmap_copy(p);
+  }
+  pIn = sqlite3_value_blob(pVal);
+  nIn = sqlite3_value_bytes(pVal);
+  return roaringDeserialize(pIn, nIn);
+}
+
+static roaring64_bitmap_t *roaring64ValueDeserialize(sqlite3_value *pVal){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  roaring64_bitmap_t *p = roaring64ValuePointer(pVal);
+  if( p != NULL ){
+    return roaring64_bitmap_copy(p);
+  }
+  pIn = sqlite3_value_blob(pVal);
+  nIn = sqlite3_value_bytes(pVal);
+  return roaring64_bitmap_portable_deserialize_safe((const char*)pIn, nIn);
+}
+
+/*
+  bitmaps deserialized by rb_cached(), keyed by table name and rowid. the
+  entries are kept in least recently used order and evicted once their
+  blobs add up to more than nMaxByte bytes
+*/
+typedef struct RoaringCache RoaringCache;
+struct RoaringCache {
+  sqlite3_int64 nMaxByte;       /* size limit */
+  sqlite3_int64 nByte;          /* size of the cached entries */
+  int nEntry;                   /* number of cached entries */
+  int nSlot;                    /* size of aSlot, a power of two */
+  RoaringCacheEntry **aSlot;    /* hash table on table name and rowid */
+  RoaringCacheEntry *pLruFirst; /* most recently used */
+  RoaringCacheEntry *pLruLast;  /* next to be evicted */
+};
+
+/*
+  per connection settings, passed as user data to every function. bitmaps
+  whose serialized size is at least nOptimizeMin bytes are run optimized
+  before they are serialized, -1 turns that off. pCache is NULL until
+  rb_cache_config() turns the cache on
+*/
+typedef struct RoaringConfig RoaringConfig;
+struct RoaringConfig {
+  sqlite3_int64 nOptimizeMin;
+  RoaringCache *pCache;
+  RoaringArena arena;
+};
+
+#define ROARING_OPTIMIZE_ALWAYS 0
+#define ROARING_OPTIMIZE_NEVER  -1
+
+static sqlite3_int64 roaringOptimizeMin(sqlite3_context *context){
+  RoaringConfig *pConfig = (RoaringConfig*)sqlite3_user_data(context);
+  return pConfig ? pConfig->nOptimizeMin : ROARING_OPTIMIZE_ALWAYS;
+}
+
+/*
+  the compaction stage in front of every serialization of an owned bitmap
+*/
+static int roaringCompactWanted(sqlite3_context *context, const roaring_bitmap_t *r){
+  sqlite3_int64 nMin = roaringOptimizeMin(context);
+  if( nMin == ROARING_OPTIMIZE_NEVER ) return 0;
+  return nMin == 0 || (sqlite3_int64)roaring_bitmap_size_in_bytes(r) >= nMin;
+}
+
+static int roaring64CompactWanted(sqlite3_context *context, const roaring64_bitmap_t *r){
+  sqlite3_int64 nMin = roaringOptimizeMin(context);
+  if( nMin == ROARING_OPTIMIZE_NEVER ) return 0;
+  return nMin == 0 || (sqlite3_int64)roaring64_bitmap_portable_size_in_bytes(r) >= nMin;
+}
+
+static void roaringCompact(sqlite3_context *context, roaring_bitmap_t *r){
+  if( roaringCompactWanted(context, r) ) roaring_bitmap_run_optimize(r);
+}
+
+static void roaring64Compact(sqlite3_context *context, roaring64_bitmap_t *r){
+  if( roaring64CompactWanted(context, r) ) roaring64_bitmap_run_optimize(r);
+}
+
+/*
+  serializes the bitmap as the function result
+*/
+static void roaringResultBlob(sqlite3_context *context, const roaring_bitmap_t *r){
+  int nSize = (int) roaring_bitmap_size_in_bytes(r);
+  char *pOut = sqlite3_malloc(nSize);
+  if( pOut == NULL ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  int nOut = (int) roaring_bitmap_serialize(r, pOut);
+  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+}
+
+static void roaring64ResultBlob(sqlite3_context *context, const roaring64_bitmap_t *r){
+  int64_t nSize = (int64_t) roaring64_bitmap_portable_size_in_bytes(r);
+  char *pOut = sqlite3_malloc64(nSize);
+  if( pOut == NULL ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  int64_t nOut = (int64_t) roaring64_bitmap_portable_serialize(r, pOut);
+  sqlite3_result_blob64(context, pOut, nOut, sqlite3_free);  
+}
+
+/*
+  serializes a bitmap the function does not own (a pointer value or an
+  aggregate's bitmap) through the compaction stage. it can be in use
+  elsewhere, e.g. iterated by a cursor, so a copy is compacted instead
+*/
+static void roaringResultBlobShared(sqlite3_context *context, const roaring_bitmap_t *r){
+  roaring_bitmap_t *pCopy;
+  if( !roaringCompactWanted(context, r) ){
+    roaringResultBlob(context, r);
+    return;
+  }
+  if( (pCopy = roaring_bitmap_copy(r)) == NULL ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  roaring_bitmap_run_optimize(pCopy);
+  roaringResultBlob(context, pCopy);
+  roaring_bitmap_free(pCopy);
+}
+
+static void roaring64ResultBlobShared(sqlite3_context *context, const roaring64_bitmap_t *r){
+  roaring64_bitmap_t *pCopy;
+  if( !roaring64CompactWanted(context, r) ){
+    roaring64ResultBlob(context, r);
+    return;
+  }
+  if( (pCopy = roaring64_bitmap_copy(r)) == NULL ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  roaring64_bitmap_run_optimize(pCopy);
+  roaring64ResultBlob(context, pCopy);
+  roaring64_bitmap_free(pCopy);
+}
+
+/*
+  sets the bitmap as the function result, either as a pointer or as a
+  serialized blob (compacted first), takes ownership of the bitmap
+*/
+static void roaringResult(sqlite3_context *context, roaring_bitmap_t *r, int bPointer){
+  if( r == NULL ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  if( bPointer ){
+    sqlite3_result_pointer(context, r, ROARING_POINTER_TYPE, (void(*)(void*))roaringFreeFunc);
+    return;
+  }
+  roaringCompact(context, r);
+  roaringResultBlob(context, r);
+  roaring_bitmap_free(r);  
+}
+
+static void roaring64Result(sqlite3_context *context, roaring64_bitmap_t *r, int bPointer){
+  if( r == NULL ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  if( bPointer ){
+    sqlite3_result_pointer(context, r, ROARING64_POINTER_TYPE, (void(*)(void*))roaring64FreeFunc);
+    return;
+  }
+  roaring64Compact(context, r);
+  roaring64ResultBlob(context, r);
+  roaring64_bitmap_free(r);  
+}
+
+/*
+  aux data left for an argument whose bitmap was deserialized in the arena,
+  which can't outlive the call. if sqlite keeps it the argument is constant,
+  and the next call deserializes it on the heap so it can be kept instead
+*/
+static const char roaringArgConstant = 0;
+#define ROARING_ARG_CONSTANT ((void*)&roaringArgConstant)
+
+/*
+  read only bitmap for argument i of a function. a constant argument (e.g.
+  a bound filter bitmap) is deserialized once and then kept as function aux
+  data by roaringArgRelease, sqlite drops the aux data of the other
+  arguments after every call. those are deserialized in the connection's
+  arena
+*/
+static int roaringArgInit(
+  sqlite3_context *context,
+  sqlite3_value **argv,
+  int i,
+  RoaringView *v
+){
+  RoaringConfig *pConfig = (RoaringConfig*)sqlite3_user_data(context);
+  RoaringView *pAux = (RoaringView*)sqlite3_get_auxdata(context, i);
+  RoaringArena *pPrev;
+  unsigned int nAlloc;
+  int ok;
+  if( pAux == ROARING_ARG_CONSTANT ){
+    return roaringValueView(v, argv[i]);
+  }
+  if( pAux != NULL ){
+    memset(v, 0, sizeof(*v));
+    v->rb = pAux->rb;
+    v->bShared = 1;
+    return 1;
+  }
+  nAlloc = pConfig->arena.nAlloc;
+  pPrev = roaringArenaEnter(&pConfig->arena);
+  ok = roaringValueView(v, argv[i]);
+  roaringArenaLeave(pPrev);
+  v->bArena = pConfig->arena.nAlloc != nAlloc;
+  return ok;
+}
+
+/*
+  done with the bitmap of argument i, should be called once the result is
+  computed as the aux data destructor might run right away
+*/
+static void roaringArgRelease(sqlite3_context *context, int i, RoaringView *v){
+  RoaringConfig *pConfig = (RoaringConfig*)sqlite3_user_data(context);
+  RoaringView *pAux;
+  if( v->bArena ){
+    RoaringArena *pPrev = roaringArenaEnter(&pConfig->arena);
+    int bKeep = v->rb != NULL && !v->bBorrowed;
+    roaringViewFree(v);
+    roaringArenaLeave(pPrev);
+    if( bKeep ) sqlite3_set_auxdata(context, i, ROARING_ARG_CONSTANT, 0);
+    return;
+  }
+  if( v->bShared || v->rb == NULL || v->bBorrowed ){
+    // borrowed views point into the value memory which may not outlive the call
+    roaringViewFree(v);
+    return;
+  }
+  pAux = (RoaringView*)sqlite3_malloc(sizeof(*pAux));
+  if( pAux == NULL ){
+    roaringViewFree(v);
+    return;
+  }
+  *pAux = *v;
+  memset(v, 0, sizeof(*v));
+  sqlite3_set_auxdata(context, i, pAux, (void(*)(void*))roaringViewDestroy);
+}
+
+static roaring64_bitmap_t *roaring64ArgInit(
+  sqlite3_context *context,
+  sqlite3_value **argv,
+  int i
+){
+  RoaringConfig *pConfig = (RoaringConfig*)sqlite3_user_data(context);
+  const unsigned char *pIn;
+  unsigned int nIn;
+  RoaringArena *pPrev;
+  unsigned int nAlloc;
+  void *pAux;
+  roaring64_bitmap_t *r = roaring64ValuePointer(argv[i]);
+  if( r != NULL ) return r;
+  pAux = sqlite3_get_auxdata(context, i);
+  if( pAux != NULL && pAux != ROARING_ARG_CONSTANT ) return (roaring64_bitmap_t*)pAux;
+  pIn = sqlite3_value_blob(argv[i]);
+  nIn = sqlite3_value_bytes(argv[i]);
+  if( pAux == ROARING_ARG_CONSTANT ){
+    return roaring64_bitmap_portable_deserialize_safe((const char*)pIn, nIn);
+  }
+  nAlloc = pConfig->arena.nAlloc;
+  pPrev = roaringArenaEnter(&pConfig->arena);
+  r = roaring64_bitmap_portable_deserialize_safe((const char*)pIn, nIn);
+  roaringArenaLeave(pPrev);
+  if( r != NULL && pConfig->arena.nAlloc != nAlloc && !roaringArenaOwns(&pConfig->arena, r) ){
+    // roaring64ArgRelease tells arena bitmaps apart by their address,
+    // so a bitmap only partly in the arena is moved to the heap
+    roaring64_bitmap_t *pCopy = roaring64_bitmap_copy(r);
+    pPrev = roaringArenaEnter(&pConfig->arena);
+    roaring64_bitmap_free(r);
+    roaringArenaLeave(pPrev);
+    r = pCopy;
+  }
+  return r;
+}
+
+static void roaring64ArgRelease(
+  sqlite3_context *context,
+  sqlite3_value **argv,
+  int i,
+  roaring64_bitmap_t *r
+){
+  RoaringConfig *pConfig = (RoaringConfig*)sqlite3_user_data(context);
+  if( r == NULL || r == sqlite3_get_auxdata(context, i) ) return;
+  if( r == roaring64ValuePointer(argv[i]) ) return;
+  if( roaringArenaOwns(&pConfig->arena, r) ){
+    RoaringArena *pPrev = roaringArenaEnter(&pConfig->arena);
+    roaring64_bitmap_free(r);
+    roaringArenaLeave(pPrev);
+    sqlite3_set_auxdata(context, i, ROARING_ARG_CONSTANT, 0);
+    return;
+  }
+  sqlite3_set_auxdata(context, i, r, (void(*)(void*))roaring64FreeFunc);
+}
+
+/*********************************************
+  rb_create(e1, e2, e3, .. , en)
+  --------------------------------------------
+  creates a new bitmap comprised of all the supplied integers
+*********************************************/
+static void roaringCreateFunc(  
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring_bitmap_t *r = roaring_bitmap_create();
+  for(int i=0; i < argc; i++){
+    if( sqlite3_value_type(argv[i])!=SQLITE_INTEGER ){
+      roaring_bitmap_free(r);
+      sqlite3_result_error(context, "invalid argument", -1);
+      return;
+    }
+    roaring_bitmap_add(r, sqlite3_value_int(argv[i]));
+  }
+  roaringResult(context, r, 0);
+}
+
+static void roaring64CreateFunc(  
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r = roaring64_bitmap_create();
+  for(int i=0; i < argc; i++){
+    if( sqlite3_value_type(argv[i])!=SQLITE_INTEGER ){
+      roaring64_bitmap_free(r);
+      sqlite3_result_error(context, "invalid argument", -1);
+      return;
+    }
+    roaring64_bitmap_add(r, sqlite3_value_int64(argv[i]));
+  }
+  roaring64Result(context, r, 0);
+}
+
+/*
+  bit sliced counter of elements, slice i holds the elements whose count has
+  bit i set. the window versions of the aggregates use it to take a row back
+  out without dropping elements that other rows in the frame still hold.
+  rb_group_create counts the extra occurrences of a value, rb_group_or
+  counts the rows holding an element
+*/
+#define ROARING_COUNTER_NSLICE 64
+
+typedef struct RoaringCounter RoaringCounter;
+struct RoaringCounter {
+  int nSlice;
+  roaring_bitmap_t *aSlice[ROARING_COUNTER_NSLICE];
+};
+
+typedef struct Roaring64Counter Roaring64Counter;
+struct Roaring64Counter {
+  int nSlice;
+  roaring64_bitmap_t *aSlice[ROARING_COUNTER_NSLICE];
+};
+
+static void roaringCounterFree(RoaringCounter *c){
+  if( c==NULL ) return;
+  for(int i=0; i < c->nSlice; i++) roaring_bitmap_free(c->aSlice[i]);
+  sqlite3_free(c);
+}
+
+static void roaring64CounterFree(Roaring64Counter *c){
+  if( c==NULL ) return;
+  for(int i=0; i < c->nSlice; i++) roaring64_bitmap_free(c->aSlice[i]);
+  sqlite3_free(c);
+}
+
+static void roaringCounterTrim(RoaringCounter *c){
+  while( c->nSlice > 0 && roaring_bitmap_is_empty(c->aSlice[c->nSlice-1]) ){
+    roaring_bitmap_free(c->aSlice[--c->nSlice]);
+  }
+}
+
+static void roaring64CounterTrim(Roaring64Counter *c){
+  while( c->nSlice > 0 && roaring64_bitmap_is_empty(c->aSlice[c->nSlice-1]) ){
+    roaring64_bitmap_free(c->aSlice[--c->nSlice]);
+  }
+}
+
+/*
+  adds 2^iSlice to the count of every element of s, returns 0 on oom
+*/
+static int roaringCounterAdd(RoaringCounter *c, const roaring_bitmap_t *s, int iSlice){
+  roaring_bitmap_t *carry = roaring_bitmap_copy(s);
+  while( carry!=NULL && c->nSlice < iSlice ){
+    c->aSlice[c->nSlice] = roaring_bitmap_create();
+    if( c->aSlice[c->nSlice]==NULL ){
+      roaring_bitmap_free(carry);
+      return 0;
+    }
+    c->nSlice++;
+  }
+  for(int i=iSlice; carry!=NULL && i < ROARING_COUNTER_NSLICE; i++){
+    roaring_bitmap_t *next;
+    if( roaring_bitmap_is_empty(carry) ) break;
+    if( i==c->nSlice ){
+      c->aSlice[c->nSlice++] = carry;
+      return 1;
+    }
+    next = roaring_bitmap_and(c->aSlice[i], carry);
+    roaring_bitmap_xor_inplace(c->aSlice[i], carry);
+    roaring_bitmap_free(carry);
+    carry = next;
+  }
+  if( carry==NULL ) return 0;
+  roaring_bitmap_free(carry);
+  return 1;
+}
+
+static int roaring64CounterAdd(Roaring64Counter *c, const roaring64_bitmap_t *s, int iSlice){
+  roaring64_bitmap_t *carry = roaring64_bitmap_copy(s);
+  while( carry!=NULL && c->nSlice < iSlice ){
+    c->aSlice[c->nSlice] = roaring64_bitmap_create();
+    if( c->aSlice[c->nSlice]==NULL ){
+      roaring64_bitmap_free(carry);
+      return 0;
+    }
+    c->nSlice++;
+  }
+  for(int i=iSlice; carry!=NULL && i < ROARING_COUNTER_NSLICE; i++){
+    roaring64_bitmap_t *next;
+    if( roaring64_bitmap_is_empty(carry) ) break;
+    if( i==c->nSlice ){
+      c->aSlice[c->nSlice++] = carry;
+      return 1;
+    }
+    next = roaring64_bitmap_and(c->aSlice[i], carry);
+    roaring64_bitmap_xor_inplace(c->aSlice[i], carry);
+    roaring64_bitmap_free(carry);
+    carry = next;
+  }
+  if( carry==NULL ) return 0;
+  roaring64_bitmap_free(carry);
+  return 1;
+}
+
+/*
+  decrements the count of every element of s, all of them must have an
+  extra count. returns 0 on oom
+*/
+static int roaringCounterRemove(RoaringCounter *c, const roaring_bitmap_t *s){
+  roaring_bitmap_t *borrow = roaring_bitmap_copy(s);
+  for(int i=0; borrow!=NULL && i < c->nSlice; i++){
+    roaring_bitmap_t *next;
+    if( roaring_bitmap_is_empty(borrow) ) break;
+    next = roaring_bitmap_andnot(borrow, c->aSlice[i]);
+    roaring_bitmap_xor_inplace(c->aSlice[i], borrow);
+    roaring_bitmap_free(borrow);
+    borrow = next;
+  }
+  if( borrow==NULL ) return 0;
+  roaring_bitmap_free(borrow);
+  roaringCounterTrim(c);
+  return 1;
+}
+
+static int roaring64CounterRemove(Roaring64Counter *c, const roaring64_bitmap_t *s){
+  roaring64_bitmap_t *borrow = roaring64_bitmap_copy(s);
+  for(int i=0; borrow!=NULL && i < c->nSlice; i++){
+    roaring64_bitmap_t *next;
+    if( roaring64_bitmap_is_empty(borrow) ) break;
+    next = roaring64_bitmap_andnot(borrow, c->aSlice[i]);
+    roaring64_bitmap_xor_inplace(c->aSlice[i], borrow);
+    roaring64_bitmap_free(borrow);
+    borrow = next;
+  }
+  if( borrow==NULL ) return 0;
+  roaring64_bitmap_free(borrow);
+  roaring64CounterTrim(c);
+  return 1;
+}
+
+/*
+  the elements of s whose count has a bit set in slice iSlice or above,
+  returns NULL on oom
+*/
+static roaring_bitmap_t *roaringCounterAnd(RoaringCounter *c, const roaring_bitmap_t *s, int iSlice){
+  roaring_bitmap_t *r = roaring_bitmap_create();
+  for(int i=iSlice; r!=NULL && i < c->nSlice; i++){
+    roaring_bitmap_t *t = roaring_bitmap_and(c->aSlice[i], s);
+    if( t==NULL ){
+      roaring_bitmap_free(r);
+      return NULL;
+    }
+    roaring_bitmap_or_inplace(r, t);
+    roaring_bitmap_free(t);
+  }
+  return r;
+}
+
+static roaring64_bitmap_t *roaring64CounterAnd(Roaring64Counter *c, const roaring64_bitmap_t *s, int iSlice){
+  roaring64_bitmap_t *r = roaring64_bitmap_create();
+  for(int i=iSlice; r!=NULL && i < c->nSlice; i++){
+    roaring64_bitmap_t *t = roaring64_bitmap_and(c->aSlice[i], s);
+    if( t==NULL ){
+      roaring64_bitmap_free(r);
+      return NULL;
+    }
+    roaring64_bitmap_or_inplace(r, t);
+    roaring64_bitmap_free(t);
+  }
+  return r;
+}
+
+/*
+  single value removal used by rb_group_create, returns 0 if value had no
+  extra count (nothing is changed then)
+*/
+static int roaringCounterRemoveValue(RoaringCounter *c, uint32_t value){
+  int i;
+  for(i=0; i < c->nSlice; i++){
+    if( roaring_bitmap_contains(c->aSlice[i], value) ) break;
+  }
+  if( i==c->nSlice ) return 0;
+  for(i=0; i < c->nSlice; i++){
+    if( roaring_bitmap_remove_checked(c->aSlice[i], value) ) break;
+    roaring_bitmap_add(c->aSlice[i], value);
+  }
+  roaringCounterTrim(c);
+  return 1;
+}
+
+static int roaring64CounterRemoveValue(Roaring64Counter *c, uint64_t value){
+  int i;
+  for(i=0; i < c->nSlice; i++){
+    if( roaring64_bitmap_contains(c->aSlice[i], value) ) break;
+  }
+  if( i==c->nSlice ) return 0;
+  for(i=0; i < c->nSlice; i++){
+    if( roaring64_bitmap_remove_checked(c->aSlice[i], value) ) break;
+    roaring64_bitmap_add(c->aSlice[i], value);
+  }
+  roaring64CounterTrim(c);
+  return 1;
+}
+
+/*
+  struct to hold a roaring bitmap, rb_group_create also keeps the run of
+  consecutive values it has not added yet and a bulk context that remembers
+  the last container written to.
+
+  rb_group_create and rb_group_or count repeated elements in pCount so they
+  can be used as window functions. xStep cannot tell a window from a plain
+  aggregate, so it only logs what the counter would need (the repeated
+  values or a copy of the row) and the log is folded into pCount by the
+  first xInverse that needs it, or once it outgrows ROARING_LOG_MAX bytes.
+
+  rb_group_or only logs rows once xValue or xInverse has shown it's a
+  window. before that it keeps the first ROARING_LOG_AHEAD rows, enough for
+  frames that start with rows ahead of the current one, and then drops them
+  so a plain aggregate stays a lazy or. an xInverse while dropped rows are
+  still in the frame is an error
+*/
+#define ROARING_LOG_MAX (16*1024*1024)
+#define ROARING_LOG_AHEAD 64
+
+typedef struct RoaringContext RoaringContext;
+struct RoaringContext {
+  unsigned init;
+  roaring_bitmap_t *rb;
+  int bRun;
+  uint32_t iRunStart;
+  uint32_t iRunEnd;
+  uint32_t iMax;                   // largest value stepped so far
+  roaring_bulk_context_t bulk;
+  int bLazy;                       // rb needs roaring_bitmap_repair_after_lazy
+  RoaringCounter *pCount;
+  int nLog;                        // entries in aDup or aRow not counted yet
+  int nLogAlloc;
+  size_t szLog;                    // approximate bytes held by the log
+  uint32_t *aDup;                  // rb_group_create: repeated values
+  roaring_bitmap_t **aRow;         // rb_group_or: rows
+  int bWindow;                     // rb_group_or: xValue or xInverse was called
+  int bLost;                       // rb_group_or: rows were dropped from the log
+};
+
+typedef struct Roaring64Context Roaring64Context;
+struct Roaring64Context {
+  unsigned init;
+  roaring64_bitmap_t *rb;
+  int bRun;
+  uint64_t iRunStart;
+  uint64_t iRunEnd;
+  uint64_t iMax;
+  roaring64_bulk_context_t bulk;
+  Roaring64Counter *pCount;
+  int nLog;
+  int nLogAlloc;
+  size_t szLog;
+  uint64_t *aDup;
+  roaring64_bitmap_t **aRow;
+  int bWindow;
+  int bLost;
+};
+
+static RoaringCounter *roaringContextCounter(RoaringContext *rc){
+  if( rc->pCount==NULL ){
+    rc->pCount = sqlite3_malloc(sizeof(*rc->pCount));
+    if( rc->pCount ) memset(rc->pCount, 0, sizeof(*rc->pCount));
+  }
+  return rc->pCount;
+}
+
+static Roaring64Counter *roaring64ContextCounter(Roaring64Context *rc){
+  if( rc->pCount==NULL ){
+    rc->pCount = sqlite3_malloc(sizeof(*rc->pCount));
+    if( rc->pCount ) memset(rc->pCount, 0, sizeof(*rc->pCount));
+  }
+  return rc->pCount;
+}
+
+static void roaringContextRepair(RoaringContext *rc){
+  if( rc->bLazy ){
+    roaring_bitmap_repair_after_lazy(rc->rb);
+    rc->bLazy = 0;
+  }
+}
+
+/*
+  adds the pending run to the bitmap, single values go through the bulk
+  context while longer runs are added as a range (which invalidates it)
+*/
+static void roaringContextFlush(RoaringContext *rc){
+  if( !rc->bRun ) return;
+  if( rc->iRunStart==rc->iRunEnd ){
+    roaring_bitmap_add_bulk(rc->rb, &rc->bulk, rc->iRunStart);
+  }else{
+    roaring_bitmap_add_range_closed(rc->rb, rc->iRunStart, rc->iRunEnd);
+    memset(&rc->bulk, 0, sizeof(rc->bulk));
+  }
+  rc->bRun = 0;
+}
+
+static void roaring64ContextFlush(Roaring64Context *rc){
+  if( !rc->bRun ) return;
+  if( rc->iRunStart==rc->iRunEnd ){
+    roaring64_bitmap_add_bulk(rc->rb, &rc->bulk, rc->iRunStart);
+  }else{
+    roaring64_bitmap_add_range_closed(rc->rb, rc->iRunStart, rc->iRunEnd);
+    memset(&rc->bulk, 0, sizeof(rc->bulk));
+  }
+  rc->bRun = 0;
+}
+
+/*
+  makes room for one more entry in a log array, returns the (possibly moved)
+  array or NULL on oom, in which case a is left alone
+*/
+static void *roaringLogGrow(void *a, int nLog, int *pnAlloc, size_t szEntry){
+  int n;
+  if( nLog < *pnAlloc ) return a;
+  n = *pnAlloc ? *pnAlloc*2 : 64;
+  a = sqlite3_realloc64(a, n*(sqlite3_uint64)szEntry);
+  if( a ) *pnAlloc = n;
+  return a;
+}
+
+static int roaringCompare32(const void *p1, const void *p2){
+  uint32_t x1 = *(const uint32_t*)p1;
+  uint32_t x2 = *(const uint32_t*)p2;
+  return (x1 > x2) - (x1 < x2);
+}
+
+static int roaringCompare64(const void *p1, const void *p2){
+  uint64_t x1 = *(const uint64_t*)p1;
+  uint64_t x2 = *(const uint64_t*)p2;
+  return (x1 > x2) - (x1 < x2);
+}
+
+/*
+  moves the log into the counter. repeated values are sorted and each bit
+  of a value's multiplicity is added at its own slice, rows are added one
+  by one. returns 0 on oom
+*/
+static int roaringContextFold(RoaringContext *rc){
+  RoaringCounter *c;
+  int bOk = 1;
+  if( rc->nLog==0 ) return 1;
+  c = roaringContextCounter(rc);
+  if( c==NULL ) return 0;
+  if( rc->aDup ){
+    qsort(rc->aDup, rc->nLog, sizeof(uint32_t), roaringCompare32);
+    for(int j=0; bOk && j < 32; j++){
+      roaring_bitmap_t *b = roaring_bitmap_create();
+      roaring_bulk_context_t bulk = {0};
+      int bMore = 0;
+      if( b==NULL ) return 0;
+      for(int i=0, k; i < rc->nLog; i=k){
+        for(k=i+1; k < rc->nLog && rc->aDup[k]==rc->aDup[i]; k++);
+        if( (k-i)>>j & 1 ) roaring_bitmap_add_bulk(b, &bulk, rc->aDup[i]);
+        if( (k-i)>>j > 1 ) bMore = 1;
+      }
+      bOk = roaring_bitmap_is_empty(b) || roaringCounterAdd(c, b, j);
+      roaring_bitmap_free(b);
+      if( !bMore ) break;
+    }
+  }else{
+    for(int i=0; i < rc->nLog; i++){
+      if( bOk ) bOk = roaringCounterAdd(c, rc->aRow[i], 0);
+      roaring_bitmap_free(rc->aRow[i]);
+    }
+  }
+  rc->nLog = 0;
+  rc->szLog = 0;
+  return bOk;
+}
+
+static int roaring64ContextFold(Roaring64Context *rc){
+  Roaring64Counter *c;
+  int bOk = 1;
+  if( rc->nLog==0 ) return 1;
+  c = roaring64ContextCounter(rc);
+  if( c==NULL ) return 0;
+  if( rc->aDup ){
+    qsort(rc->aDup, rc->nLog, sizeof(uint64_t), roaringCompare64);
+    for(int j=0; bOk && j < 32; j++){
+      roaring64_bitmap_t *b = roaring64_bitmap_create();
+      roaring64_bulk_context_t bulk = {0};
+      int bMore = 0;
+      if( b==NULL ) return 0;
+      for(int i=0, k; i < rc->nLog; i=k){
+        for(k=i+1; k < rc->nLog && rc->aDup[k]==rc->aDup[i]; k++);
+        if( (k-i)>>j & 1 ) roaring64_bitmap_add_bulk(b, &bulk, rc->aDup[i]);
+        if( (k-i)>>j > 1 ) bMore = 1;
+      }
+      bOk = roaring64_bitmap_is_empty(b) || roaring64CounterAdd(c, b, j);
+      roaring64_bitmap_free(b);
+      if( !bMore ) break;
+    }
+  }else{
+    for(int i=0; i < rc->nLog; i++){
+      if( bOk ) bOk = roaring64CounterAdd(c, rc->aRow[i], 0);
+      roaring64_bitmap_free(rc->aRow[i]);
+    }
+  }
+  rc->nLog = 0;
+  rc->szLog = 0;
+  return bOk;
+}
+
+/*
+  logs a repeated value (rb_group_create) or takes a row (rb_group_or), the
+  row is owned by the log afterwards. returns 0 on oom
+*/
+static int roaringContextLogValue(RoaringContext *rc, uint32_t value){
+  uint32_t *a = roaringLogGrow(rc->aDup, rc->nLog, &rc->nLogAlloc, sizeof(*a));
+  if( a==NULL ) return 0;
+  rc->aDup = a;
+  rc->aDup[rc->nLog++] = value;
+  rc->szLog += sizeof(uint32_t);
+  return rc->szLog < ROARING_LOG_MAX || roaringContextFold(rc);
+}
+
+static int roaring64ContextLogValue(Roaring64Context *rc, uint64_t value){
+  uint64_t *a = roaringLogGrow(rc->aDup, rc->nLog, &rc->nLogAlloc, sizeof(*a));
+  if( a==NULL ) return 0;
+  rc->aDup = a;
+  rc->aDup[rc->nLog++] = value;
+  rc->szLog += sizeof(uint64_t);
+  return rc->szLog < ROARING_LOG_MAX || roaring64ContextFold(rc);
+}
+
+static int roaringContextLogRow(RoaringContext *rc, roaring_bitmap_t *r){
+  roaring_bitmap_t **a = roaringLogGrow(rc->aRow, rc->nLog, &rc->nLogAlloc, sizeof(*a));
+  if( a==NULL ){
+    roaring_bitmap_free(r);
+    return 0;
+  }
+  rc->aRow = a;
+  rc->aRow[rc->nLog++] = r;
+  rc->szLog += roaring_bitmap_size_in_bytes(r);
+  return rc->szLog < ROARING_LOG_MAX || roaringContextFold(rc);
+}
+
+static int roaring64ContextLogRow(Roaring64Context *rc, roaring64_bitmap_t *r){
+  roaring64_bitmap_t **a = roaringLogGrow(rc->aRow, rc->nLog, &rc->nLogAlloc, sizeof(*a));
+  if( a==NULL ){
+    roaring64_bitmap_free(r);
+    return 0;
+  }
+  rc->aRow = a;
+  rc->aRow[rc->nLog++] = r;
+  rc->szLog += roaring64_bitmap_portable_size_in_bytes(r);
+  return rc->szLog < ROARING_LOG_MAX || roaring64ContextFold(rc);
+}
+
+/*
+  rb_group_or before its first xValue or xInverse: returns 0 once the row
+  can't be logged as more than ROARING_LOG_AHEAD rows came in, the rows
+  logged so far are dropped then
+*/
+static int roaringContextLogAhead(RoaringContext *rc){
+  if( rc->bWindow ) return 1;
+  if( !rc->bLost && rc->nLog < ROARING_LOG_AHEAD ) return 1;
+  for(int i=0; i < rc->nLog; i++) roaring_bitmap_free(rc->aRow[i]);
+  rc->bLost = 1;
+  rc->nLog = 0;
+  rc->szLog = 0;
+  return 0;
+}
+
+static int roaring64ContextLogAhead(Roaring64Context *rc){
+  if( rc->bWindow ) return 1;
+  if( !rc->bLost && rc->nLog < ROARING_LOG_AHEAD ) return 1;
+  for(int i=0; i < rc->nLog; i++) roaring64_bitmap_free(rc->aRow[i]);
+  rc->bLost = 1;
+  rc->nLog = 0;
+  rc->szLog = 0;
+  return 0;
+}
+
+static void roaringContextReset(RoaringContext *rc){
+  if( rc->aRow ){
+    for(int i=0; i < rc->nLog; i++) roaring_bitmap_free(rc->aRow[i]);
+  }
+  sqlite3_free(rc->aDup);
+  sqlite3_free(rc->aRow);
+  roaringCounterFree(rc->pCount);
+  memset(rc, 0, sizeof(*rc));
+}
+
+static void roaring64ContextReset(Roaring64Context *rc){
+  if( rc->aRow ){
+    for(int i=0; i < rc->nLog; i++) roaring64_bitmap_free(rc->aRow[i]);
+  }
+  sqlite3_free(rc->aDup);
+  sqlite3_free(rc->aRow);
+  roaring64CounterFree(rc->pCount);
+  memset(rc, 0, sizeof(*rc));
+}
+
+
+/*********************************************
+  rb_group_create(col) 
+  --------------------------------------------
+  creates a bitmap from a SQL aggregation, consecutive values (as produced
+  by scanning a table in rowid order) are collected into runs and added as
+  ranges, values below the largest one so far skip the run tracking and are
+  added directly. it also works as a window function, rows that leave the
+  frame are removed
+  
+  example: SELECT rb_group_create(col) FROM table;
+           SELECT rb_group_create(col) OVER (ORDER BY day ROWS 6 PRECEDING) FROM table;
+*********************************************/
+static void roaringCreateStep(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+
+  RoaringContext *rc;
+  uint32_t value;
+
+  // bail out if the value supplied is not an integer
+  if( sqlite3_value_type(argv[0])!=SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+
+  // check if the context already has the roaring bitmap  
+  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->init == 0){
+    // create a roaring bitmap
+    rc->rb = roaring_bitmap_create();
+    if(rc->rb == NULL){
+      memset(rc, 0, sizeof(*rc)); 
+      sqlite3_result_error(context, "failed to create bitmap in step", -1);
+      return;
+    }
+    rc->init = 1;
+  }
+  value = (uint32_t) sqlite3_value_int(argv[0]);
+  if( value <= rc->iMax ){
+    // out of order (or the first value is 0), added right away. the add
+    // replaces containers so the bulk context is dropped, a value that was
+    // already there is logged so that xInverse can tell
+    roaringContextFlush(rc);
+    memset(&rc->bulk, 0, sizeof(rc->bulk));
+    if( !roaring_bitmap_add_checked(rc->rb, value) && !roaringContextLogValue(rc, value) ){
+      sqlite3_result_error_nomem(context);
+    }
+    return;
+  }
+  // ascending, value can't be a repeat and may extend the run
+  rc->iMax = value;
+  if( rc->bRun && value==rc->iRunEnd+1 ){
+    rc->iRunEnd = value;
+    return;
+  }
+  roaringContextFlush(rc);
+  rc->bRun = 1;
+  rc->iRunStart = rc->iRunEnd = value;
+}
+
+static void roaringCreateFinal(sqlite3_context *context){
+  RoaringContext *rc;
+  
+  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->rb == NULL){
+    // no rb was created, must be an empty result set
+    rc->rb = roaring_bitmap_create();    
+  }else{
+    roaringContextFlush(rc);
+  }
+  roaringResult(context, rc->rb, 0);
+  roaringContextReset(rc);
+}
+
+static void roaringCreateValue(sqlite3_context *context){
+  RoaringContext *rc;
+  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->rb == NULL){
+    roaringResult(context, roaring_bitmap_create(), 0);
+    return;
+  }
+  roaringContextFlush(rc);
+  roaringResultBlobShared(context, rc->rb);
+}
+
+static void roaringCreateInverse(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringContext *rc;
+  uint32_t value;
+  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if( rc->rb == NULL || sqlite3_value_type(argv[0])!=SQLITE_INTEGER ) return;
+  value = (uint32_t) sqlite3_value_int(argv[0]);
+  roaringContextFlush(rc);
+  if( !roaringContextFold(rc) ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  if( rc->pCount==NULL || !roaringCounterRemoveValue(rc->pCount, value) ){
+    roaring_bitmap_remove(rc->rb, value);
+    memset(&rc->bulk, 0, sizeof(rc->bulk));
+  }
+}
+
+static void roaring64CreateStep(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+
+  Roaring64Context *rc;
+  uint64_t value;
+
+  // bail out if the value supplied is not an integer
+  if( sqlite3_value_type(argv[0])!=SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+
+  // check if the context already has the roaring bitmap  
+  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->init == 0){
+    // create a roaring bitmap
+    rc->rb = roaring64_bitmap_create();
+    if(rc->rb == NULL){
+      memset(rc, 0, sizeof(*rc)); 
+      sqlite3_result_error(context, "failed to create bitmap in step", -1);
+      return;
+    }
+    rc->init = 1;
+  }
+  value = (uint64_t) sqlite3_value_int64(argv[0]);
+  if( value <= rc->iMax ){
+    // out of order (or the first value is 0), added right away. the add
+    // replaces containers so the bulk context is dropped, a value that was
+    // already there is logged so that xInverse can tell
+    roaring64ContextFlush(rc);
+    memset(&rc->bulk, 0, sizeof(rc->bulk));
+    if( !roaring64_bitmap_add_checked(rc->rb, value) && !roaring64ContextLogValue(rc, value) ){
+      sqlite3_result_error_nomem(context);
+    }
+    return;
+  }
+  // ascending, value can't be a repeat and may extend the run
+  rc->iMax = value;
+  if( rc->bRun && value==rc->iRunEnd+1 ){
+    rc->iRunEnd = value;
+    return;
+  }
+  roaring64ContextFlush(rc);
+  rc->bRun = 1;
+  rc->iRunStart = rc->iRunEnd = value;
+}
+
+static void roaring64CreateFinal(sqlite3_context *context){
+  Roaring64Context *rc;
+  
+  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->rb == NULL){
+    // no rb was created, must be an empty result set
+    rc->rb = roaring64_bitmap_create();    
+  }else{
+    roaring64ContextFlush(rc);
+  }
+  roaring64Result(context, rc->rb, 0);
+  roaring64ContextReset(rc);
+}
+
+static void roaring64CreateValue(sqlite3_context *context){
+  Roaring64Context *rc;
+  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->rb == NULL){
+    roaring64Result(context, roaring64_bitmap_create(), 0);
+    return;
+  }
+  roaring64ContextFlush(rc);
+  roaring64ResultBlobShared(context, rc->rb);
+}
+
+static void roaring64CreateInverse(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  Roaring64Context *rc;
+  uint64_t value;
+  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if( rc->rb == NULL || sqlite3_value_type(argv[0])!=SQLITE_INTEGER ) return;
+  value = (uint64_t) sqlite3_value_int64(argv[0]);
+  roaring64ContextFlush(rc);
+  if( !roaring64ContextFold(rc) ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  if( rc->pCount==NULL || !roaring64CounterRemoveValue(rc->pCount, value) ){
+    roaring64_bitmap_remove(rc->rb, value);
+    memset(&rc->bulk, 0, sizeof(rc->bulk));
+  }
+}
+
+
+/*********************************************
+  rb_add(bitmap, element)
+  --------------------------------------------
+  adds an element to the bitmap and returns the new bitmap
+*********************************************/
+static void roaringAddFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  roaring_bitmap_t *r = roaringValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaring_bitmap_add(r, sqlite3_value_int(argv[1]));
+  roaringResult(context, r, roaringValuePointer(argv[0]) != NULL);
+}
+
+static void roaring64AddFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  roaring64_bitmap_t *r = roaring64ValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaring64_bitmap_add(r, sqlite3_value_int64(argv[1]));
+  roaring64Result(context, r, roaring64ValuePointer(argv[0]) != NULL);
+}
+
+
+/*********************************************
+  rb_remove(bitmap, element)
+  --------------------------------------------
+  removes an element from a bitmap and returns the new bitmap
+*********************************************/
+static void roaringRemoveFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  roaring_bitmap_t *r = roaringValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaring_bitmap_remove(r, sqlite3_value_int(argv[1]));
+  roaringResult(context, r, roaringValuePointer(argv[0]) != NULL);
+}
+
+static void roaring64RemoveFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  roaring64_bitmap_t *r = roaring64ValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaring64_bitmap_remove(r, sqlite3_value_int64(argv[1]));
+  roaring64Result(context, r, roaring64ValuePointer(argv[0]) != NULL);
+}
+
+/*********************************************
+  rb_and_length(bitmap1, bitmap2)
+  --------------------------------------------
+  and the second bitmap with the first one (first one is modified) and returns the length of the result
+*********************************************/
+static void roaringAndLengthFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringView v1, v2;
+  int ok1 = roaringArgInit(context, argv, 0, &v1);
+  int ok2 = roaringArgInit(context, argv, 1, &v2);
+  if( !ok1 || !ok2 ){
+    roaringArgRelease(context, 0, &v1);
+    roaringArgRelease(context, 1, &v2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  int nOut = (int) roaring_bitmap_and_cardinality(v1.rb, v2.rb);
+  roaringArgRelease(context, 0, &v1);
+  roaringArgRelease(context, 1, &v2);
+  sqlite3_result_int(context, nOut);
+}
+
+static void roaring64AndLengthFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r1 = roaring64ArgInit(context, argv, 0);
+  roaring64_bitmap_t *r2 = roaring64ArgInit(context, argv, 1);
+  if( r1 == NULL || r2 == NULL){
+    roaring64ArgRelease(context, argv, 0, r1);
+    roaring64ArgRelease(context, argv, 1, r2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  int64_t nOut = (int64_t) roaring64_bitmap_and_cardinality(r1, r2);
+  roaring64ArgRelease(context, argv, 0, r1);
+  roaring64ArgRelease(context, argv, 1, r2);
+  sqlite3_result_int64(context, nOut);
+}
+
+
+/*********************************************
+  rb_and_many(bitmap1, bitmap2, bitmap3, ...)
+  rb_or_many(bitmap1, bitmap2, bitmap3, ...)
+  rb_xor_many(bitmap1, bitmap2, bitmap3, ...)
+  --------------------------------------------
+  Bitwise AND/OR/XOR all bitmaps and return the result, NULL arguments are
+  skipped. intersections start from the smallest bitmap and stop as soon as
+  the result is empty, unions and xors merge all the bitmaps in one pass
+*********************************************/
+#define ROARING_MANY_AND 1
+#define ROARING_MANY_OR  2
+#define ROARING_MANY_XOR 3
+
+static void roaringManyFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv,
+  int op
+){
+  RoaringView *aView;
+  const roaring_bitmap_t **aRb;
+  uint64_t *aCard;
+  int *aArg;
+  int n = 0;
+  int bPointer = 0;
+  roaring_bitmap_t *r = NULL;
+
+  aView = sqlite3_malloc64(argc * (sizeof(*aView) + sizeof(*aRb) + sizeof(*aCard) + sizeof(*aArg)) + 1);
+  if( aView == NULL ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  aRb = (const roaring_bitmap_t**)&aView[argc];
+  aCard = (uint64_t*)&aRb[argc];
+  aArg = (int*)&aCard[argc];
+  for(int i=0; i < argc; i++){
+    if( roaringValuePointer(argv[i]) != NULL ){
+      bPointer = 1;
+    }else if( sqlite3_value_type(argv[i]) == SQLITE_NULL ){
+      continue;
+    }
+    if( !roaringArgInit(context, argv, i, &aView[n]) ){
+      roaringViewFree(&aView[n]);
+      for(int j=0; j < n; j++) roaringArgRelease(context, aArg[j], &aView[j]);
+      sqlite3_free(aView);
+      sqlite3_result_error(context, "invalid bitmap(s)", -1);
+      return;
+    }
+    aArg[n] = i;
+    aRb[n] = aView[n].rb;
+    n++;
+  }
+
+  if( n == 0 ){
+    r = roaring_bitmap_create();
+  }else if( op == ROARING_MANY_AND ){
+    // smallest first, insertion sort is fine for a handful of arguments
+    for(int i=0; i < n; i++){
+      const roaring_bitmap_t *rb = aRb[i];
+      uint64_t card = roaring_bitmap_get_cardinality(rb);
+      int j = i;
+      for(; j > 0 && aCard[j-1] > card; j--){
+        aRb[j] = aRb[j-1];
+        aCard[j] = aCard[j-1];
+      }
+      aRb[j] = rb;
+      aCard[j] = card;
+    }
+    r = n == 1 ? roaring_bitmap_copy(aRb[0]) : roaring_bitmap_and(aRb[0], aRb[1]);
+    for(int i=2; r != NULL && i < n && !roaring_bitmap_is_empty(r); i++){
+      roaring_bitmap_and_inplace(r, aRb[i]);
+    }
+  }else if( op == ROARING_MANY_OR ){
+    r = roaring_bitmap_or_many(n, aRb);
+  }else{
+    r = roaring_bitmap_xor_many(n, aRb);
+  }
+
+  for(int i=0; i < n; i++) roaringArgRelease(context, aArg[i], &aView[i]);
+  sqlite3_free(aView);
+  roaringResult(context, r, bPointer);
+}
+
+static void roaring64ManyFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv,
+  int op
+){
+  roaring64_bitmap_t **aRb;
+  uint64_t *aCard;
+  int *aArg;
+  int n = 0;
+  int bPointer = 0;
+  roaring64_bitmap_t *r = NULL;
+
+  aRb = sqlite3_malloc64(argc * (sizeof(*aRb) + sizeof(*aCard) + 2*sizeof(*aArg)) + 1);
+  if( aRb == NULL ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  aCard = (uint64_t*)&aRb[argc];
+  aArg = (int*)&aCard[argc];
+  for(int i=0; i < argc; i++){
+    if( roaring64ValuePointer(argv[i]) != NULL ){
+      bPointer = 1;
+    }else if( sqlite3_value_type(argv[i]) == SQLITE_NULL ){
+      continue;
+    }
+    aRb[n] = roaring64ArgInit(context, argv, i);
+    if( aRb[n] == NULL ){
+      for(int j=0; j < n; j++) roaring64ArgRelease(context, argv, aArg[j], aRb[j]);
+      sqlite3_free(aRb);
+      sqlite3_result_error(context, "invalid bitmap(s)", -1);
+      return;
+    }
+    aArg[n++] = i;
+  }
+
+  if( n == 0 ){
+    r = roaring64_bitmap_create();
+  }else if( op == ROARING_MANY_AND ){
+    // smallest first, the order is kept apart from aRb which is released by argument
+    int *aOrder = &aArg[argc];
+    for(int i=0; i < n; i++){
+      uint64_t card = roaring64_bitmap_get_cardinality(aRb[i]);
+      int j = i;
+      for(; j > 0 && aCard[j-1] > card; j--){
+        aOrder[j] = aOrder[j-1];
+        aCard[j] = aCard[j-1];
+      }
+      aOrder[j] = i;
+      aCard[j] = card;
+    }
+    r = roaring64_bitmap_copy(aRb[aOrder[0]]);
+    for(int i=1; r != NULL && i < n && !roaring64_bitmap_is_empty(r); i++){
+      roaring64_bitmap_and_inplace(r, aRb[aOrder[i]]);
+    }
+  }else{
+    r = roaring64_bitmap_copy(aRb[0]);
+    for(int i=1; r != NULL && i < n; i++){
+      if( op == ROARING_MANY_OR ){
+        roaring64_bitmap_or_inplace(r, aRb[i]);
+      }else{
+        roaring64_bitmap_xor_inplace(r, aRb[i]);
+      }
+    }
+  }
+
+  for(int i=0; i < n; i++) roaring64ArgRelease(context, argv, aArg[i], aRb[i]);
+  sqlite3_free(aRb);
+  roaring64Result(context, r, bPointer);
+}
+
+static void roaringAndManyFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringManyFunc(context, argc, argv, ROARING_MANY_AND);
+}
+
+static void roaringOrManyFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringManyFunc(context, argc, argv, ROARING_MANY_OR);
+}
+
+static void roaringXorManyFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringManyFunc(context, argc, argv, ROARING_MANY_XOR);
+}
+
+static void roaring64AndManyFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64ManyFunc(context, argc, argv, ROARING_MANY_AND);
+}
+
+static void roaring64OrManyFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64ManyFunc(context, argc, argv, ROARING_MANY_OR);
+}
+
+static void roaring64XorManyFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64ManyFunc(context, argc, argv, ROARING_MANY_XOR);
+}
+
+
+/*********************************************
+  rb_and(bitmap1, bitmap2)
+  --------------------------------------------
+  and the second bitmap with the first one (first one is modified) and returns the first bitmap
+*********************************************/
+static void roaringAndFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringView v1, v2;
+  int ok1 = roaringArgInit(context, argv, 0, &v1);
+  int ok2 = roaringArgInit(context, argv, 1, &v2);
+  if( !ok1 || !ok2 ){
+    roaringArgRelease(context, 0, &v1);
+    roaringArgRelease(context, 1, &v2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  roaring_bitmap_t *r = roaring_bitmap_and(v1.rb, v2.rb);
+  roaringArgRelease(context, 0, &v1);
+  roaringArgRelease(context, 1, &v2);
+  int bPointer = roaringValuePointer(argv[0]) || roaringValuePointer(argv[1]);
+  roaringResult(context, r, bPointer);
+}
+
+static void roaring64AndFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r1 = roaring64ArgInit(context, argv, 0);
+  roaring64_bitmap_t *r2 = roaring64ArgInit(context, argv, 1);
+  if( r1 == NULL || r2 == NULL){
+    roaring64ArgRelease(context, argv, 0, r1);
+    roaring64ArgRelease(context, argv, 1, r2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  roaring64_bitmap_t *r = roaring64_bitmap_and(r1, r2);
+  roaring64ArgRelease(context, argv, 0, r1);
+  roaring64ArgRelease(context, argv, 1, r2);
+  int bPointer = roaring64ValuePointer(argv[0]) || roaring64ValuePointer(argv[1]);
+  roaring64Result(context, r, bPointer);
+}
+
+/*********************************************
+  rb_not(bitmap1, bitmap2)
+  --------------------------------------------
+  and the second bitmap with the first one (first one is modified) and returns the first bitmap
+*********************************************/
+static void roaringNotFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringView v1, v2;
+  int ok1 = roaringArgInit(context, argv, 0, &v1);
+  int ok2 = roaringArgInit(context, argv, 1, &v2);
+  if( !ok1 || !ok2 ){
+    roaringArgRelease(context, 0, &v1);
+    roaringArgRelease(context, 1, &v2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  roaring_bitmap_t *r = roaring_bitmap_andnot(v1.rb, v2.rb);
+  roaringArgRelease(context, 0, &v1);
+  roaringArgRelease(context, 1, &v2);
+  int bPointer = roaringValuePointer(argv[0]) || roaringValuePointer(argv[1]);
+  roaringResult(context, r, bPointer);
+}
+
+static void roaring64NotFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r1 = roaring64ArgInit(context, argv, 0);
+  roaring64_bitmap_t *r2 = roaring64ArgInit(context, argv, 1);
+  if( r1 == NULL || r2 == NULL){
+    roaring64ArgRelease(context, argv, 0, r1);
+    roaring64ArgRelease(context, argv, 1, r2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  roaring64_bitmap_t *r = roaring64_bitmap_andnot(r1, r2);
+  roaring64ArgRelease(context, argv, 0, r1);
+  roaring64ArgRelease(context, argv, 1, r2);
+  int bPointer = roaring64ValuePointer(argv[0]) || roaring64ValuePointer(argv[1]);
+  roaring64Result(context, r, bPointer);
+}
+
+/*********************************************
+  rb_not_length(bitmap1, bitmap2)
+  --------------------------------------------
+  and the second bitmap with the first one (first one is modified) and returns the first bitmap
+*********************************************/
+static void roaringNotLengthFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringView v1, v2;
+  int ok1 = roaringArgInit(context, argv, 0, &v1);
+  int ok2 = roaringArgInit(context, argv, 1, &v2);
+  if( !ok1 || !ok2 ){
+    roaringArgRelease(context, 0, &v1);
+    roaringArgRelease(context, 1, &v2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  int nOut = (int) roaring_bitmap_andnot_cardinality(v1.rb, v2.rb);
+  roaringArgRelease(context, 0, &v1);
+  roaringArgRelease(context, 1, &v2);
+  sqlite3_result_int(context, nOut);
+}
+
+static void roaring64NotLengthFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r1 = roaring64ArgInit(context, argv, 0);
+  roaring64_bitmap_t *r2 = roaring64ArgInit(context, argv, 1);
+  if( r1 == NULL || r2 == NULL){
+    roaring64ArgRelease(context, argv, 0, r1);
+    roaring64ArgRelease(context, argv, 1, r2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  int64_t nOut = (int64_t) roaring64_bitmap_andnot_cardinality(r1, r2);
+  roaring64ArgRelease(context, argv, 0, r1);
+  roaring64ArgRelease(context, argv, 1, r2);
+  sqlite3_result_int64(context, nOut);
+}
+
+/*********************************************
+  rb_xor(bitmap1, bitmap2)
+  --------------------------------------------
+  and the second bitmap with the first one (first one is modified) and returns the first bitmap
+*********************************************/
+static void roaringXorFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringView v1, v2;
+  int ok1 = roaringArgInit(context, argv, 0, &v1);
+  int ok2 = roaringArgInit(context, argv, 1, &v2);
+  if( !ok1 || !ok2 ){
+    roaringArgRelease(context, 0, &v1);
+    roaringArgRelease(context, 1, &v2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  roaring_bitmap_t *r = roaring_bitmap_xor(v1.rb, v2.rb);
+  roaringArgRelease(context, 0, &v1);
+  roaringArgRelease(context, 1, &v2);
+  int bPointer = roaringValuePointer(argv[0]) || roaringValuePointer(argv[1]);
+  roaringResult(context, r, bPointer);
+}
+
+static void roaring64XorFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r1 = roaring64ArgInit(context, argv, 0);
+  roaring64_bitmap_t *r2 = roaring64ArgInit(context, argv, 1);
+  if( r1 == NULL || r2 == NULL){
+    roaring64ArgRelease(context, argv, 0, r1);
+    roaring64ArgRelease(context, argv, 1, r2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  roaring64_bitmap_t *r = roaring64_bitmap_xor(r1, r2);
+  roaring64ArgRelease(context, argv, 0, r1);
+  roaring64ArgRelease(context, argv, 1, r2);
+  int bPointer = roaring64ValuePointer(argv[0]) || roaring64ValuePointer(argv[1]);
+  roaring64Result(context, r, bPointer);
+}
+
+/*********************************************
+  rb_xor_length(bitmap1, bitmap2)
+  --------------------------------------------
+  and the second bitmap with the first one (first one is modified) and returns the first bitmap
+*********************************************/
+static void roaringXorLengthFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringView v1, v2;
+  int ok1 = roaringArgInit(context, argv, 0, &v1);
+  int ok2 = roaringArgInit(context, argv, 1, &v2);
+  if( !ok1 || !ok2 ){
+    roaringArgRelease(context, 0, &v1);
+    roaringArgRelease(context, 1, &v2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  int nOut = (int) roaring_bitmap_xor_cardinality(v1.rb, v2.rb);
+  roaringArgRelease(context, 0, &v1);
+  roaringArgRelease(context, 1, &v2);
+  sqlite3_result_int(context, nOut);
+}
+
+static void roaring64XorLengthFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r1 = roaring64ArgInit(context, argv, 0);
+  roaring64_bitmap_t *r2 = roaring64ArgInit(context, argv, 1);
+  if( r1 == NULL || r2 == NULL){
+    roaring64ArgRelease(context, argv, 0, r1);
+    roaring64ArgRelease(context, argv, 1, r2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  int64_t nOut = (int64_t) roaring64_bitmap_xor_cardinality(r1, r2);
+  roaring64ArgRelease(context, argv, 0, r1);
+  roaring64ArgRelease(context, argv, 1, r2);
+  sqlite3_result_int64(context, nOut);
+}
+
+/*********************************************
+  rb_or_length(bitmap1, bitmap2)
+  --------------------------------------------
+  or the second bitmap with the first one (first one is modified) and returns the length of the result
+*********************************************/
+static void roaringOrLengthFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringView v1, v2;
+  int ok1 = roaringArgInit(context, argv, 0, &v1);
+  int ok2 = roaringArgInit(context, argv, 1, &v2);
+  if( !ok1 || !ok2 ){
+    roaringArgRelease(context, 0, &v1);
+    roaringArgRelease(context, 1, &v2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  int nOut = (int) roaring_bitmap_or_cardinality(v1.rb, v2.rb);
+  roaringArgRelease(context, 0, &v1);
+  roaringArgRelease(context, 1, &v2);
+  sqlite3_result_int(context, nOut);
+}
+
+static void roaring64OrLengthFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r1 = roaring64ArgInit(context, argv, 0);
+  roaring64_bitmap_t *r2 = roaring64ArgInit(context, argv, 1);
+  if( r1 == NULL || r2 == NULL){
+    roaring64ArgRelease(context, argv, 0, r1);
+    roaring64ArgRelease(context, argv, 1, r2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  int64_t nOut = (int64_t) roaring64_bitmap_or_cardinality(r1, r2);
+  roaring64ArgRelease(context, argv, 0, r1);
+  roaring64ArgRelease(context, argv, 1, r2);
+  sqlite3_result_int64(context, nOut);
+}
+
+
+/*********************************************
+  rb_or(bitmap1, bitmap2)
+  --------------------------------------------
+  or the second bitmap with the first one (first one is modified) and returns the first bitmap
+*********************************************/
+static void roaringOrFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringView v1, v2;
+  int ok1 = roaringArgInit(context, argv, 0, &v1);
+  int ok2 = roaringArgInit(context, argv, 1, &v2);
+  if( !ok1 || !ok2 ){
+    roaringArgRelease(context, 0, &v1);
+    roaringArgRelease(context, 1, &v2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  roaring_bitmap_t *r = roaring_bitmap_or(v1.rb, v2.rb);
+  roaringArgRelease(context, 0, &v1);
+  roaringArgRelease(context, 1, &v2);
+  int bPointer = roaringValuePointer(argv[0]) || roaringValuePointer(argv[1]);
+  roaringResult(context, r, bPointer);
+}
+
+static void roaring64OrFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r1 = roaring64ArgInit(context, argv, 0);
+  roaring64_bitmap_t *r2 = roaring64ArgInit(context, argv, 1);
+  if( r1 == NULL || r2 == NULL){
+    roaring64ArgRelease(context, argv, 0, r1);
+    roaring64ArgRelease(context, argv, 1, r2);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  roaring64_bitmap_t *r = roaring64_bitmap_or(r1, r2);
+  roaring64ArgRelease(context, argv, 0, r1);
+  roaring64ArgRelease(context, argv, 1, r2);
+  int bPointer = roaring64ValuePointer(argv[0]) || roaring64ValuePointer(argv[1]);
+  roaring64Result(context, r, bPointer);
+}
+
+/*********************************************
+  rb_group_and(col)
+  --------------------------------------------
+  and all the values in col
+  
+  example: SELECT rb_group_and(col) FROM table
+*********************************************/
+
+static void roaringAndAllStep(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+
+  RoaringContext *rc;
+  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
+
+  if(rc->init == 0){
+    rc->init = 1;
+    rc->rb = roaringValueDeserialize(argv[0]);
+    if( rc->rb == NULL ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+  }else{
+    RoaringView v;
+    if( !roaringValueView(&v, argv[0]) ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+    roaring_bitmap_and_inplace(rc->rb, v.rb);
+    roaringViewFree(&v);
+  }
+
+}
+
+
+static void roaringAndAllFinal(sqlite3_context *context){
+  RoaringContext *rc;
+  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->rb == NULL){
+    // no rb was created, must be an empty result set
+    rc->rb = roaring_bitmap_create();    
+  }
+  roaringResult(context, rc->rb, 0);
+  memset(rc, 0, sizeof(*rc)); 
+}
+
+static void roaring64AndAllStep(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+
+  Roaring64Context *rc;
+  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
+
+  if(rc->init == 0){
+    rc->init = 1;
+    rc->rb = roaring64ValueDeserialize(argv[0]);
+    if( rc->rb == NULL ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+  }else{
+    roaring64_bitmap_t *r = roaring64ValueDeserialize(argv[0]);
+    if( r == NULL ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+    roaring64_bitmap_and_inplace(rc->rb, r);
+    roaring64_bitmap_free(r);
+  }
+
+}
+
+static void roaring64AndAllFinal(sqlite3_context *context){
+  Roaring64Context *rc;
+  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->rb == NULL){
+    // no rb was created, must be an empty result set
+    rc->rb = roaring64_bitmap_create();    
+  }
+  roaring64Result(context, rc->rb, 0);
+  memset(rc, 0, sizeof(*rc)); 
+}
+
+
+/*********************************************
+  rb_group_or(col)
+  --------------------------------------------
+  or all the values in col, the rows are merged lazily (cardinalities are
+  not maintained) and the result is repaired once in the final step. it
+  also works as a window function, the rows holding each element are
+  counted so rows can leave the frame
+  
+  example: SELECT rb_group_or(col) FROM table
+           SELECT rb_group_or(col) OVER (ORDER BY day ROWS 6 PRECEDING) FROM table
+*********************************************/
+static void roaringOrAllStep(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+
+  RoaringContext *rc;
+  RoaringView v;
+  roaring_bitmap_t *r;
+  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->init == 0){
+    rc->init = 1;
+    rc->rb = roaring_bitmap_create();
+  }
+  if( !roaringValueView(&v, argv[0]) ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaring_bitmap_lazy_or_inplace(rc->rb, v.rb, true);
+  rc->bLazy = 1;
+  if( !roaringContextLogAhead(rc) ){
+    roaringViewFree(&v);
+    return;
+  }
+  // the log keeps the row for xInverse, a deserialized row is handed over
+  if( v.bShared || v.bBorrowed || v.pCopy ){
+    r = roaring_bitmap_copy(v.rb);
+  }else{
+    r = (roaring_bitmap_t*)v.rb;
+    v.rb = NULL;
+  }
+  if( r==NULL || !roaringContextLogRow(rc, r) ){
+    sqlite3_result_error_nomem(context);
+  }
+  roaringViewFree(&v);
+}
+
+static void roaringOrAllInverse(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringContext *rc;
+  RoaringView v;
+  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if( rc->rb == NULL ) return;
+  rc->bWindow = 1;
+  if( rc->bLost ){
+    // the leaving row or one still in the frame wasn't logged
+    sqlite3_result_error(context, "unsupported window frame", -1);
+    return;
+  }
+  if( !roaringValueView(&v, argv[0]) ) return;
+  roaringContextRepair(rc);
+  if( !roaringContextFold(rc) ){
+    roaringViewFree(&v);
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  if( rc->pCount!=NULL && rc->pCount->nSlice > 0 ){
+    // every element loses a count, those no other row holds leave
+    roaring_bitmap_t *shared = roaringCounterAnd(rc->pCount, v.rb, 1);
+    roaring_bitmap_t *leaving = shared ? roaring_bitmap_andnot(v.rb, shared) : NULL;
+    if( leaving==NULL || !roaringCounterRemove(rc->pCount, v.rb) ){
+      sqlite3_result_error_nomem(context);
+    }else{
+      roaring_bitmap_andnot_inplace(rc->rb, leaving);
+    }
+    roaring_bitmap_free(shared);
+    roaring_bitmap_free(leaving);
+  }else{
+    roaring_bitmap_andnot_inplace(rc->rb, v.rb);
+  }
+  roaringViewFree(&v);
+}
+
+static void roaringOrAllValue(sqlite3_context *context){
+  RoaringContext *rc;
+  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
+  rc->bWindow = 1;
+  if(rc->rb == NULL){
+    roaringResult(context, roaring_bitmap_create(), 0);
+    return;
+  }
+  roaringContextRepair(rc);
+  roaringResultBlobShared(context, rc->rb);
+}
+
+static void roaringOrAllFinal(sqlite3_context *context){
+  RoaringContext *rc;
+  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->rb == NULL){
+    // no rb was created, must be an empty result set
+    rc->rb = roaring_bitmap_create();    
+  }else{
+    roaringContextRepair(rc);
+  }
+  roaringResult(context, rc->rb, 0);
+  roaringContextReset(rc);
+}
+
+static void roaring64OrAllStep(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+
+  Roaring64Context *rc;
+  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->init == 0){
+    rc->init = 1;
+    rc->rb = roaring64_bitmap_create();
+  }
+  roaring64_bitmap_t *p = roaring64ValuePointer(argv[0]);
+  roaring64_bitmap_t *r = p ? p : roaring64ValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaring64_bitmap_or_inplace(rc->rb, r);
+  if( !roaring64ContextLogAhead(rc) ){
+    if( r != p ) roaring64_bitmap_free(r);
+    return;
+  }
+  // the log keeps the row for xInverse, a deserialized row is handed over
+  if( r == p ) r = roaring64_bitmap_copy(p);
+  if( r==NULL || !roaring64ContextLogRow(rc, r) ){
+    sqlite3_result_error_nomem(context);
+  }
+}
+
+static void roaring64OrAllInverse(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  Roaring64Context *rc;
+  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if( rc->rb == NULL ) return;
+  rc->bWindow = 1;
+  if( rc->bLost ){
+    sqlite3_result_error(context, "unsupported window frame", -1);
+    return;
+  }
+  roaring64_bitmap_t *p = roaring64ValuePointer(argv[0]);
+  roaring64_bitmap_t *r = p ? p : roaring64ValueDeserialize(argv[0]);
+  if( r == NULL ) return;
+  if( !roaring64ContextFold(rc) ){
+    sqlite3_result_error_nomem(context);
+  }else if( rc->pCount!=NULL && rc->pCount->nSlice > 0 ){
+    // every element loses a count, those no other row holds leave
+    roaring64_bitmap_t *shared = roaring64CounterAnd(rc->pCount, r, 1);
+    roaring64_bitmap_t *leaving = shared ? roaring64_bitmap_andnot(r, shared) : NULL;
+    if( leaving==NULL || !roaring64CounterRemove(rc->pCount, r) ){
+      sqlite3_result_error_nomem(context);
+    }else{
+      roaring64_bitmap_andnot_inplace(rc->rb, leaving);
+    }
+    if( shared ) roaring64_bitmap_free(shared);
+    if( leaving ) roaring64_bitmap_free(leaving);
+  }else{
+    roaring64_bitmap_andnot_inplace(rc->rb, r);
+  }
+  if( r != p ) roaring64_bitmap_free(r);
+}
+
+static void roaring64OrAllValue(sqlite3_context *context){
+  Roaring64Context *rc;
+  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
+  rc->bWindow = 1;
+  if(rc->rb == NULL){
+    roaring64Result(context, roaring64_bitmap_create(), 0);
+    return;
+  }
+  roaring64ResultBlobShared(context, rc->rb);
+}
+
+static void roaring64OrAllFinal(sqlite3_context *context){
+  Roaring64Context *rc;
+  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
+  if(rc->rb == NULL){
+    // no rb was created, must be an empty result set
+    rc->rb = roaring64_bitmap_create();    
+  }
+  roaring64Result(context, rc->rb, 0);
+  roaring64ContextReset(rc);
+}
+
+
+
+typedef struct ArrayContext ArrayContext;
+struct ArrayContext {
+  unsigned init;
+  unsigned count;
+  int64_t *array;
+};
+
+
+
+/*********************************************
+  rb_array(bitmap, limit=null, offset=0)
+  --------------------------------------------
+  returns the first limit elements starting from offset
+  if the limit is not provided or equal to -1 then all the entries are returned
+  if the offset is not set then elements will be returned starting from offset 0
+*********************************************/
+static void roaringArrayFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringView v;
+  if( !roaringValueView(&v, argv[0]) ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  int nSize = roaring_bitmap_get_cardinality(v.rb);
+  uint32_t *ids;
+  ids = sqlite3_malloc(nSize * sizeof(uint32_t));
+  roaring_bitmap_to_uint32_array(v.rb, ids);
+  roaringViewFree(&v);
+  sqlite3_result_pointer(context, ids, "carray", (void*)roaringArrayFreeFunc);
+}
+
+
+static void roaring64ArrayFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r = roaring64ValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  int nSize = roaring64_bitmap_get_cardinality(r);
+  uint64_t *ids;
+  ids = sqlite3_malloc(nSize * sizeof(uint64_t));
+  roaring64_bitmap_to_uint64_array(r, ids);
+  roaring64_bitmap_free(r); 
+  sqlite3_result_pointer(context, ids, "carray", (void*)roaring64ArrayFreeFunc);
+}
+
+
+/*********************************************
+  rb_freeze(bitmap)
+  --------------------------------------------
+  converts a bitmap to the frozen layout, read only functions use frozen
+  bitmaps in place instead of deserializing them
+*********************************************/
+static void roaringFreezeFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringView v;
+  if( !roaringValueView(&v, argv[0]) ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  size_t nSize = roaring_bitmap_frozen_size_in_bytes(v.rb) + ROARING_FROZEN_OFFSET;
+  char *pOut = sqlite3_malloc64(nSize);
+  if( pOut == NULL ){
+    roaringViewFree(&v);
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  memset(pOut, 0, ROARING_FROZEN_OFFSET);
+  pOut[0] = ROARING_SERIALIZATION_FROZEN;
+  roaring_bitmap_frozen_serialize(v.rb, pOut + ROARING_FROZEN_OFFSET);
+  roaringViewFree(&v);
+  sqlite3_result_blob64(context, pOut, nSize, sqlite3_free);
+}
+
+/*********************************************
+  rb_ptr(bitmap)
+  --------------------------------------------
+  deserializes a bitmap once and returns it as a pointer value, functions
+  that get a pointer argument return pointers as well until rb_blob()
+  serializes the result
+
+  example: SELECT rb_blob(rb_and(rb_or(rb_ptr(a), b), c)) FROM table
+*********************************************/
+static void roaringPtrFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring_bitmap_t *r = roaringValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaringResult(context, r, 1);
+}
+
+static void roaring64PtrFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r = roaring64ValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaring64Result(context, r, 1);
+}
+
+/*********************************************
+  rb_blob(bitmap)
+  --------------------------------------------
+  serializes a bitmap pointer value, blobs are returned as they are
+*********************************************/
+static void roaringBlobFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring_bitmap_t *p = roaringValuePointer(argv[0]);
+  if( p == NULL ){
+    sqlite3_result_value(context, argv[0]);
+    return;
+  }
+  roaringResultBlobShared(context, p);
+}
+
+static void roaring64BlobFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *p = roaring64ValuePointer(argv[0]);
+  if( p == NULL ){
+    sqlite3_result_value(context, argv[0]);
+    return;
+  }
+  roaring64ResultBlobShared(context, p);
+}
+
+/*********************************************
+  rb_optimize(bitmap)
+  --------------------------------------------
+  run optimizes the bitmap whatever rb_optimize_config says, meant for
+  rewriting bitmaps that were stored before
+
+  example: UPDATE table SET bitmap = rb_optimize(bitmap)
+*********************************************/
+static void roaringOptimizeFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring_bitmap_t *r = roaringValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaring_bitmap_run_optimize(r);
+  roaring_bitmap_shrink_to_fit(r);
+  roaringResult(context, r, roaringValuePointer(argv[0]) != NULL);
+}
+
+static void roaring64OptimizeFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r = roaring64ValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaring64_bitmap_run_optimize(r);
+  roaring64Result(context, r, roaring64ValuePointer(argv[0]) != NULL);
+}
+
+/*********************************************
+  rb_optimize_config([mode])
+  --------------------------------------------
+  sets when the bitmaps returned by this connection are run optimized
+  before they are serialized: 'always' (the default), 'never' or a size in
+  bytes below which bitmaps are left alone. returns the current setting
+
+  example: SELECT rb_optimize_config(4096)
+*********************************************/
+static void roaringOptimizeConfigFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringConfig *pConfig = (RoaringConfig*)sqlite3_user_data(context);
+  if( argc == 1 ){
+    const char *zMode = (const char*)sqlite3_value_text(argv[0]);
+    if( sqlite3_value_type(argv[0]) == SQLITE_INTEGER && sqlite3_value_int64(argv[0]) >= 0 ){
+      pConfig->nOptimizeMin = sqlite3_value_int64(argv[0]);
+    }else if( zMode && sqlite3_stricmp(zMode, "always") == 0 ){
+      pConfig->nOptimizeMin = ROARING_OPTIMIZE_ALWAYS;
+    }else if( zMode && sqlite3_stricmp(zMode, "never") == 0 ){
+      pConfig->nOptimizeMin = ROARING_OPTIMIZE_NEVER;
+    }else{
+      sqlite3_result_error(context, "invalid argument", -1);
+      return;
+    }
+  }
+  if( pConfig->nOptimizeMin == ROARING_OPTIMIZE_ALWAYS ){
+    sqlite3_result_text(context, "always", -1, SQLITE_STATIC);
+  }else if( pConfig->nOptimizeMin == ROARING_OPTIMIZE_NEVER ){
+    sqlite3_result_text(context, "never", -1, SQLITE_STATIC);
+  }else{
+    sqlite3_result_int64(context, pConfig->nOptimizeMin);
+  }
+}
+
+/*
+  drops a reference to a cache entry, used as the destructor of the pointer
+  values returned by rb_cached()
+*/
+static void roaringCacheEntryUnref(void *pArg){
+  RoaringCacheEntry *p = (RoaringCacheEntry*)pArg;
+  if( --p->nRef > 0 ) return;
+  if( p->bWide ){
+    roaring64_bitmap_free((roaring64_bitmap_t*)p->pBitmap);
+  }else{
+    roaring_bitmap_free((roaring_bitmap_t*)p->pBitmap);
+  }
+  sqlite3_free(p);
+}
+
+/*
+  hash of a blob, a cached bitmap is only used for the blob it was read from.
+  four independent lanes keep it well ahead of a deserialization
+*/
+static sqlite3_uint64 roaringCacheCheck(const unsigned char *p, sqlite3_int64 n){
+  sqlite3_uint64 h[4] = { 0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, (sqlite3_uint64)n };
+  sqlite3_uint64 w[4], x = 0;
+  sqlite3_int64 i = 0;
+  for(; i + 32 <= n; i += 32){
+    memcpy(w, p + i, sizeof(w));
+    for(int k = 0; k < 4; k++){
+      h[k] = (h[k] ^ w[k]) * 0xFF51AFD7ED558CCDull;
+      h[k] ^= h[k] >> 31;
+    }
+  }
+  for(; i < n; i++){
+    x = (x ^ p[i]) * 0x100000001B3ull;
+  }
+  for(int k = 0; k < 4; k++){
+    x = (x ^ h[k]) * 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 29;
+  }
+  return x;
+}
+
+/*
+  entries are hashed on table and rowid, names are compared without case
+  like sqlite does
+*/
+static unsigned int roaringCacheHash(const char *zTab, sqlite3_int64 iRowid){
+  unsigned int h = 2166136261u;
+  for(; *zTab; zTab++){
+    h = (h ^ (unsigned char)tolower((unsigned char)*zTab)) * 16777619u;
+  }
+  h ^= (unsigned int)iRowid ^ (unsigned int)((sqlite3_uint64)iRowid >> 32);
+  return h * 2654435761u;
+}
+
+static int roaringCacheSameDb(const char *zDb1, const char *zDb2){
+  if( zDb1 == NULL || zDb2 == NULL ) return zDb1 == zDb2;
+  return sqlite3_stricmp(zDb1, zDb2) == 0;
+}
+
+static RoaringCacheEntry *roaringCacheFind(
+  RoaringCache *pCache,
+  const char *zDb,
+  const char *zTab,
+  const char *zCol,
+  sqlite3_int64 iRowid,
+  int bWide
+){
+  unsigned int iHash = roaringCacheHash(zTab, iRowid);
+  RoaringCacheEntry *p = pCache->aSlot[iHash & (pCache->nSlot - 1)];
+  for(; p; p = p->pHashNext){
+    if( p->iHash == iHash
+     && p->iRowid == iRowid
+     && p->bWide == bWide
+     && sqlite3_stricmp(p->zTab, zTab) == 0
+     && sqlite3_stricmp(p->zCol, zCol) == 0
+     && roaringCacheSameDb(p->zDb, zDb)
+    ){
+      return p;
+    }
+  }
+  return NULL;
+}
+
+static void roaringCacheLruUnlink(RoaringCache *pCache, RoaringCacheEntry *p){
+  if( p->pLruPrev ) p->pLruPrev->pLruNext = p->pLruNext;
+  else pCache->pLruFirst = p->pLruNext;
+  if( p->pLruNext ) p->pLruNext->pLruPrev = p->pLruPrev;
+  else pCache->pLruLast = p->pLruPrev;
+  p->pLruPrev = p->pLruNext = NULL;
+}
+
+static void roaringCacheLruPush(RoaringCache *pCache, RoaringCacheEntry *p){
+  p->pLruPrev = NULL;
+  p->pLruNext = pCache->pLruFirst;
+  if( pCache->pLruFirst ) pCache->pLruFirst->pLruPrev = p;
+  else pCache->pLruLast = p;
+  pCache->pLruFirst = p;
+}
+
+/*
+  takes the entry out of the cache, it's freed once no statement uses it
+*/
+static void roaringCacheRemove(RoaringCache *pCache, RoaringCacheEntry *p){
+  RoaringCacheEntry **pp = &pCache->aSlot[p->iHash & (pCache->nSlot - 1)];
+  while( *pp != p ) pp = &(*pp)->pHashNext;
+  *pp = p->pHashNext;
+  roaringCacheLruUnlink(pCache, p);
+  pCache->nByte -= p->nByte;
+  pCache->nEntry--;
+  roaringCacheEntryUnref(p);
+}
+
+static void roaringCacheEvict(RoaringCache *pCache){
+  while( pCache->nByte > pCache->nMaxByte && pCache->pLruLast ){
+    roaringCacheRemove(pCache, pCache->pLruLast);
+  }
+}
+
+static int roaringCacheInsert(RoaringCache *pCache, RoaringCacheEntry *p){
+  RoaringCacheEntry **pp;
+  if( pCache->nEntry >= pCache->nSlot ){
+    int nSlot = pCache->nSlot * 2;
+    int i;
+    RoaringCacheEntry **aSlot = sqlite3_malloc64(sizeof(*aSlot) * nSlot);
+    if( aSlot == NULL ) return SQLITE_NOMEM;
+    memset(aSlot, 0, sizeof(*aSlot) * nSlot);
+    for(i = 0; i < pCache->nSlot; i++){
+      RoaringCacheEntry *pNext, *q;
+      for(q = pCache->aSlot[i]; q; q = pNext){
+        pNext = q->pHashNext;
+        pp = &aSlot[q->iHash & (nSlot - 1)];
+        q->pHashNext = *pp;
+        *pp = q;
+      }
+    }
+    sqlite3_free(pCache->aSlot);
+    pCache->aSlot = aSlot;
+    pCache->nSlot = nSlot;
+  }
+  pp = &pCache->aSlot[p->iHash & (pCache->nSlot - 1)];
+  p->pHashNext = *pp;
+  *pp = p;
+  roaringCacheLruPush(pCache, p);
+  pCache->nByte += p->nByte;
+  pCache->nEntry++;
+  return SQLITE_OK;
+}
+
+#define ROARING_CACHE_SLOTS 64
+
+static RoaringCache *roaringCacheNew(sqlite3_int64 nMaxByte){
+  RoaringCache *pCache = sqlite3_malloc(sizeof(*pCache));
+  if( pCache == NULL ) return NULL;
+  memset(pCache, 0, sizeof(*pCache));
+  pCache->nMaxByte = nMaxByte;
+  pCache->nSlot = ROARING_CACHE_SLOTS;
+  pCache->aSlot = sqlite3_malloc64(sizeof(*pCache->aSlot) * pCache->nSlot);
+  if( pCache->aSlot == NULL ){
+    sqlite3_free(pCache);
+    return NULL;
+  }
+  memset(pCache->aSlot, 0, sizeof(*pCache->aSlot) * pCache->nSlot);
+  return pCache;
+}
+
+static void roaringCacheFree(RoaringCache *pCache){
+  if( pCache == NULL ) return;
+  while( pCache->pLruFirst ){
+    roaringCacheRemove(pCache, pCache->pLruFirst);
+  }
+  sqlite3_free(pCache->aSlot);
+  sqlite3_free(pCache);
+}
+
+/*
+  destructor of the connection settings
+*/
+static void roaringConfigFree(void *pArg){
+  RoaringConfig *pConfig = (RoaringConfig*)pArg;
+  roaringCacheFree(pConfig->pCache);
+  roaringArenaFree(&pConfig->arena);
+  sqlite3_free(pConfig);
+}
+
+/*********************************************
+  rb_cache_config([max_bytes])
+  --------------------------------------------
+  turns on the connection's cache of bitmaps read through rb_cached() with
+  a size limit in bytes, 0 or 'off' turns it off again and frees it. no
+  update hook is installed, the application keeps its own: rb_cached()
+  checks every hit against the length and hash of the blob, so rewritten
+  rows are read again and their stale entries age out of the lru. returns
+  the current limit, 0 when the cache is off
+
+  example: SELECT rb_cache_config(64 * 1024 * 1024)
+*********************************************/
+static void roaringCacheConfigFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringConfig *pConfig = (RoaringConfig*)sqlite3_user_data(context);
+  if( argc == 1 ){
+    const char *zMode = (const char*)sqlite3_value_text(argv[0]);
+    sqlite3_int64 nMaxByte;
+    if( sqlite3_value_type(argv[0]) == SQLITE_INTEGER && sqlite3_value_int64(argv[0]) >= 0 ){
+      nMaxByte = sqlite3_value_int64(argv[0]);
+    }else if( zMode && sqlite3_stricmp(zMode, "off") == 0 ){
+      nMaxByte = 0;
+    }else{
+      sqlite3_result_error(context, "invalid argument", -1);
+      return;
+    }
+    if( nMaxByte == 0 ){
+      if( pConfig->pCache != NULL ){
+        roaringCacheFree(pConfig->pCache);
+        pConfig->pCache = NULL;
+      }
+    }else if( pConfig->pCache == NULL ){
+      pConfig->pCache = roaringCacheNew(nMaxByte);
+      if( pConfig->pCache == NULL ){
+        sqlite3_result_error_nomem(context);
+        return;
+      }
+    }else{
+      pConfig->pCache->nMaxByte = nMaxByte;
+      roaringCacheEvict(pConfig->pCache);
+    }
+  }
+  sqlite3_result_int64(context, pConfig->pCache ? pConfig->pCache->nMaxByte : 0);
+}
+
+/*********************************************
+  rb_cached(table, [column,] rowid, bitmap)
+  --------------------------------------------
+  returns the bitmap stored in the row as a pointer value, like rb_ptr(),
+  but keeps the deserialized bitmap in the connection's cache so the next
+  statement that reads the same row skips the deserialization. entries are
+  keyed on the schema (if the table name has one), table, column and rowid
+  and a cached bitmap is only used for a blob with the same length and
+  hash. without rb_cache_config() it works like
+  rb_ptr()
+
+  example: SELECT id FROM segments WHERE rb_intersects(rb_cached('segments', 'bitmap', rowid, bitmap), :filter)
+*********************************************/
+static void roaringCachedFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv,
+  int bWide
+){
+  RoaringConfig *pConfig = (RoaringConfig*)sqlite3_user_data(context);
+  RoaringCache *pCache = pConfig->pCache;
+  const char *zName = (const char*)sqlite3_value_text(argv[0]);
+  const char *zCol = argc == 4 ? (const char*)sqlite3_value_text(argv[1]) : "";
+  sqlite3_value *pRowid = argv[argc - 2];
+  sqlite3_value *pBitmap = argv[argc - 1];
+  sqlite3_int64 iRowid = sqlite3_value_int64(pRowid);
+  sqlite3_int64 nIn = 0;
+  sqlite3_uint64 iCheck = 0;
+  const char *zTab, *zDot;
+  char *zDb = NULL;
+  RoaringCacheEntry *p;
+  void *r;
+  if( zName == NULL || zCol == NULL || sqlite3_value_type(pRowid) != SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  // 'schema.table' limits the entry to that schema
+  zTab = zName;
+  if( (zDot = strchr(zName, '.')) != NULL ){
+    zTab = zDot + 1;
+    zDb = sqlite3_mprintf("%.*s", (int)(zDot - zName), zName);
+    if( zDb == NULL ){
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+  }
+  if( pCache != NULL && sqlite3_value_type(pBitmap) == SQLITE_BLOB ){
+    nIn = sqlite3_value_bytes(pBitmap);
+    iCheck = roaringCacheCheck(sqlite3_value_blob(pBitmap), nIn);
+    p = roaringCacheFind(pCache, zDb, zTab, zCol, iRowid, bWide);
+    if( p != NULL && p->nByte == nIn && p->iCheck == iCheck ){
+      sqlite3_free(zDb);
+      roaringCacheLruUnlink(pCache, p);
+      roaringCacheLruPush(pCache, p);
+      p->nRef++;
+      sqlite3_result_pointer(context, p, ROARING_CACHED_POINTER_TYPE, roaringCacheEntryUnref);
+      return;
+    }
+    if( p != NULL ) roaringCacheRemove(pCache, p);
+  }else{
+    pCache = NULL;
+  }
+  if( bWide ){
+    r = roaring64ValueDeserialize(pBitmap);
+  }else{
+    r = roaringValueDeserialize(pBitmap);
+  }
+  if( r == NULL ){
+    sqlite3_free(zDb);
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  if( pCache == NULL || nIn > pCache->nMaxByte ){
+    sqlite3_free(zDb);
+    if( bWide ){
+      roaring64Result(context, (roaring64_bitmap_t*)r, 1);
+    }else{
+      roaringResult(context, (roaring_bitmap_t*)r, 1);
+    }
+    return;
+  }
+  p = sqlite3_malloc64(sizeof(*p) + strlen(zTab) + strlen(zCol) + (zDb ? strlen(zDb) + 1 : 0) + 2);
+  if( p == NULL ){
+    sqlite3_free(zDb);
+    if( bWide ){
+      roaring64_bitmap_free((roaring64_bitmap_t*)r);
+    }else{
+      roaring_bitmap_free((roaring_bitmap_t*)r);
+    }
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  memset(p, 0, sizeof(*p));
+  p->pBitmap = r;
+  p->bWide = bWide;
+  p->nRef = 1;
+  p->zTab = (char*)&p[1];
+  strcpy(p->zTab, zTab);
+  p->zCol = p->zTab + strlen(zTab) + 1;
+  strcpy(p->zCol, zCol);
+  if( zDb != NULL ){
+    p->zDb = p->zCol + strlen(zCol) + 1;
+    strcpy(p->zDb, zDb);
+    sqlite3_free(zDb);
+  }
+  p->iRowid = iRowid;
+  p->nByte = nIn;
+  p->iCheck = iCheck;
+  p->iHash = roaringCacheHash(zTab, iRowid);
+  if( roaringCacheInsert(pCache, p) != SQLITE_OK ){
+    roaringCacheEntryUnref(p);
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  roaringCacheEvict(pCache);
+  p->nRef++;
+  sqlite3_result_pointer(context, p, ROARING_CACHED_POINTER_TYPE, roaringCacheEntryUnref);
+}
+
+static void roaringCachedPtrFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaringCachedFunc(context, argc, argv, 0);
+}
+
+static void roaring64CachedPtrFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaringCachedFunc(context, argc, argv, 1);
+}
+
+/*********************************************
+  rb_count(bitmap)
+  --------------------------------------------
+  returns the cardinality of the bitmap
+*********************************************/
+static void roaringLengthFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  const unsigned char *pIn;
+  unsigned int nIn;  
+  RoaringHeader h;
+  RoaringView v;
+  roaring_bitmap_t *p = roaringValuePointer(argv[0]);
+  if( p != NULL ){
+    sqlite3_result_int64(context, (sqlite3_int64) roaring_bitmap_get_cardinality(p));
+    return;
+  }
+  pIn = sqlite3_value_blob(argv[0]);
+  nIn = sqlite3_value_bytes(argv[0]);
+  if( nIn > 0 && pIn[0] == ROARING_SERIALIZATION_FROZEN ){
+    if( !roaringViewInit(&v, pIn, nIn) ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+    sqlite3_result_int64(context, (sqlite3_int64) roaring_bitmap_get_cardinality(v.rb));
+    roaringViewFree(&v);
+    return;
+  }
+  // the cardinality is kept in the header, no need to deserialize
+  if( !roaringHeaderInit(&h, pIn, nIn) ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  sqlite3_result_int64(context, (sqlite3_int64) roaringHeaderCardinality(&h));
+}
+
+static void roaring64LengthFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  const unsigned char *pIn;
+  unsigned int nIn;  
+  uint64_t nSize;
+  roaring64_bitmap_t *p = roaring64ValuePointer(argv[0]);
+  if( p != NULL ){
+    sqlite3_result_int64(context, (sqlite3_int64) roaring64_bitmap_get_cardinality(p));
+    return;
+  }
+  pIn = sqlite3_value_blob(argv[0]);
+  nIn = sqlite3_value_bytes(argv[0]);
+  if( !roaring64HeaderCardinality(pIn, nIn, &nSize) ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  sqlite3_result_int64(context, (sqlite3_int64) nSize);
+}
+
+/*
+  sets the statistics as a JSON object result, min and max are null for
+  an empty bitmap. nByte is the size of the serialized bitmap
+*/
+static void roaringStatsResult(
+  sqlite3_context *context,
+  const roaring64_statistics_t *st,
+  sqlite3_int64 nByte
+){
+  char zMin[24] = "null", zMax[24] = "null";
+  if( st->cardinality > 0 ){
+    sqlite3_snprintf(sizeof(zMin), zMin, "%llu", (unsigned long long) st->min_value);
+    sqlite3_snprintf(sizeof(zMax), zMax, "%llu", (unsigned long long) st->max_value);
+  }
+  char *zOut = sqlite3_mprintf(
+    "{\"cardinality\":%llu,\"n_bytes\":%lld,\"min_value\":%s,\"max_value\":%s,"
+    "\"n_containers\":%llu,\"n_array_containers\":%llu,\"n_run_containers\":%llu,"
+    "\"n_bitset_containers\":%llu,\"n_values_array_containers\":%llu,"
+    "\"n_values_run_containers\":%llu,\"n_values_bitset_containers\":%llu,"
+    "\"n_bytes_array_containers\":%llu,\"n_bytes_run_containers\":%llu,"
+    "\"n_bytes_bitset_containers\":%llu}",
+    (unsigned long long) st->cardinality, nByte, zMin, zMax,
+    (unsigned long long) st->n_containers,
+    (unsigned long long) st->n_array_containers,
+    (unsigned long long) st->n_run_containers,
+    (unsigned long long) st->n_bitset_containers,
+    (unsigned long long) st->n_values_array_containers,
+    (unsigned long long) st->n_values_run_containers,
+    (unsigned long long) st->n_values_bitset_containers,
+    (unsigned long long) st->n_bytes_array_containers,
+    (unsigned long long) st->n_bytes_run_containers,
+    (unsigned long long) st->n_bytes_bitset_containers
+  );
+  if( zOut == NULL ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  sqlite3_result_text(context, zOut, -1, sqlite3_free);
+}
+
+/*********************************************
+  rb_stats(bitmap)
+  --------------------------------------------
+  returns the roaring_bitmap_statistics of the bitmap as a JSON object
+  (container counts, values and bytes per container type) along with the
+  serialized size. serialized bitmaps are not deserialized, the container
+  types and cardinalities come from the header
+
+  example: SELECT sum(json_extract(rb_stats(bitmap), '$.n_bitset_containers')) FROM t
+*********************************************/
+static void roaringStatsFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  RoaringHeader h;
+  RoaringView v;
+  roaring_statistics_t st32;
+  roaring64_statistics_t st;
+  uint32_t x;
+  sqlite3_int64 nByte;
+  memset(&st, 0, sizeof(st));
+  pIn = sqlite3_value_blob(argv[0]);
+  nIn = sqlite3_value_bytes(argv[0]);
+  if( roaringValuePointer(argv[0]) != NULL || (nIn > 0 && pIn[0] == ROARING_SERIALIZATION_FROZEN) ){
+    if( !roaringValueView(&v, argv[0]) ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+    roaring_bitmap_statistics(v.rb, &st32);
+    nByte = v.bShared ? (sqlite3_int64) roaring_bitmap_size_in_bytes(v.rb) : nIn;
+    roaringViewFree(&v);
+    st.n_containers = st32.n_containers;
+    st.n_array_containers = st32.n_array_containers;
+    st.n_run_containers = st32.n_run_containers;
+    st.n_bitset_containers = st32.n_bitset_containers;
+    st.n_values_array_containers = st32.n_values_array_containers;
+    st.n_values_run_containers = st32.n_values_run_containers;
+    st.n_values_bitset_containers = st32.n_values_bitset_containers;
+    st.n_bytes_array_containers = st32.n_bytes_array_containers;
+    st.n_bytes_run_containers = st32.n_bytes_run_containers;
+    st.n_bytes_bitset_containers = st32.n_bytes_bitset_containers;
+    st.min_value = st32.min_value;
+    st.max_value = st32.max_value;
+    st.cardinality = st32.cardinality;
+    roaringStatsResult(context, &st, nByte);
+    return;
+  }
+  if( !roaringHeaderInit(&h, pIn, nIn) ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaringHeaderStatistics(&h, &st);
+  if( roaringHeaderBound(&h, 0, &x) < 0 ) goto invalid;
+  st.min_value = x;
+  if( roaringHeaderBound(&h, 1, &x) < 0 ) goto invalid;
+  st.max_value = x;
+  roaringStatsResult(context, &st, nIn);
+  return;
+invalid:
+  sqlite3_result_error(context, "invalid bitmap", -1);
+}
+
+static void roaring64StatsFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  roaring64_statistics_t st;
+  roaring64_bitmap_t *p = roaring64ValuePointer(argv[0]);
+  if( p != NULL ){
+    roaring64_bitmap_statistics(p, &st);
+    roaringStatsResult(context, &st, (sqlite3_int64) roaring64_bitmap_portable_size_in_bytes(p));
+    return;
+  }
+  memset(&st, 0, sizeof(st));
+  pIn = sqlite3_value_blob(argv[0]);
+  nIn = sqlite3_value_bytes(argv[0]);
+  if( roaring64HeaderStatistics(pIn, nIn, &st) < 0
+   || roaring64HeaderBound(pIn, nIn, 0, &st.min_value) < 0
+   || roaring64HeaderBound(pIn, nIn, 1, &st.max_value) < 0
+  ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaringStatsResult(context, &st, nIn);
+}
+
+/*********************************************
+  rb_intersects(bitmap1, bitmap2)
+  --------------------------------------------
+  returns 1 if the bitmaps have at least one element in common, 0 otherwise.
+  the container keys are compared first, straight from the header of
+  serialized bitmaps, and the payloads are only deserialized if a key is
+  shared by both
+*********************************************/
+static void roaringIntersectsFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  RoaringView v[2];
+  RoaringHeader h[2];
+  int bHeader[2];
+  int ok = 1;
+  int bOut = 0;
+  memset(v, 0, sizeof(v));
+  for(int i=0; i < 2 && ok; i++){
+    pIn = sqlite3_value_blob(argv[i]);
+    nIn = sqlite3_value_bytes(argv[i]);
+    // bitmaps already in memory (pointers, cached constants, frozen views)
+    // are probed directly, others only get their header parsed for now
+    bHeader[i] = roaringValuePointer(argv[i]) == NULL
+      && sqlite3_get_auxdata(context, i) == NULL
+      && !(nIn > 0 && pIn[0] == ROARING_SERIALIZATION_FROZEN);
+    if( bHeader[i] ){
+      ok = roaringHeaderInit(&h[i], pIn, nIn);
+    }else{
+      ok = roaringArgInit(context, argv, i, &v[i]);
+    }
+  }
+  if( ok ){
+    if( bHeader[0] && bHeader[1] ){
+      bOut = roaringHeaderKeysIntersect(&h[0], &h[1]);
+    }else if( bHeader[0] ){
+      bOut = roaringHeaderKeysIntersectBitmap(&h[0], v[1].rb);
+    }else if( bHeader[1] ){
+      bOut = roaringHeaderKeysIntersectBitmap(&h[1], v[0].rb);
+    }else{
+      bOut = 1;
+    }
+  }
+  if( ok && bOut ){
+    for(int i=0; i < 2 && ok; i++){
+      if( bHeader[i] ) ok = roaringArgInit(context, argv, i, &v[i]);
+    }
+    if( ok ) bOut = roaring_bitmap_intersect(v[0].rb, v[1].rb);
+  }
+  if( !ok ){
+    roaringArgRelease(context, 0, &v[0]);
+    roaringArgRelease(context, 1, &v[1]);
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  roaringArgRelease(context, 0, &v[0]);
+  roaringArgRelease(context, 1, &v[1]);
+  sqlite3_result_int(context, bOut);
+}
+
+/*
+  1 if the two cursors share a key, -1 if either buffer is not valid
+*/
+static int roaring64KeysIntersect(Roaring64KeyCursor *c1, Roaring64KeyCursor *c2){
+  uint64_t k1, k2;
+  int rc1 = roaring64KeyCursorNext(c1, &k1);
+  int rc2 = roaring64KeyCursorNext(c2, &k2);
+  while( rc1 == 1 && rc2 == 1 ){
+    if( k1 == k2 ) return 1;
+    if( k1 < k2 ){
+      rc1 = roaring64KeyCursorNext(c1, &k1);
+    }else{
+      rc2 = roaring64KeyCursorNext(c2, &k2);
+    }
+  }
+  return (rc1 < 0 || rc2 < 0) ? -1 : 0;
+}
+
+/*
+  1 if the bitmap has an element under one of the keys of the cursor, -1
+  if the buffer is not valid
+*/
+static int roaring64KeysIntersectBitmap(Roaring64KeyCursor *c, const roaring64_bitmap_t *r){
+  uint64_t key;
+  int rc;
+  while( (rc = roaring64KeyCursorNext(c, &key)) == 1 ){
+    // the range of the very last key ends past UINT64_MAX
+    if( key == (UINT64_MAX >> 16) ) return 1;
+    if( roaring64_bitmap_intersect_with_range(r, key << 16, (key + 1) << 16) ) return 1;
+  }
+  return rc;
+}
+
+static void roaring64IntersectsFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r[2] = {NULL, NULL};
+  Roaring64KeyCursor c[2];
+  int bHeader[2];
+  int ok = 1;
+  int bOut = 0;
+  for(int i=0; i < 2 && ok; i++){
+    bHeader[i] = roaring64ValuePointer(argv[i]) == NULL
+      && sqlite3_get_auxdata(context, i) == NULL;
+    if( bHeader[i] ){
+      ok = roaring64KeyCursorInit(&c[i], sqlite3_value_blob(argv[i]), sqlite3_value_bytes(argv[i]));
+    }else{
+      r[i] = roaring64ArgInit(context, argv, i);
+      ok = r[i] != NULL;
+    }
+  }
+  if( ok ){
+    if( bHeader[0] && bHeader[1] ){
+      bOut = roaring64KeysIntersect(&c[0], &c[1]);
+    }else if( bHeader[0] ){
+      bOut = roaring64KeysIntersectBitmap(&c[0], r[1]);
+    }else if( bHeader[1] ){
+      bOut = roaring64KeysIntersectBitmap(&c[1], r[0]);
+    }else{
+      bOut = 1;
+    }
+    ok = bOut >= 0;
+  }
+  if( ok && bOut ){
+    for(int i=0; i < 2 && ok; i++){
+      if( bHeader[i] ){
+        r[i] = roaring64ArgInit(context, argv, i);
+        ok = r[i] != NULL;
+      }
+    }
+    if( ok ) bOut = roaring64_bitmap_intersect(r[0], r[1]);
+  }
+  roaring64ArgRelease(context, argv, 0, r[0]);
+  roaring64ArgRelease(context, argv, 1, r[1]);
+  if( !ok ){
+    sqlite3_result_error(context, "invalid bitmap(s)", -1);
+    return;
+  }
+  sqlite3_result_int(context, bOut);
+}
+
+/*********************************************
+  rb_contains(bitmap, value)
+  --------------------------------------------
+  returns 1 if the value is in the bitmap, 0 otherwise (always for values
+  outside 0..4294967295). serialized bitmaps are not deserialized, the
+  container is found by a binary search over the header keys and only its
+  bytes are probed
+*********************************************/
+static void roaringContainsFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  RoaringHeader h;
+  RoaringProbe probe;
+  RoaringView v;
+  int bOut;
+  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  sqlite3_int64 n = sqlite3_value_int64(argv[1]);
+  if( n < 0 || n > UINT32_MAX ){
+    // can't be an element of a 32 bit bitmap
+    sqlite3_result_int(context, 0);
+    return;
+  }
+  uint32_t x = (uint32_t) n;
+  pIn = sqlite3_value_blob(argv[0]);
+  nIn = sqlite3_value_bytes(argv[0]);
+  if( roaringValuePointer(argv[0]) != NULL
+   || sqlite3_get_auxdata(context, 0) != NULL
+   || (nIn > 0 && pIn[0] == ROARING_SERIALIZATION_FROZEN)
+  ){
+    if( !roaringArgInit(context, argv, 0, &v) ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+    bOut = roaring_bitmap_contains(v.rb, x);
+    roaringArgRelease(context, 0, &v);
+    sqlite3_result_int(context, bOut);
+    return;
+  }
+  if( !roaringHeaderInit(&h, pIn, nIn) ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  roaringProbeInit(&probe, &h);
+  bOut = roaringProbeContains(&probe, x);
+  if( bOut < 0 ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  sqlite3_result_int(context, bOut);
+}
+
+static void roaring64ContainsFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bitmap_t *r;
+  int bOut;
+  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  uint64_t x = (uint64_t) sqlite3_value_int64(argv[1]);
+  if( roaring64ValuePointer(argv[0]) != NULL || sqlite3_get_auxdata(context, 0) != NULL ){
+    r = roaring64ArgInit(context, argv, 0);
+    bOut = roaring64_bitmap_contains(r, x);
+    roaring64ArgRelease(context, argv, 0, r);
+    sqlite3_result_int(context, bOut);
+    return;
+  }
+  bOut = roaring64HeaderContains(sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), x);
+  if( bOut < 0 ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  sqlite3_result_int(context, bOut);
+}
+
+/*
+  a bitmap stored in a table, read piece by piece with incremental blob i/o
+  instead of loading the whole value. a lookup binary searches the keys in
+  the blob and reads the one container it needs, only the run flags of the
+  container layout and the keys, counts and typecodes that frozen bitmaps
+  store at the end of the blob are kept in memory
+*/
+typedef struct RoaringBlobReader RoaringBlobReader;
+struct RoaringBlobReader {
+  sqlite3_blob *pBlob;
+  sqlite3_int64 nBlob;
+  int layout;               // leading byte of the blob
+  int nContainer;
+  uint32_t nArray;          // element count (array layout)
+  char *aHead;              // run flags or frozen header, NULL if none
+  sqlite3_int64 iKeyCard;   // blob offset of the (key, cardinality - 1) pairs
+  sqlite3_int64 iOffset;    // blob offset of the container offsets, 0 if none
+  sqlite3_int64 iPayload;   // blob offset of the first container
+  RoaringHeader h;          // describes the last container read
+  char aKeyCard[4];
+  char aRunFlags[1];
+};
+
+static int roaringBlobRead(RoaringBlobReader *r, void *p, sqlite3_int64 n, sqlite3_int64 iOff){
+  if( iOff < 0 || n < 0 || iOff + n > r->nBlob ) return SQLITE_CORRUPT;
+  return sqlite3_blob_read(r->pBlob, p, (int)n, (int)iOff);
+}
+
+/*
+  reads the start of the header, returns SQLITE_CORRUPT if the blob is not
+  a bitmap
+*/
+static int roaringBlobReaderInit(RoaringBlobReader *r, sqlite3_blob *pBlob){
+  unsigned char layout;
+  uint32_t cookie, size;
+  sqlite3_int64 nHead;
+  int rc;
+  memset(r, 0, sizeof(*r));
+  r->pBlob = pBlob;
+  r->nBlob = sqlite3_blob_bytes(pBlob);
+  if( (rc = roaringBlobRead(r, &layout, 1, 0)) != SQLITE_OK ) return rc;
+  r->layout = layout;
+  if( layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    if( (rc = roaringBlobRead(r, &r->nArray, sizeof(r->nArray), 1)) != SQLITE_OK ) return rc;
+    return 1 + sizeof(r->nArray) + 4 * (sqlite3_int64)r->nArray <= r->nBlob ? SQLITE_OK : SQLITE_CORRUPT;
+  }
+  if( layout == ROARING_SERIALIZATION_FROZEN ){
+    if( r->nBlob < ROARING_FROZEN_OFFSET + (sqlite3_int64)sizeof(cookie) ) return SQLITE_CORRUPT;
+    if( (rc = roaringBlobRead(r, &cookie, sizeof(cookie), r->nBlob - sizeof(cookie))) != SQLITE_OK ) return rc;
+    if( (cookie & 0x7FFF) != FROZEN_COOKIE ) return SQLITE_CORRUPT;
+    r->nContainer = (int)(cookie >> 15);
+    nHead = 5 * (sqlite3_int64)r->nContainer;
+    if( r->nBlob - (sqlite3_int64)sizeof(cookie) - nHead < ROARING_FROZEN_OFFSET ) return SQLITE_CORRUPT;
+    if( (r->aHead = sqlite3_malloc64(nHead + 1)) == NULL ) return SQLITE_NOMEM;
+    return roaringBlobRead(r, r->aHead, nHead, r->nBlob - sizeof(cookie) - nHead);
+  }
+  if( layout != CROARING_SERIALIZATION_CONTAINER ) return SQLITE_CORRUPT;
+  if( (rc = roaringBlobRead(r, &cookie, sizeof(cookie), 1)) != SQLITE_OK ) return rc;
+  if( (cookie & 0xFFFF) == SERIAL_COOKIE ){
+    size = (cookie >> 16) + 1;
+    if( (r->aHead = sqlite3_malloc64((size + 7) / 8)) == NULL ) return SQLITE_NOMEM;
+    if( (rc = roaringBlobRead(r, r->aHead, (size + 7) / 8, 1 + sizeof(cookie))) != SQLITE_OK ) return rc;
+    r->iKeyCard = 1 + sizeof(cookie) + (size + 7) / 8;
+    // bitmaps with run containers omit the offsets below NO_OFFSET_THRESHOLD containers
+    if( size >= NO_OFFSET_THRESHOLD ) r->iOffset = r->iKeyCard + 4 * (sqlite3_int64)size;
+  }else if( cookie == SERIAL_COOKIE_NO_RUNCONTAINER ){
+    if( (rc = roaringBlobRead(r, &size, sizeof(size), 1 + sizeof(cookie))) != SQLITE_OK ) return rc;
+    if( size > (1 << 16) ) return SQLITE_CORRUPT;
+    r->iKeyCard = 1 + sizeof(cookie) + sizeof(size);
+    r->iOffset = r->iKeyCard + 4 * (sqlite3_int64)size;
+  }else{
+    return SQLITE_CORRUPT;
+  }
+  r->nContainer = (int)size;
+  r->iPayload = r->iKeyCard + (r->iOffset ? 8 : 4) * (sqlite3_int64)size;
+  return r->iPayload <= r->nBlob ? SQLITE_OK : SQLITE_CORRUPT;
+}
+
+static void roaringBlobReaderFree(RoaringBlobReader *r){
+  sqlite3_free(r->aHead);
+}
+
+/*
+  points r->h at a single container header for container i (container
+  layout), the RoaringHeader functions then work on its payload
+*/
+static int roaringBlobHeader(RoaringBlobReader *r, int i){
+  int rc = roaringBlobRead(r, r->aKeyCard, sizeof(r->aKeyCard), r->iKeyCard + 4 * (sqlite3_int64)i);
+  if( rc != SQLITE_OK ) return rc;
+  memset(&r->h, 0, sizeof(r->h));
+  r->h.layout = CROARING_SERIALIZATION_CONTAINER;
+  r->h.nContainer = 1;
+  r->h.aKeyCard = r->aKeyCard;
+  r->aRunFlags[0] = r->aHead != NULL && (r->aHead[i / 8] & (1 << (i % 8))) != 0;
+  r->h.aRunFlags = r->aRunFlags;
+  return SQLITE_OK;
+}
+
+/*
+  size in the blob of the container described by r->h, starting at iOff
+*/
+static int roaringBlobContainerSize(RoaringBlobReader *r, sqlite3_int64 iOff, sqlite3_int64 *pn){
+  uint16_t nRun;
+  int rc;
+  if( roaringHeaderIsRun(&r->h, 0) ){
+    if( (rc = roaringBlobRead(r, &nRun, sizeof(nRun), iOff)) != SQLITE_OK ) return rc;
+    *pn = sizeof(nRun) + 4 * (sqlite3_int64)nRun;
+  }else if( roaringHeaderCard(&r->h, 0) > DEFAULT_MAX_SIZE ){
+    *pn = BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+  }else{
+    *pn = 2 * (sqlite3_int64)roaringHeaderCard(&r->h, 0);
+  }
+  return SQLITE_OK;
+}
+
+/*
+  reads the container with the given key in the portable layout, r->h
+  describes it for the RoaringHeader functions (as container 0). *ppC is
+  NULL if the bitmap has no such container
+*/
+static int roaringBlobContainer(RoaringBlobReader *r, uint16_t key, char **ppC){
+  sqlite3_int64 iOff = 0, n = 0;
+  uint16_t k, count;
+  int rc, i = -1;
+  *ppC = NULL;
+  if( r->layout == CROARING_SERIALIZATION_CONTAINER ){
+    int lo = 0, hi = r->nContainer - 1;
+    while( lo <= hi ){
+      int mid = lo + (hi - lo) / 2;
+      if( (rc = roaringBlobRead(r, &k, sizeof(k), r->iKeyCard + 4 * (sqlite3_int64)mid)) != SQLITE_OK ) return rc;
+      if( k == key ){
+        i = mid;
+        break;
+      }
+      if( k < key ) lo = mid + 1; else hi = mid - 1;
+    }
+    if( i < 0 ) return SQLITE_OK;
+    if( r->iOffset != 0 ){
+      uint32_t off;
+      if( (rc = roaringBlobRead(r, &off, sizeof(off), r->iOffset + 4 * (sqlite3_int64)i)) != SQLITE_OK ) return rc;
+      iOff = 1 + (sqlite3_int64)off;
+    }else{
+      // without offsets the containers before i are skipped one by one
+      iOff = r->iPayload;
+      for(int j = 0; j < i; j++){
+        if( (rc = roaringBlobHeader(r, j)) != SQLITE_OK ) return rc;
+        if( (rc = roaringBlobContainerSize(r, iOff, &n)) != SQLITE_OK ) return rc;
+        iOff += n;
+      }
+    }
+    if( (rc = roaringBlobHeader(r, i)) != SQLITE_OK ) return rc;
+    if( (rc = roaringBlobContainerSize(r, iOff, &n)) != SQLITE_OK ) return rc;
+    if( (*ppC = sqlite3_malloc64(n + 1)) == NULL ) return SQLITE_NOMEM;
+    return roaringBlobRead(r, *ppC, n, iOff);
+  }
+  // frozen: bitset containers come first, then the runs, then the arrays
+  sqlite3_int64 nBitset = 0, nRun = 0, iBitset = 0, iRun = 0, iArray = 0;
+  const char *aKey = r->aHead;
+  const char *aCount = r->aHead + 2 * (size_t)r->nContainer;
+  const char *aType = r->aHead + 4 * (size_t)r->nContainer;
+  for(int j = 0; j < r->nContainer; j++){
+    memcpy(&k, aKey + 2 * j, sizeof(k));
+    memcpy(&count, aCount + 2 * j, sizeof(count));
+    // the offsets end past container i, its size is taken off below
+    switch( aType[j] ){
+      case BITSET_CONTAINER_TYPE:
+        if( i < 0 ) iBitset += BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+        nBitset += BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+        break;
+      case RUN_CONTAINER_TYPE:
+        if( i < 0 ) iRun += 4 * (sqlite3_int64)count;
+        nRun += 4 * (sqlite3_int64)count;
+        break;
+      case ARRAY_CONTAINER_TYPE:
+        if( i < 0 ) iArray += 2 * ((sqlite3_int64)count + 1);
+        break;
+      default:
+        return SQLITE_CORRUPT;
+    }
+    if( k == key ) i = j;
+  }
+  if( i < 0 ) return SQLITE_OK;
+  memcpy(&count, aCount + 2 * i, sizeof(count));
+  memcpy(r->aKeyCard, &key, sizeof(key));
+  memset(&r->h, 0, sizeof(r->h));
+  r->h.layout = CROARING_SERIALIZATION_CONTAINER;
+  r->h.nContainer = 1;
+  r->h.aKeyCard = r->aKeyCard;
+  r->aRunFlags[0] = aType[i] == RUN_CONTAINER_TYPE;
+  r->h.aRunFlags = r->aRunFlags;
+  if( aType[i] == BITSET_CONTAINER_TYPE ){
+    // the portable layout tells bitsets from arrays by their cardinality
+    uint16_t card = count < DEFAULT_MAX_SIZE ? DEFAULT_MAX_SIZE : count;
+    memcpy(r->aKeyCard + 2, &card, sizeof(card));
+    n = BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+    iOff = ROARING_FROZEN_OFFSET + iBitset - n;
+  }else if( aType[i] == RUN_CONTAINER_TYPE ){
+    // portable runs are prefixed by their count
+    n = 4 * (sqlite3_int64)count;
+    if( (*ppC = sqlite3_malloc64(2 + n)) == NULL ) return SQLITE_NOMEM;
+    memcpy(*ppC, &count, sizeof(count));
+    return roaringBlobRead(r, *ppC + 2, n, ROARING_FROZEN_OFFSET + nBitset + iRun - n);
+  }else{
+    memcpy(r->aKeyCard + 2, &count, sizeof(count));
+    n = 2 * ((sqlite3_int64)count + 1);
+    iOff = ROARING_FROZEN_OFFSET + nBitset + nRun + iArray - n;
+  }
+  if( (*ppC = sqlite3_malloc64(n)) == NULL ) return SQLITE_NOMEM;
+  return roaringBlobRead(r, *ppC, n, iOff);
+}
+
+/*
+  cardinality from the header. the container layout reads the cardinality
+  pairs, frozen bitmaps also read their run containers since the count of a
+  run container is its number of runs
+*/
+static int roaringBlobCardinality(RoaringBlobReader *r, uint64_t *pCard){
+  sqlite3_int64 nBitset = 0, nRun = 0, n;
+  uint16_t count;
+  char *aBuf;
+  int rc;
+  *pCard = 0;
+  if( r->layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    *pCard = r->nArray;
+    return SQLITE_OK;
+  }
+  if( r->layout == CROARING_SERIALIZATION_CONTAINER ){
+    n = 4 * (sqlite3_int64)r->nContainer;
+    if( (aBuf = sqlite3_malloc64(n + 1)) == NULL ) return SQLITE_NOMEM;
+    rc = roaringBlobRead(r, aBuf, n, r->iKeyCard);
+    for(sqlite3_int64 k = 2; rc == SQLITE_OK && k < n; k += 4){
+      memcpy(&count, aBuf + k, sizeof(count));
+      *pCard += (uint64_t)count + 1;
+    }
+    sqlite3_free(aBuf);
+    return rc;
+  }
+  const char *aCount = r->aHead + 2 * (size_t)r->nContainer;
+  const char *aType = r->aHead + 4 * (size_t)r->nContainer;
+  for(int j = 0; j < r->nContainer; j++){
+    memcpy(&count, aCount + 2 * j, sizeof(count));
+    if( aType[j] == RUN_CONTAINER_TYPE ){
+      nRun += 4 * (sqlite3_int64)count;
+    }else{
+      if( aType[j] == BITSET_CONTAINER_TYPE ) nBitset += BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+      *pCard += (uint64_t)count + 1;
+    }
+  }
+  if( nRun == 0 ) return SQLITE_OK;
+  if( (aBuf = sqlite3_malloc64(nRun)) == NULL ) return SQLITE_NOMEM;
+  rc = roaringBlobRead(r, aBuf, nRun, ROARING_FROZEN_OFFSET + nBitset);
+  // runs are (start, length - 1) pairs
+  for(sqlite3_int64 k = 2; rc == SQLITE_OK && k < nRun; k += 4){
+    memcpy(&count, aBuf + k, sizeof(count));
+    *pCard += (uint64_t)count + 1;
+  }
+  sqlite3_free(aBuf);
+  return rc;
+}
+
+typedef struct RoaringBlobHandle RoaringBlobHandle;
+struct RoaringBlobHandle {
+  sqlite3_blob *pBlob;
+  char *zTable;
+  char *zColumn;
+};
+
+static void roaringBlobHandleFree(void *p){
+  sqlite3_blob_close(((RoaringBlobHandle*)p)->pBlob);
+  sqlite3_free(p);
+}
+
+/*
+  opens the blob at (table, column, rowid) of the main schema. the handle is
+  kept as aux data of the table argument and moved to the next row with
+  sqlite3_blob_reopen, which is much cheaper than opening a new one
+*/
+static sqlite3_blob *roaringBlobOpen(sqlite3_context *context, sqlite3_value **argv){
+  sqlite3 *db = sqlite3_context_db_handle(context);
+  const char *zTable = (const char*)sqlite3_value_text(argv[0]);
+  const char *zColumn = (const char*)sqlite3_value_text(argv[1]);
+  sqlite3_int64 iRowid = sqlite3_value_int64(argv[2]);
+  RoaringBlobHandle *p = (RoaringBlobHandle*)sqlite3_get_auxdata(context, 0);
+  size_t nTable, nColumn;
+  int rc;
+  if( zTable == NULL || zColumn == NULL || sqlite3_value_type(argv[2]) != SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return NULL;
+  }
+  if( p != NULL && strcmp(p->zTable, zTable) == 0 && strcmp(p->zColumn, zColumn) == 0 ){
+    if( sqlite3_blob_reopen(p->pBlob, iRowid) == SQLITE_OK ) return p->pBlob;
+    // the handle is aborted, e.g. after a write to the table
+    sqlite3_set_auxdata(context, 0, NULL, NULL);
+  }
+  nTable = strlen(zTable) + 1;
+  nColumn = strlen(zColumn) + 1;
+  p = sqlite3_malloc64(sizeof(*p) + nTable + nColumn);
+  if( p == NULL ){
+    sqlite3_result_error_nomem(context);
+    return NULL;
+  }
+  rc = sqlite3_blob_open(db, "main", zTable, zColumn, iRowid, 0, &p->pBlob);
+  if( rc != SQLITE_OK ){
+    sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+    sqlite3_blob_close(p->pBlob);
+    sqlite3_free(p);
+    return NULL;
+  }
+  p->zTable = (char*)&p[1];
+  p->zColumn = p->zTable + nTable;
+  memcpy(p->zTable, zTable, nTable);
+  memcpy(p->zColumn, zColumn, nColumn);
+  sqlite3_set_auxdata(context, 0, p, roaringBlobHandleFree);
+  // sqlite frees the aux data right away if it cannot keep it
+  p = (RoaringBlobHandle*)sqlite3_get_auxdata(context, 0);
+  if( p == NULL ){
+    sqlite3_result_error_nomem(context);
+    return NULL;
+  }
+  return p->pBlob;
+}
+
+static void roaringBlobError(sqlite3_context *context, int rc){
+  if( rc == SQLITE_CORRUPT ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+  }else{
+    sqlite3_result_error_code(context, rc);
+  }
+}
+
+/*********************************************
+  rb_contains_at(table, column, rowid, value)
+  --------------------------------------------
+  rb_contains on the bitmap stored in the column of a row, read with
+  incremental blob i/o: the header first, then only the container that can
+  hold the value, so a lookup into a 10MB bitmap reads a few KB. values
+  outside 0..4294967295 return 0 without reading the blob
+*********************************************/
+static void roaringContainsAtFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringBlobReader r;
+  sqlite3_blob *pBlob;
+  sqlite3_int64 x;
+  char *pC = NULL;
+  int rc;
+  int bOut = 0;
+  if( sqlite3_value_type(argv[3]) != SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  x = sqlite3_value_int64(argv[3]);
+  if( x < 0 || x > UINT32_MAX ){
+    // can't be an element of a 32 bit bitmap, like rb_contains
+    sqlite3_result_int(context, 0);
+    return;
+  }
+  if( (pBlob = roaringBlobOpen(context, argv)) == NULL ) return;
+  rc = roaringBlobReaderInit(&r, pBlob);
+  if( rc == SQLITE_OK && r.layout == CROARING_SERIALIZATION_ARRAY_UINT32 ){
+    // binary search over the sorted uint32 elements
+    int lo = 0, hi = (int)r.nArray - 1;
+    uint32_t v;
+    while( lo <= hi ){
+      int mid = lo + (hi - lo) / 2;
+      rc = roaringBlobRead(&r, &v, sizeof(v), 1 + sizeof(uint32_t) + 4 * (sqlite3_int64)mid);
+      if( rc != SQLITE_OK ) break;
+      if( v == x ){
+        bOut = 1;
+        break;
+      }
+      if( v < x ) lo = mid + 1; else hi = mid - 1;
+    }
+  }else if( rc == SQLITE_OK ){
+    rc = roaringBlobContainer(&r, (uint16_t)(x >> 16), &pC);
+    if( rc == SQLITE_OK && pC != NULL ) bOut = roaringHeaderContainerContains(&r.h, 0, pC, (uint16_t)x);
+  }
+  sqlite3_free(pC);
+  roaringBlobReaderFree(&r);
+  if( rc != SQLITE_OK ){
+    roaringBlobError(context, rc);
+    return;
+  }
+  sqlite3_result_int(context, bOut);
+}
+
+/*********************************************
+  rb_count_at(table, column, rowid)
+  --------------------------------------------
+  rb_count on the bitmap stored in the column of a row, computed from the
+  header that is read with incremental blob i/o
+*********************************************/
+static void roaringCountAtFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringBlobReader r;
+  sqlite3_blob *pBlob;
+  uint64_t nCard = 0;
+  int rc;
+  if( (pBlob = roaringBlobOpen(context, argv)) == NULL ) return;
+  rc = roaringBlobReaderInit(&r, pBlob);
+  if( rc == SQLITE_OK ) rc = roaringBlobCardinality(&r, &nCard);
+  roaringBlobReaderFree(&r);
+  if( rc != SQLITE_OK ){
+    roaringBlobError(context, rc);
+    return;
+  }
+  sqlite3_result_int64(context, (sqlite3_int64)nCard);
+}
+
+/*
+  a list of values taken from a JSON array of integers or from a carray
+  pointer and its length
+*/
+typedef struct RoaringValues RoaringValues;
+struct RoaringValues {
+  int n;
+  uint64_t *a;              // allocated along with the struct
+};
+
+static int roaringValuesCompare(const void *p1, const void *p2){
+  uint64_t x1 = *(const uint64_t*)p1;
+  uint64_t x2 = *(const uint64_t*)p2;
+  return (x1 > x2) - (x1 < x2);
+}
+
+static RoaringValues *roaringValuesAlloc(sqlite3_int64 n){
+  RoaringValues *p = sqlite3_malloc64(sizeof(*p) + n * sizeof(uint64_t));
+  if( p == NULL ) return NULL;
+  p->n = 0;
+  p->a = (uint64_t*)&p[1];
+  return p;
+}
+
+static void roaringValuesSort(RoaringValues *p){
+  int n = 0;
+  qsort(p->a, p->n, sizeof(uint64_t), roaringValuesCompare);
+  for(int i=0; i < p->n; i++){
+    if( n == 0 || p->a[i] != p->a[n - 1] ) p->a[n++] = p->a[i];
+  }
+  p->n = n;
+}
+
+/*
+  parses a JSON array of integers, negative values are kept as their two's
+  complement. returns NULL if z is not such an array
+*/
+static RoaringValues *roaringValuesFromJson(const char *z){
+  RoaringValues *p;
+  sqlite3_int64 n = 1;
+  char *zEnd;
+  uint64_t x;
+  if( z == NULL ) return NULL;
+  for(const char *c = z; *c; c++){
+    if( *c == ',' ) n++;
+  }
+  p = roaringValuesAlloc(n);
+  if( p == NULL ) return NULL;
+  while( isspace((unsigned char)*z) ) z++;
+  if( *z++ != '[' ) goto invalid;
+  while( isspace((unsigned char)*z) ) z++;
+  if( *z != ']' ){
+    for(;;){
+      if( *z == '-' ){
+        x = (uint64_t) strtoll(z, &zEnd, 10);
+      }else if( isdigit((unsigned char)*z) ){
+        x = (uint64_t) strtoull(z, &zEnd, 10);
+      }else{
+        goto invalid;
+      }
+      if( zEnd == z ) goto invalid;
+      p->a[p->n++] = x;
+      z = zEnd;
+      while( isspace((unsigned char)*z) ) z++;
+      if( *z == ']' ) break;
+      if( *z++ != ',' ) goto invalid;
+      while( isspace((unsigned char)*z) ) z++;
+    }
+  }
+  z++;
+  while( isspace((unsigned char)*z) ) z++;
+  if( *z != 0 ) goto invalid;
+  return p;
+invalid:
+  sqlite3_free(p);
+  return NULL;
+}
+
+/*
+  copies a carray of int32 (bWide is 0) or int64 values, int32 values are
+  sign extended so a negative one can't match a 32 bit element
+*/
+static RoaringValues *roaringValuesFromArray(const void *pArray, sqlite3_int64 n, int bWide){
+  RoaringValues *p;
+  if( pArray == NULL || n < 0 || n > INT_MAX ) return NULL;
+  p = roaringValuesAlloc(n);
+  if( p == NULL ) return NULL;
+  for(p->n=0; p->n < n; p->n++){
+    p->a[p->n] = bWide ? (uint64_t)((const int64_t*)pArray)[p->n] : (uint64_t)(int64_t)((const int32_t*)pArray)[p->n];
+  }
+  return p;
+}
+
+/*
+  values of rb_contains_many, sorted. a constant JSON list is parsed once
+  and kept as aux data by roaringValuesRelease
+*/
+static RoaringValues *roaringValuesInit(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv,
+  int bWide
+){
+  RoaringValues *p;
+  if( argc == 3 ){
+    p = roaringValuesFromArray(sqlite3_value_pointer(argv[1], "carray"), sqlite3_value_int64(argv[2]), bWide);
+  }else{
+    p = (RoaringValues*)sqlite3_get_auxdata(context, 1);
+    if( p != NULL ) return p;
+    p = roaringValuesFromJson((const char*)sqlite3_value_text(argv[1]));
+  }
+  if( p != NULL ) roaringValuesSort(p);
+  return p;
+}
+
+static void roaringValuesRelease(sqlite3_context *context, int argc, RoaringValues *p){
+  if( p == NULL || p == sqlite3_get_auxdata(context, 1) ) return;
+  if( argc == 3 ){
+    sqlite3_free(p);
+    return;
+  }
+  sqlite3_set_auxdata(context, 1, p, sqlite3_free);
+}
+
+/*********************************************
+  rb_contains_many(bitmap, json_array)
+  rb_contains_many(bitmap, carray_pointer, count)
+  --------------------------------------------
+  returns how many of the distinct values in the list are in the bitmap.
+  the values are probed in sorted order so that the ones sharing a
+  container reuse its lookup, through roaring_bitmap_contains_bulk for
+  bitmaps in memory and straight from the bytes for serialized ones.
+  values outside 0..4294967295 (sorted last) are never in the bitmap
+
+  example: SELECT rb_contains_many(bitmap, '[3, 7, 70000]') = 3
+*********************************************/
+static void roaringContainsManyFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  RoaringHeader h;
+  RoaringProbe probe;
+  RoaringView v;
+  roaring_bulk_context_t bulk;
+  sqlite3_int64 nOut = 0;
+  int ok = 1;
+  RoaringValues *pValues = roaringValuesInit(context, argc, argv, 0);
+  int n = 0;
+  if( pValues == NULL ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  while( n < pValues->n && pValues->a[n] <= UINT32_MAX ) n++;
+  pIn = sqlite3_value_blob(argv[0]);
+  nIn = sqlite3_value_bytes(argv[0]);
+  if( roaringValuePointer(argv[0]) != NULL
+   || sqlite3_get_auxdata(context, 0) != NULL
+   || (nIn > 0 && pIn[0] == ROARING_SERIALIZATION_FROZEN)
+  ){
+    ok = roaringArgInit(context, argv, 0, &v);
+    if( ok ){
+      memset(&bulk, 0, sizeof(bulk));
+      for(int i=0; i < n; i++){
+        nOut += roaring_bitmap_contains_bulk(v.rb, &bulk, (uint32_t)pValues->a[i]);
+      }
+      roaringArgRelease(context, 0, &v);
+    }
+  }else{
+    ok = roaringHeaderInit(&h, pIn, nIn);
+    if( ok ){
+      roaringProbeInit(&probe, &h);
+      for(int i=0; i < n && ok; i++){
+        int rc = roaringProbeContains(&probe, (uint32_t)pValues->a[i]);
+        ok = rc >= 0;
+        nOut += rc;
+      }
+    }
+  }
+  roaringValuesRelease(context, argc, pValues);
+  if( !ok ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  sqlite3_result_int64(context, nOut);
+}
+
+static void roaring64ContainsManyFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  roaring64_bulk_context_t bulk;
+  sqlite3_int64 nOut = 0;
+  RoaringValues *pValues = roaringValuesInit(context, argc, argv, 1);
+  if( pValues == NULL ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  roaring64_bitmap_t *r = roaring64ArgInit(context, argv, 0);
+  if( r == NULL ){
+    roaringValuesRelease(context, argc, pValues);
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  memset(&bulk, 0, sizeof(bulk));
+  for(int i=0; i < pValues->n; i++){
+    nOut += roaring64_bitmap_contains_bulk(r, &bulk, pValues->a[i]);
+  }
+  roaring64ArgRelease(context, argv, 0, r);
+  roaringValuesRelease(context, argc, pValues);
+  sqlite3_result_int64(context, nOut);
+}
+
+/*
+  runs of consecutive values at least this long are added as ranges when
+  building a bitmap from sorted values, shorter ones are cheaper to add
+  one by one
+*/
+#define ROARING_FROM_RUN_MIN 8
+
+/*
+  builds a bitmap from an array of values. unsorted values are added in a
+  single roaring_bitmap_of_ptr call, sorted ones are scanned for runs that
+  are added as ranges with the values in between going through
+  roaring_bitmap_add_many
+*/
+static roaring_bitmap_t *roaringFromArray(const uint32_t *a, size_t n){
+  roaring_bitmap_t *r;
+  size_t iPending = 0;
+  for(size_t i=1; i < n; i++){
+    if( a[i] < a[i - 1] ) return roaring_bitmap_of_ptr(n, a);
+  }
+  r = roaring_bitmap_create();
+  if( r == NULL ) return NULL;
+  for(size_t i=0, j; i < n; i = j + 1){
+    for(j=i; j + 1 < n && a[j + 1] - a[j] <= 1; j++);
+    if( a[j] - a[i] + 1 >= ROARING_FROM_RUN_MIN ){
+      roaring_bitmap_add_many(r, i - iPending, a + iPending);
+      roaring_bitmap_add_range_closed(r, a[i], a[j]);
+      iPending = j + 1;
+    }
+  }
+  roaring_bitmap_add_many(r, n - iPending, a + iPending);
+  return r;
+}
+
+static roaring64_bitmap_t *roaring64FromArray(const uint64_t *a, size_t n){
+  roaring64_bitmap_t *r;
+  size_t iPending = 0;
+  for(size_t i=1; i < n; i++){
+    if( a[i] < a[i - 1] ) return roaring64_bitmap_of_ptr(n, a);
+  }
+  r = roaring64_bitmap_create();
+  if( r == NULL ) return NULL;
+  for(size_t i=0, j; i < n; i = j + 1){
+    for(j=i; j + 1 < n && a[j + 1] - a[j] <= 1; j++);
+    if( a[j] - a[i] + 1 >= ROARING_FROM_RUN_MIN ){
+      roaring64_bitmap_add_many(r, i - iPending, a + iPending);
+      roaring64_bitmap_add_range_closed(r, a[i], a[j]);
+      iPending = j + 1;
+    }
+  }
+  roaring64_bitmap_add_many(r, n - iPending, a + iPending);
+  return r;
+}
+
+/*********************************************
+  rb_from_json(json_array)
+  --------------------------------------------
+  creates a bitmap from a JSON array of integers, values are truncated to
+  32 bits the way rb_create does
+
+  example: SELECT rb_from_json('[1, 2, 3, 70000]')
+*********************************************/
+static void roaringFromJsonFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringValues *p = roaringValuesFromJson((const char*)sqlite3_value_text(argv[0]));
+  uint32_t *a;
+  if( p == NULL ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  a = sqlite3_malloc64(p->n * sizeof(uint32_t) + 1);
+  if( a == NULL ){
+    sqlite3_free(p);
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  for(int i=0; i < p->n; i++) a[i] = (uint32_t)p->a[i];
+  roaring_bitmap_t *r = roaringFromArray(a, p->n);
+  sqlite3_free(a);
+  sqlite3_free(p);
+  roaringResult(context, r, 0);
+}
+
+static void roaring64FromJsonFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  RoaringValues *p = roaringValuesFromJson((const char*)sqlite3_value_text(argv[0]));
+  if( p == NULL ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  roaring64_bitmap_t *r = roaring64FromArray(p->a, p->n);
+  sqlite3_free(p);
+  roaring64Result(context, r, 0);
+}
+
 /*********************************************
-  rb_create(e1, e2, e3, .. , en)
+  rb_from_carray(pointer, count)
   --------------------------------------------
-  creates a new bitmap comprised of all the supplied integers
+  creates a bitmap from a carray pointer holding count int32 values (int64
+  for rb64_from_carray), as returned by rb_array or bound by the application
+  with sqlite3_bind_pointer(stmt, i, array, "carray", 0). the "carray-bind"
+  pointers of sqlite3_carray_bind hold a struct private to carray and are
+  not accepted
 *********************************************/
-static void roaringCreateFunc(  
+static void roaringFromCarrayFunc(
   sqlite3_context *context,
   int argc,
   sqlite3_value **argv
 ){
-  roaring_bitmap_t *r = roaring_bitmap_create();
-  for(int i=0; i < argc; i++){
-    if( sqlite3_value_type(argv[i])!=SQLITE_INTEGER ){
+  const uint32_t *a = (const uint32_t*)sqlite3_value_pointer(argv[0], "carray");
+  sqlite3_int64 n = sqlite3_value_int64(argv[1]);
+  if( a == NULL || n < 0 ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  roaringResult(context, roaringFromArray(a, (size_t)n), 0);
+}
+
+static void roaring64FromCarrayFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  const uint64_t *a = (const uint64_t*)sqlite3_value_pointer(argv[0], "carray");
+  sqlite3_int64 n = sqlite3_value_int64(argv[1]);
+  if( a == NULL || n < 0 ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  roaring64Result(context, roaring64FromArray(a, (size_t)n), 0);
+}
+
+/*********************************************
+  rb_from_int32_blob(blob)
+  --------------------------------------------
+  creates a bitmap from a blob of packed little endian int32 values (int64
+  for rb64_from_int64_blob), sorted or not
+
+  example: SELECT rb_from_int32_blob(?) -- bound from an application array
+*********************************************/
+static void roaringFromBlobFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  const void *pIn = sqlite3_value_blob(argv[0]);
+  int nIn = sqlite3_value_bytes(argv[0]);
+  uint32_t *pCopy = NULL;
+  if( nIn % sizeof(uint32_t) != 0 || sqlite3_value_type(argv[0]) != SQLITE_BLOB ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  if( (uintptr_t)pIn % sizeof(uint32_t) != 0 ){
+    // sqlite makes no alignment promise for blobs
+    pCopy = sqlite3_malloc(nIn);
+    if( pCopy == NULL ){
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    memcpy(pCopy, pIn, nIn);
+    pIn = pCopy;
+  }
+  roaring_bitmap_t *r = roaringFromArray((const uint32_t*)pIn, nIn / sizeof(uint32_t));
+  sqlite3_free(pCopy);
+  roaringResult(context, r, 0);
+}
+
+static void roaring64FromBlobFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  const void *pIn = sqlite3_value_blob(argv[0]);
+  int nIn = sqlite3_value_bytes(argv[0]);
+  uint64_t *pCopy = NULL;
+  if( nIn % sizeof(uint64_t) != 0 || sqlite3_value_type(argv[0]) != SQLITE_BLOB ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  if( (uintptr_t)pIn % sizeof(uint64_t) != 0 ){
+    pCopy = sqlite3_malloc(nIn);
+    if( pCopy == NULL ){
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    memcpy(pCopy, pIn, nIn);
+    pIn = pCopy;
+  }
+  roaring64_bitmap_t *r = roaring64FromArray((const uint64_t*)pIn, nIn / sizeof(uint64_t));
+  sqlite3_free(pCopy);
+  roaring64Result(context, r, 0);
+}
+
+/*********************************************
+  rb_min(bitmap), rb_max(bitmap), rb_rank(bitmap, value),
+  rb_select(bitmap, n), rb_index_of(bitmap, value)
+  --------------------------------------------
+  rb_min and rb_max return the smallest and largest values (NULL if the
+  bitmap is empty), rb_rank the number of values less than or equal to
+  value, rb_select the value at the 0 based position n (NULL past the end)
+  and rb_index_of the 0 based position of value (-1 if it is missing).
+  serialized bitmaps are answered from the header cardinalities and the
+  single container that holds the answer
+
+  example: SELECT rb_select(bitmap, rb_count(bitmap) * 9 / 10) -- 90th percentile
+*********************************************/
+#define ROARING_POSITION_MIN    1
+#define ROARING_POSITION_MAX    2
+#define ROARING_POSITION_RANK   3
+#define ROARING_POSITION_SELECT 4
+#define ROARING_POSITION_INDEX  5
+
+static void roaringPositionFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv,
+  int op
+){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  RoaringHeader h;
+  RoaringProbe probe;
+  RoaringView v;
+  uint32_t x = 0, value = 0;
+  uint64_t rank = 0;
+  sqlite3_int64 n = 0;
+  sqlite3_int64 nOut = 0;
+  int rc = 1;               // 1 for a result in nOut, 0 for NULL, -1 if not valid
+  if( argc == 2 ){
+    if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
+      sqlite3_result_error(context, "invalid argument", -1);
+      return;
+    }
+    n = sqlite3_value_int64(argv[1]);
+  }
+  if( op == ROARING_POSITION_SELECT && (n < 0 || n > UINT32_MAX) ){
+    sqlite3_result_null(context);
+    return;
+  }
+  if( op == ROARING_POSITION_INDEX && (n < 0 || n > UINT32_MAX) ){
+    sqlite3_result_int64(context, -1);
+    return;
+  }
+  if( op == ROARING_POSITION_RANK && n < 0 ){
+    sqlite3_result_int64(context, 0);
+    return;
+  }
+  // a rank above the 32 bit range is the rank of the largest element
+  x = n > UINT32_MAX ? UINT32_MAX : (uint32_t)n;
+  pIn = sqlite3_value_blob(argv[0]);
+  nIn = sqlite3_value_bytes(argv[0]);
+  if( roaringValuePointer(argv[0]) != NULL
+   || sqlite3_get_auxdata(context, 0) != NULL
+   || (nIn > 0 && pIn[0] == ROARING_SERIALIZATION_FROZEN)
+  ){
+    if( !roaringArgInit(context, argv, 0, &v) ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+    switch( op ){
+      case ROARING_POSITION_MIN:
+      case ROARING_POSITION_MAX:
+        rc = !roaring_bitmap_is_empty(v.rb);
+        if( rc ){
+          value = op == ROARING_POSITION_MIN ? roaring_bitmap_minimum(v.rb) : roaring_bitmap_maximum(v.rb);
+        }
+        nOut = value;
+        break;
+      case ROARING_POSITION_RANK:
+        nOut = (sqlite3_int64) roaring_bitmap_rank(v.rb, x);
+        break;
+      case ROARING_POSITION_SELECT:
+        rc = roaring_bitmap_select(v.rb, (uint32_t)n, &value);
+        nOut = value;
+        break;
+      case ROARING_POSITION_INDEX:
+        nOut = roaring_bitmap_get_index(v.rb, x);
+        break;
+    }
+    roaringArgRelease(context, 0, &v);
+  }else if( !roaringHeaderInit(&h, pIn, nIn) ){
+    rc = -1;
+  }else{
+    switch( op ){
+      case ROARING_POSITION_MIN:
+      case ROARING_POSITION_MAX:
+        rc = roaringHeaderBound(&h, op == ROARING_POSITION_MAX, &value);
+        nOut = value;
+        break;
+      case ROARING_POSITION_RANK:
+        rc = roaringHeaderRank(&h, x, &rank) < 0 ? -1 : 1;
+        nOut = (sqlite3_int64) rank;
+        break;
+      case ROARING_POSITION_SELECT:
+        rc = roaringHeaderSelect(&h, (uint64_t)n, &value);
+        nOut = value;
+        break;
+      case ROARING_POSITION_INDEX:
+        roaringProbeInit(&probe, &h);
+        rc = roaringProbeContains(&probe, x);
+        nOut = -1;
+        if( rc == 0 ){
+          rc = 1;
+        }else if( rc == 1 ){
+          rc = roaringHeaderRank(&h, x, &rank) < 0 ? -1 : 1;
+          nOut = (sqlite3_int64) rank - 1;
+        }
+        break;
+    }
+  }
+  if( rc < 0 ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+  }else if( rc == 0 ){
+    sqlite3_result_null(context);
+  }else{
+    sqlite3_result_int64(context, nOut);
+  }
+}
+
+static void roaring64PositionFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv,
+  int op
+){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  roaring64_bitmap_t *r;
+  uint64_t x = 0, value = 0;
+  int rc = 1;               // 1 for a result in value, 0 for NULL, -1 if not valid
+  if( argc == 2 ){
+    if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
       sqlite3_result_error(context, "invalid argument", -1);
       return;
     }
-    roaring_bitmap_add(r, sqlite3_value_int(argv[i]));
+    x = (uint64_t) sqlite3_value_int64(argv[1]);
+  }
+  if( op == ROARING_POSITION_SELECT && sqlite3_value_int64(argv[1]) < 0 ){
+    sqlite3_result_null(context);
+    return;
+  }
+  if( roaring64ValuePointer(argv[0]) != NULL || sqlite3_get_auxdata(context, 0) != NULL ){
+    r = roaring64ArgInit(context, argv, 0);
+    switch( op ){
+      case ROARING_POSITION_MIN:
+      case ROARING_POSITION_MAX:
+        rc = !roaring64_bitmap_is_empty(r);
+        if( rc ){
+          value = op == ROARING_POSITION_MIN ? roaring64_bitmap_minimum(r) : roaring64_bitmap_maximum(r);
+        }
+        break;
+      case ROARING_POSITION_RANK:
+        value = roaring64_bitmap_rank(r, x);
+        break;
+      case ROARING_POSITION_SELECT:
+        rc = roaring64_bitmap_select(r, x, &value);
+        break;
+      case ROARING_POSITION_INDEX:
+        if( !roaring64_bitmap_get_index(r, x, &value) ) value = (uint64_t)-1;
+        break;
+    }
+    roaring64ArgRelease(context, argv, 0, r);
+  }else{
+    pIn = sqlite3_value_blob(argv[0]);
+    nIn = sqlite3_value_bytes(argv[0]);
+    switch( op ){
+      case ROARING_POSITION_MIN:
+      case ROARING_POSITION_MAX:
+        rc = roaring64HeaderBound(pIn, nIn, op == ROARING_POSITION_MAX, &value);
+        break;
+      case ROARING_POSITION_RANK:
+        rc = roaring64HeaderRank(pIn, nIn, x, &value) < 0 ? -1 : 1;
+        break;
+      case ROARING_POSITION_SELECT:
+        rc = roaring64HeaderSelect(pIn, nIn, x, &value);
+        break;
+      case ROARING_POSITION_INDEX:
+        rc = roaring64HeaderContains(pIn, nIn, x);
+        value = (uint64_t)-1;
+        if( rc == 0 ){
+          rc = 1;
+        }else if( rc == 1 ){
+          rc = roaring64HeaderRank(pIn, nIn, x, &value) < 0 ? -1 : 1;
+          value--;
+        }
+        break;
+    }
+  }
+  if( rc < 0 ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+  }else if( rc == 0 ){
+    sqlite3_result_null(context);
+  }else{
+    sqlite3_result_int64(context, (sqlite3_int64) value);
+  }
+}
+
+static void roaringMinFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringPositionFunc(context, argc, argv, ROARING_POSITION_MIN);
+}
+
+static void roaringMaxFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringPositionFunc(context, argc, argv, ROARING_POSITION_MAX);
+}
+
+static void roaringRankFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringPositionFunc(context, argc, argv, ROARING_POSITION_RANK);
+}
+
+static void roaringSelectFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringPositionFunc(context, argc, argv, ROARING_POSITION_SELECT);
+}
+
+static void roaringIndexOfFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringPositionFunc(context, argc, argv, ROARING_POSITION_INDEX);
+}
+
+static void roaring64MinFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64PositionFunc(context, argc, argv, ROARING_POSITION_MIN);
+}
+
+static void roaring64MaxFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64PositionFunc(context, argc, argv, ROARING_POSITION_MAX);
+}
+
+static void roaring64RankFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64PositionFunc(context, argc, argv, ROARING_POSITION_RANK);
+}
+
+static void roaring64SelectFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64PositionFunc(context, argc, argv, ROARING_POSITION_SELECT);
+}
+
+static void roaring64IndexOfFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64PositionFunc(context, argc, argv, ROARING_POSITION_INDEX);
+}
+
+/*
+  reads the closed range [lo, hi] from arguments 1 and 2, clamped to the
+  32 bit values. returns 0 with the error set if they are not integers,
+  *pbEmpty is set when no 32 bit value is in the range
+*/
+static int roaringRangeInit(
+  sqlite3_context *context,
+  sqlite3_value **argv,
+  uint32_t *pLo,
+  uint32_t *pHi,
+  int *pbEmpty
+){
+  sqlite3_int64 lo, hi;
+  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER || sqlite3_value_type(argv[2])!=SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return 0;
+  }
+  lo = sqlite3_value_int64(argv[1]);
+  hi = sqlite3_value_int64(argv[2]);
+  if( lo < 0 ) lo = 0;
+  if( hi > UINT32_MAX ) hi = UINT32_MAX;
+  *pbEmpty = lo > hi;
+  *pLo = (uint32_t)lo;
+  *pHi = *pbEmpty ? *pLo : (uint32_t)hi;
+  return 1;
+}
+
+static int roaring64RangeInit(
+  sqlite3_context *context,
+  sqlite3_value **argv,
+  uint64_t *pLo,
+  uint64_t *pHi,
+  int *pbEmpty
+){
+  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER || sqlite3_value_type(argv[2])!=SQLITE_INTEGER ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return 0;
+  }
+  *pLo = (uint64_t) sqlite3_value_int64(argv[1]);
+  *pHi = (uint64_t) sqlite3_value_int64(argv[2]);
+  *pbEmpty = *pLo > *pHi;
+  return 1;
+}
+
+/*********************************************
+  rb_add_range(bitmap, lo, hi), rb_remove_range(bitmap, lo, hi),
+  rb_clip(bitmap, lo, hi)
+  --------------------------------------------
+  adds or removes all the values from lo to hi (both included) in one
+  step, rb_clip returns the values of the bitmap that are between lo and
+  hi. the range is clamped to the 32 bit values, lo > hi is an empty range
+
+  example: UPDATE t SET bitmap = rb_add_range(bitmap, :first_id, :last_id)
+*********************************************/
+#define ROARING_RANGE_ADD    1
+#define ROARING_RANGE_REMOVE 2
+#define ROARING_RANGE_CLIP   3
+
+static void roaringRangeFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv,
+  int op
+){
+  uint32_t lo, hi;
+  int bEmpty;
+  RoaringView v;
+  roaring_bitmap_t *r, *pRange;
+  if( !roaringRangeInit(context, argv, &lo, &hi, &bEmpty) ) return;
+  if( op == ROARING_RANGE_CLIP ){
+    // only the containers in the range are copied
+    if( !roaringArgInit(context, argv, 0, &v) ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+    if( bEmpty ){
+      r = roaring_bitmap_create();
+    }else{
+      pRange = roaring_bitmap_from_range(lo, (uint64_t)hi + 1, 1);
+      r = pRange ? roaring_bitmap_and(v.rb, pRange) : NULL;
+      roaring_bitmap_free(pRange);
+    }
+    roaringArgRelease(context, 0, &v);
+    roaringResult(context, r, roaringValuePointer(argv[0]) != NULL);
+    return;
+  }
+  r = roaringValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  if( !bEmpty ){
+    if( op == ROARING_RANGE_ADD ){
+      roaring_bitmap_add_range_closed(r, lo, hi);
+    }else{
+      roaring_bitmap_remove_range_closed(r, lo, hi);
+    }
+  }
+  roaringResult(context, r, roaringValuePointer(argv[0]) != NULL);
+}
+
+static void roaring64RangeFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv,
+  int op
+){
+  uint64_t lo, hi;
+  int bEmpty;
+  if( !roaring64RangeInit(context, argv, &lo, &hi, &bEmpty) ) return;
+  roaring64_bitmap_t *r = roaring64ValueDeserialize(argv[0]);
+  if( r == NULL ){
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  if( op == ROARING_RANGE_ADD && !bEmpty ){
+    roaring64_bitmap_add_range_closed(r, lo, hi);
+  }else if( op == ROARING_RANGE_REMOVE && !bEmpty ){
+    roaring64_bitmap_remove_range_closed(r, lo, hi);
+  }else if( op == ROARING_RANGE_CLIP && bEmpty ){
+    roaring64_bitmap_remove_range_closed(r, 0, UINT64_MAX);
+  }else if( op == ROARING_RANGE_CLIP ){
+    if( lo > 0 ) roaring64_bitmap_remove_range_closed(r, 0, lo - 1);
+    if( hi < UINT64_MAX ) roaring64_bitmap_remove_range_closed(r, hi + 1, UINT64_MAX);
+  }
+  roaring64Result(context, r, roaring64ValuePointer(argv[0]) != NULL);
+}
+
+static void roaringAddRangeFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringRangeFunc(context, argc, argv, ROARING_RANGE_ADD);
+}
+
+static void roaringRemoveRangeFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringRangeFunc(context, argc, argv, ROARING_RANGE_REMOVE);
+}
+
+static void roaringClipFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringRangeFunc(context, argc, argv, ROARING_RANGE_CLIP);
+}
+
+static void roaring64AddRangeFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64RangeFunc(context, argc, argv, ROARING_RANGE_ADD);
+}
+
+static void roaring64RemoveRangeFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64RangeFunc(context, argc, argv, ROARING_RANGE_REMOVE);
+}
+
+static void roaring64ClipFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64RangeFunc(context, argc, argv, ROARING_RANGE_CLIP);
+}
+
+/*********************************************
+  rb_range_count(bitmap, lo, hi), rb_intersects_range(bitmap, lo, hi)
+  --------------------------------------------
+  the number of values from lo to hi (both included), and whether there is
+  any. serialized bitmaps are not deserialized, the count is the difference
+  of the ranks of hi and lo - 1 which only read the containers of lo and hi
+*********************************************/
+static void roaringRangeCountFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv,
+  int bAny
+){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  uint32_t lo, hi;
+  uint64_t rankLo = 0, rankHi = 0;
+  int bEmpty;
+  RoaringHeader h;
+  RoaringView v;
+  if( !roaringRangeInit(context, argv, &lo, &hi, &bEmpty) ) return;
+  pIn = sqlite3_value_blob(argv[0]);
+  nIn = sqlite3_value_bytes(argv[0]);
+  if( roaringValuePointer(argv[0]) != NULL
+   || sqlite3_get_auxdata(context, 0) != NULL
+   || (nIn > 0 && pIn[0] == ROARING_SERIALIZATION_FROZEN)
+  ){
+    if( !roaringArgInit(context, argv, 0, &v) ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+    if( bEmpty ){
+      rankHi = 0;
+    }else if( bAny ){
+      rankHi = roaring_bitmap_intersect_with_range(v.rb, lo, (uint64_t)hi + 1);
+    }else{
+      rankHi = roaring_bitmap_range_cardinality_closed(v.rb, lo, hi);
+    }
+    roaringArgRelease(context, 0, &v);
+  }else{
+    if( !roaringHeaderInit(&h, pIn, nIn)
+     || roaringHeaderRank(&h, hi, &rankHi) < 0
+     || (lo > 0 && roaringHeaderRank(&h, lo - 1, &rankLo) < 0)
+    ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+    rankHi = bEmpty ? 0 : rankHi - rankLo;
+  }
+  if( bAny ){
+    sqlite3_result_int(context, rankHi > 0);
+  }else{
+    sqlite3_result_int64(context, (sqlite3_int64) rankHi);
+  }
+}
+
+static void roaring64RangeCountFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv,
+  int bAny
+){
+  const unsigned char *pIn;
+  unsigned int nIn;
+  uint64_t lo, hi;
+  uint64_t rankLo = 0, rankHi = 0;
+  int bEmpty;
+  roaring64_bitmap_t *r;
+  if( !roaring64RangeInit(context, argv, &lo, &hi, &bEmpty) ) return;
+  if( roaring64ValuePointer(argv[0]) != NULL || sqlite3_get_auxdata(context, 0) != NULL ){
+    r = roaring64ArgInit(context, argv, 0);
+    if( bEmpty ){
+      rankHi = 0;
+    }else if( bAny ){
+      // the half open range can't reach past UINT64_MAX
+      rankHi = hi == UINT64_MAX ? roaring64_bitmap_range_closed_cardinality(r, lo, hi) > 0
+        : roaring64_bitmap_intersect_with_range(r, lo, hi + 1);
+    }else{
+      rankHi = roaring64_bitmap_range_closed_cardinality(r, lo, hi);
+    }
+    roaring64ArgRelease(context, argv, 0, r);
+  }else{
+    pIn = sqlite3_value_blob(argv[0]);
+    nIn = sqlite3_value_bytes(argv[0]);
+    if( roaring64HeaderRank(pIn, nIn, hi, &rankHi) < 0
+     || (lo > 0 && roaring64HeaderRank(pIn, nIn, lo - 1, &rankLo) < 0)
+    ){
+      sqlite3_result_error(context, "invalid bitmap", -1);
+      return;
+    }
+    rankHi = bEmpty ? 0 : rankHi - rankLo;
+  }
+  if( bAny ){
+    sqlite3_result_int(context, rankHi > 0);
+  }else{
+    sqlite3_result_int64(context, (sqlite3_int64) rankHi);
+  }
+}
+
+static void roaringRangeLengthFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringRangeCountFunc(context, argc, argv, 0);
+}
+
+static void roaringIntersectsRangeFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaringRangeCountFunc(context, argc, argv, 1);
+}
+
+static void roaring64RangeLengthFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64RangeCountFunc(context, argc, argv, 0);
+}
+
+static void roaring64IntersectsRangeFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  roaring64RangeCountFunc(context, argc, argv, 1);
+}
+
+/*********************************************
+  bit-sliced indexes
+  --------------------------------------------
+  a bit-sliced index (BSI) keeps an integer per rowid as one bitmap per bit
+  of the value plus an existence bitmap, so range predicates, filtered sums
+  and top k queries run as bitmap operations. values are stored as offsets
+  from the smallest one, negative values work and the number of slices
+  follows the spread of the values
+
+  blob layout: ROARING_SERIALIZATION_BSI, the number of slices (1 byte),
+  the smallest value (8 bytes), then the existence bitmap and the slices
+  from the lowest bit up, each one a uint32 size and a serialized bitmap
+*********************************************/
+#define ROARING_SERIALIZATION_BSI 4
+#define ROARING_BSI_HEADER_SIZE   10
+#define ROARING_BSI_MAX_SLICE     64
+
+#define ROARING_BSI_EQ 1
+#define ROARING_BSI_NE 2
+#define ROARING_BSI_LT 3
+#define ROARING_BSI_LE 4
+#define ROARING_BSI_GT 5
+#define ROARING_BSI_GE 6
+
+typedef struct RoaringBsi RoaringBsi;
+struct RoaringBsi {
+  sqlite3_int64 iBase;                          // smallest value
+  int nSlice;
+  roaring_bitmap_t *pExist;                     // rowids that have a value
+  roaring_bitmap_t *aSlice[ROARING_BSI_MAX_SLICE]; // rowids with bit i of value - iBase set
+};
+
+typedef struct RoaringBsiPair RoaringBsiPair;
+struct RoaringBsiPair {
+  uint32_t iRowid;
+  sqlite3_int64 iValue;
+};
+
+typedef struct RoaringBsiContext RoaringBsiContext;
+struct RoaringBsiContext {
+  RoaringBsiPair *aPair;
+  sqlite3_int64 nPair;
+  sqlite3_int64 nAlloc;
+};
+
+static void roaringBsiFree(RoaringBsi *p){
+  if( p == NULL ) return;
+  if( p->pExist != NULL ) roaring_bitmap_free(p->pExist);
+  for(int i = 0; i < p->nSlice; i++){
+    if( p->aSlice[i] != NULL ) roaring_bitmap_free(p->aSlice[i]);
+  }
+  sqlite3_free(p);
+}
+
+static RoaringBsi *roaringBsiDeserialize(const unsigned char *pIn, sqlite3_int64 nIn){
+  RoaringBsi *p;
+  sqlite3_int64 iOff = ROARING_BSI_HEADER_SIZE;
+  uint32_t nBitmap;
+  if( pIn == NULL
+   || nIn < ROARING_BSI_HEADER_SIZE
+   || pIn[0] != ROARING_SERIALIZATION_BSI
+   || pIn[1] > ROARING_BSI_MAX_SLICE
+  ){
+    return NULL;
+  }
+  if( (p = sqlite3_malloc(sizeof(*p))) == NULL ) return NULL;
+  memset(p, 0, sizeof(*p));
+  p->nSlice = pIn[1];
+  memcpy(&p->iBase, pIn + 2, sizeof(p->iBase));
+  for(int i = -1; i < p->nSlice; i++){
+    roaring_bitmap_t *r = NULL;
+    if( nIn - iOff >= (sqlite3_int64)sizeof(nBitmap) ){
+      memcpy(&nBitmap, pIn + iOff, sizeof(nBitmap));
+      iOff += sizeof(nBitmap);
+      if( nBitmap <= nIn - iOff ) r = roaringDeserialize(pIn + iOff, nBitmap);
+      iOff += nBitmap;
+    }
+    if( r == NULL ){
+      roaringBsiFree(p);
+      return NULL;
+    }
+    if( i < 0 ) p->pExist = r; else p->aSlice[i] = r;
   }
-  int nSize = (int )roaring_bitmap_size_in_bytes(r);
-  char *pOut = sqlite3_malloc(nSize);
-  int nOut = (int) roaring_bitmap_serialize(r, pOut);
-  roaring_bitmap_free(r);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free); 
+  if( iOff != nIn ){
+    roaringBsiFree(p);
+    return NULL;
+  }
+  return p;
 }
 
-static void roaring64CreateFunc(  
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  roaring64_bitmap_t *r = roaring64_bitmap_create();
-  for(int i=0; i < argc; i++){
-    if( sqlite3_value_type(argv[i])!=SQLITE_INTEGER ){
-      sqlite3_result_error(context, "invalid argument", -1);
-      return;
+/*
+  serializes the index as the function result, takes ownership of it
+*/
+static void roaringBsiResult(sqlite3_context *context, RoaringBsi *p){
+  sqlite3_int64 nOut = ROARING_BSI_HEADER_SIZE, iOff = ROARING_BSI_HEADER_SIZE;
+  unsigned char *pOut;
+  uint32_t nBitmap;
+  for(int i = -1; i < p->nSlice; i++){
+    roaring_bitmap_t *r = i < 0 ? p->pExist : p->aSlice[i];
+    roaringCompact(context, r);
+    nOut += sizeof(nBitmap) + roaring_bitmap_size_in_bytes(r);
+  }
+  if( (pOut = sqlite3_malloc64(nOut)) == NULL ){
+    roaringBsiFree(p);
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  pOut[0] = ROARING_SERIALIZATION_BSI;
+  pOut[1] = (unsigned char)p->nSlice;
+  memcpy(pOut + 2, &p->iBase, sizeof(p->iBase));
+  for(int i = -1; i < p->nSlice; i++){
+    roaring_bitmap_t *r = i < 0 ? p->pExist : p->aSlice[i];
+    nBitmap = (uint32_t)roaring_bitmap_serialize(r, (char*)pOut + iOff + sizeof(nBitmap));
+    memcpy(pOut + iOff, &nBitmap, sizeof(nBitmap));
+    iOff += sizeof(nBitmap) + nBitmap;
+  }
+  roaringBsiFree(p);
+  sqlite3_result_blob64(context, pOut, iOff, sqlite3_free);
+}
+
+/*
+  the index in argument 0. like roaringArgInit a deserialized index is kept
+  as aux data by roaringBsiArgRelease, so a constant one is read once per
+  statement
+*/
+static RoaringBsi *roaringBsiArgInit(sqlite3_context *context, sqlite3_value **argv){
+  RoaringBsi *p = (RoaringBsi*)sqlite3_get_auxdata(context, 0);
+  if( p != NULL ) return p;
+  p = roaringBsiDeserialize(sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]));
+  if( p == NULL ) sqlite3_result_error(context, "invalid bitmap", -1);
+  return p;
+}
+
+static void roaringBsiArgRelease(sqlite3_context *context, RoaringBsi *p){
+  if( p != NULL && p != sqlite3_get_auxdata(context, 0) ){
+    sqlite3_set_auxdata(context, 0, p, (void(*)(void*))roaringBsiFree);
+  }
+}
+
+/*
+  rowids whose value compares to x as op. the slices are walked from the
+  highest bit down, keeping the rows equal to x on the bits seen so far and
+  moving the ones that differ to the smaller or larger side
+*/
+static roaring_bitmap_t *roaringBsiCompare(const RoaringBsi *p, int op, sqlite3_int64 x){
+  roaring_bitmap_t *pEq, *pSide, *pDiff, *r;
+  uint64_t iOff = (uint64_t)x - (uint64_t)p->iBase;
+  int bLess = op == ROARING_BSI_LT || op == ROARING_BSI_GE;
+  int bSide = op != ROARING_BSI_EQ && op != ROARING_BSI_NE;
+  if( x < p->iBase ){
+    // every row is larger
+    pEq = roaring_bitmap_create();
+    pSide = bLess ? roaring_bitmap_create() : roaring_bitmap_copy(p->pExist);
+  }else if( p->nSlice < ROARING_BSI_MAX_SLICE && (iOff >> p->nSlice) != 0 ){
+    // every row is smaller
+    pEq = roaring_bitmap_create();
+    pSide = bLess ? roaring_bitmap_copy(p->pExist) : roaring_bitmap_create();
+  }else{
+    pEq = roaring_bitmap_copy(p->pExist);
+    pSide = roaring_bitmap_create();
+    for(int i = p->nSlice - 1; i >= 0 && !roaring_bitmap_is_empty(pEq); i--){
+      int bBit = (iOff >> i) & 1;
+      if( bSide && bBit == bLess ){
+        // with bit i of x set the rows without it are smaller, and the other way round
+        pDiff = bLess ? roaring_bitmap_andnot(pEq, p->aSlice[i]) : roaring_bitmap_and(pEq, p->aSlice[i]);
+        roaring_bitmap_or_inplace(pSide, pDiff);
+        roaring_bitmap_free(pDiff);
+      }
+      if( bBit ){
+        roaring_bitmap_and_inplace(pEq, p->aSlice[i]);
+      }else{
+        roaring_bitmap_andnot_inplace(pEq, p->aSlice[i]);
+      }
     }
-    roaring64_bitmap_add(r, sqlite3_value_int64(argv[i]));
   }
-  int nSize = (int )roaring64_bitmap_portable_size_in_bytes(r);
-  char *pOut = sqlite3_malloc(nSize);
-  int nOut = (int) roaring64_bitmap_portable_serialize(r, pOut);
-  roaring64_bitmap_free(r);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free); 
+  switch( op ){
+    case ROARING_BSI_EQ: r = pEq; pEq = NULL; break;
+    case ROARING_BSI_NE: r = roaring_bitmap_andnot(p->pExist, pEq); break;
+    case ROARING_BSI_LT:
+    case ROARING_BSI_GT: r = pSide; pSide = NULL; break;
+    default: r = roaring_bitmap_andnot(p->pExist, pSide); break;
+  }
+  if( pEq != NULL ) roaring_bitmap_free(pEq);
+  if( pSide != NULL ) roaring_bitmap_free(pSide);
+  return r;
 }
 
 /*
-  struct to hold a roaring bitmap
+  128 bit two's complement accumulator for rb_bsi_sum. with at most 2^32
+  rows, nRow * iBase and every slice's weighted count stay well inside it,
+  so only the final sum needs to fit in 64 bits
 */
-typedef struct RoaringContext RoaringContext;
-struct RoaringContext {
-  unsigned init;
-  roaring_bitmap_t *rb;
+typedef struct RoaringBsiSum RoaringBsiSum;
+struct RoaringBsiSum {
+  uint64_t hi;
+  uint64_t lo;
 };
 
-typedef struct Roaring64Context Roaring64Context;
-struct Roaring64Context {
-  unsigned init;
-  roaring64_bitmap_t *rb;
-};
+static void roaringBsiSumAdd(RoaringBsiSum *p, uint64_t hi, uint64_t lo){
+  p->lo += lo;
+  p->hi += hi + (p->lo < lo);
+}
+
+/*
+  n << i for i < 64
+*/
+static void roaringBsiSumAddShifted(RoaringBsiSum *p, uint64_t n, int i){
+  roaringBsiSumAdd(p, i ? n >> (64 - i) : 0, n << i);
+}
+
+/*
+  iBase * nRow for nRow <= 2^32, as 32 bit halves of |iBase|
+*/
+static void roaringBsiSumAddProduct(RoaringBsiSum *p, sqlite3_int64 iBase, uint64_t nRow){
+  uint64_t m = iBase < 0 ? (uint64_t)(-(iBase + 1)) + 1 : (uint64_t)iBase;
+  uint64_t a = (m & 0xffffffff) * nRow;
+  uint64_t b = (m >> 32) * nRow;
+  uint64_t lo = a + (b << 32);
+  uint64_t hi = (b >> 32) + (lo < a);
+  if( iBase < 0 ){
+    lo = ~lo + 1;
+    hi = ~hi + (lo == 0);
+  }
+  roaringBsiSumAdd(p, hi, lo);
+}
 
+/*
+  returns 0 if the sum does not fit in 64 bits
+*/
+static int roaringBsiSumValue(const RoaringBsiSum *p, sqlite3_int64 *pOut){
+  if( p->hi != (p->lo >> 63 ? UINT64_MAX : 0) ) return 0;
+  *pOut = (sqlite3_int64)p->lo;
+  return 1;
+}
 
 /*********************************************
-  rb_group_create(col) 
+  rb_bsi_build(rowid, value)
   --------------------------------------------
-  creates a bitmap from a SQL aggregation
-  
-  example: SELECT rb_group_create(col) FROM table;
+  aggregate that builds a bit-sliced index of the values, rows with a NULL
+  value are left out. the pairs are collected first since the number of
+  slices depends on the smallest and largest value
+
+  example: SELECT rb_bsi_build(rowid, price) FROM products;
 *********************************************/
-static void roaringCreateStep(
+static void roaringBsiBuildStep(
   sqlite3_context *context,
   int argc,
   sqlite3_value **argv
 ){
-
-  RoaringContext *rc;
-
-  // bail out if the value supplied is not an integer
-  if( sqlite3_value_type(argv[0])!=SQLITE_INTEGER ){
+  RoaringBsiContext *bc;
+  sqlite3_int64 iRowid;
+  if( sqlite3_value_type(argv[1]) == SQLITE_NULL ) return;
+  iRowid = sqlite3_value_int64(argv[0]);
+  if( sqlite3_value_type(argv[0]) != SQLITE_INTEGER
+   || iRowid < 0 || iRowid > UINT32_MAX
+   || sqlite3_value_type(argv[1]) != SQLITE_INTEGER
+  ){
     sqlite3_result_error(context, "invalid argument", -1);
     return;
   }
-
-  // check if the context already has the roaring bitmap  
-  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
-  if(rc->init == 0){
-    // create a roaring bitmap
-    rc->rb = roaring_bitmap_create();
-    if(rc->rb == NULL){
-      memset(rc, 0, sizeof(*rc)); 
-      sqlite3_result_error(context, "failed to create bitmap in step", -1);
+  bc = (RoaringBsiContext*)sqlite3_aggregate_context(context, sizeof(*bc));
+  if( bc == NULL ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  if( bc->nPair == bc->nAlloc ){
+    sqlite3_int64 nNew = bc->nAlloc ? bc->nAlloc * 2 : 256;
+    RoaringBsiPair *aNew = sqlite3_realloc64(bc->aPair, nNew * sizeof(*aNew));
+    if( aNew == NULL ){
+      sqlite3_result_error_nomem(context);
       return;
     }
-    rc->init = 1;
+    bc->aPair = aNew;
+    bc->nAlloc = nNew;
   }
-  roaring_bitmap_add(rc->rb, sqlite3_value_int(argv[0]));
+  bc->aPair[bc->nPair].iRowid = (uint32_t)iRowid;
+  bc->aPair[bc->nPair].iValue = sqlite3_value_int64(argv[1]);
+  bc->nPair++;
 }
 
-static void roaringCreateFinal(sqlite3_context *context){
-  RoaringContext *rc;
-  int nOut, nSize;
-  
-  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
-  if(rc->rb == NULL){
-    // no rb was created, must be an empty result set
-    rc->rb = roaring_bitmap_create();    
+static void roaringBsiBuildFinal(sqlite3_context *context){
+  RoaringBsiContext *bc = (RoaringBsiContext*)sqlite3_aggregate_context(context, 0);
+  roaring_bulk_context_t aBulk[ROARING_BSI_MAX_SLICE + 1];
+  RoaringBsi *p;
+  sqlite3_int64 iMin = 0, iMax = 0, nPair = bc ? bc->nPair : 0;
+  uint64_t nSpread;
+  int nSlice = 0, bOk = 1;
+  for(sqlite3_int64 k = 0; k < nPair; k++){
+    if( k == 0 || bc->aPair[k].iValue < iMin ) iMin = bc->aPair[k].iValue;
+    if( k == 0 || bc->aPair[k].iValue > iMax ) iMax = bc->aPair[k].iValue;
   }
-  nSize = (int )roaring_bitmap_size_in_bytes(rc->rb);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int) roaring_bitmap_serialize(rc->rb, pOut);
-  roaring_bitmap_free(rc->rb); 
-  memset(rc, 0, sizeof(*rc)); 
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  for(nSpread = (uint64_t)iMax - (uint64_t)iMin; nSpread != 0; nSpread >>= 1) nSlice++;
+  p = sqlite3_malloc(sizeof(*p));
+  if( p != NULL ){
+    memset(p, 0, sizeof(*p));
+    p->iBase = iMin;
+    p->nSlice = nSlice;
+    for(int i = -1; i < nSlice; i++){
+      roaring_bitmap_t *r = roaring_bitmap_create();
+      if( r == NULL ) bOk = 0;
+      if( i < 0 ) p->pExist = r; else p->aSlice[i] = r;
+    }
+  }
+  if( p == NULL || !bOk ){
+    roaringBsiFree(p);
+    if( bc ) sqlite3_free(bc->aPair);
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  memset(aBulk, 0, sizeof(aBulk));
+  for(sqlite3_int64 k = 0; k < nPair; k++){
+    uint64_t iOff = (uint64_t)bc->aPair[k].iValue - (uint64_t)iMin;
+    uint32_t iRowid = bc->aPair[k].iRowid;
+    roaring_bitmap_add_bulk(p->pExist, &aBulk[ROARING_BSI_MAX_SLICE], iRowid);
+    for(int i = 0; iOff != 0; i++, iOff >>= 1){
+      if( iOff & 1 ) roaring_bitmap_add_bulk(p->aSlice[i], &aBulk[i], iRowid);
+    }
+  }
+  if( bc ) sqlite3_free(bc->aPair);
+  if( (sqlite3_int64)roaring_bitmap_get_cardinality(p->pExist) != nPair ){
+    // a rowid with two values
+    roaringBsiFree(p);
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  roaringBsiResult(context, p);
 }
 
-static void roaring64CreateStep(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
+/*********************************************
+  rb_bsi_range(bsi, op, x), rb_bsi_range(bsi, 'between', x, y)
+  --------------------------------------------
+  returns the bitmap of the rowids whose value compares to x as op, which
+  is one of =, !=, <, <=, >, >=. 'between' takes both bounds, inclusive
 
-  Roaring64Context *rc;
+  example: SELECT rb_bsi_range(bsi, '>=', 100) FROM price_index;
+           SELECT rb_bsi_range(bsi, 'between', 100, 200) FROM price_index;
+*********************************************/
+static int roaringBsiOp(sqlite3_value *pVal){
+  static const struct { const char *zOp; int op; } aOp[] = {
+    { "=", ROARING_BSI_EQ }, { "==", ROARING_BSI_EQ },
+    { "!=", ROARING_BSI_NE }, { "<>", ROARING_BSI_NE },
+    { "<", ROARING_BSI_LT }, { "<=", ROARING_BSI_LE },
+    { ">", ROARING_BSI_GT }, { ">=", ROARING_BSI_GE },
+  };
+  const char *zOp = (const char*)sqlite3_value_text(pVal);
+  if( zOp == NULL ) return 0;
+  for(size_t i = 0; i < sizeof(aOp) / sizeof(aOp[0]); i++){
+    if( strcmp(zOp, aOp[i].zOp) == 0 ) return aOp[i].op;
+  }
+  return 0;
+}
 
-  // bail out if the value supplied is not an integer
-  if( sqlite3_value_type(argv[0])!=SQLITE_INTEGER ){
+static void roaringBsiRangeFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  RoaringBsi *p;
+  roaring_bitmap_t *r, *pHi;
+  int op = 0;
+  if( argc == 3 ){
+    op = roaringBsiOp(argv[1]);
+  }else if( sqlite3_value_type(argv[1]) == SQLITE_TEXT
+         && sqlite3_stricmp((const char*)sqlite3_value_text(argv[1]), "between") == 0
+  ){
+    op = ROARING_BSI_GE;
+  }
+  if( op == 0
+   || sqlite3_value_type(argv[2]) != SQLITE_INTEGER
+   || (argc == 4 && sqlite3_value_type(argv[3]) != SQLITE_INTEGER)
+  ){
     sqlite3_result_error(context, "invalid argument", -1);
     return;
   }
-
-  // check if the context already has the roaring bitmap  
-  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
-  if(rc->init == 0){
-    // create a roaring bitmap
-    rc->rb = roaring64_bitmap_create();
-    if(rc->rb == NULL){
-      memset(rc, 0, sizeof(*rc)); 
-      sqlite3_result_error(context, "failed to create bitmap in step", -1);
-      return;
+  if( (p = roaringBsiArgInit(context, argv)) == NULL ) return;
+  r = roaringBsiCompare(p, op, sqlite3_value_int64(argv[2]));
+  if( r != NULL && argc == 4 ){
+    pHi = roaringBsiCompare(p, ROARING_BSI_GT, sqlite3_value_int64(argv[3]));
+    if( pHi != NULL ){
+      roaring_bitmap_andnot_inplace(r, pHi);
+      roaring_bitmap_free(pHi);
+    }else{
+      roaring_bitmap_free(r);
+      r = NULL;
     }
-    rc->init = 1;
   }
-  roaring64_bitmap_add(rc->rb, sqlite3_value_int64(argv[0]));
+  roaringResult(context, r, 0);
+  roaringBsiArgRelease(context, p);
 }
 
-static void roaring64CreateFinal(sqlite3_context *context){
-  Roaring64Context *rc;
-  int nOut, nSize;
-  
-  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
-  if(rc->rb == NULL){
-    // no rb was created, must be an empty result set
-    rc->rb = roaring64_bitmap_create();    
+/*********************************************
+  rb_bsi_sum(bsi [, filter])
+  --------------------------------------------
+  sum of the values of the rowids in the filter bitmap, or of all values.
+  each slice adds its bit weight times its intersection count with the
+  filter, the rows are never visited. NULL if no row matches, like sum()
+
+  example: SELECT rb_bsi_sum(bsi, :customers) FROM revenue_index;
+*********************************************/
+static void roaringBsiSumFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  RoaringBsi *p;
+  RoaringView v;
+  uint64_t nRow, nCard;
+  RoaringBsiSum sum = {0, 0};
+  sqlite3_int64 iSum = 0;
+  if( (p = roaringBsiArgInit(context, argv)) == NULL ) return;
+  memset(&v, 0, sizeof(v));
+  if( argc == 2 && !roaringArgInit(context, argv, 1, &v) ){
+    roaringArgRelease(context, 1, &v);
+    roaringBsiArgRelease(context, p);
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
   }
-  nSize = (int )roaring64_bitmap_portable_size_in_bytes(rc->rb);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int) roaring64_bitmap_portable_serialize(rc->rb, pOut);
-  roaring64_bitmap_free(rc->rb); 
-  memset(rc, 0, sizeof(*rc)); 
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  nRow = v.rb ? roaring_bitmap_and_cardinality(p->pExist, v.rb) : roaring_bitmap_get_cardinality(p->pExist);
+  // the sum is nRow * iBase plus each slice's count times its bit weight
+  roaringBsiSumAddProduct(&sum, p->iBase, nRow);
+  for(int i = 0; i < p->nSlice && nRow > 0; i++){
+    nCard = v.rb ? roaring_bitmap_and_cardinality(p->aSlice[i], v.rb) : roaring_bitmap_get_cardinality(p->aSlice[i]);
+    roaringBsiSumAddShifted(&sum, nCard, i);
+  }
+  if( argc == 2 ) roaringArgRelease(context, 1, &v);
+  if( !roaringBsiSumValue(&sum, &iSum) ){
+    sqlite3_result_error(context, "integer overflow", -1);
+  }else if( nRow > 0 ){
+    sqlite3_result_int64(context, iSum);
+  }
+  roaringBsiArgRelease(context, p);
 }
 
+/*********************************************
+  rb_bsi_topk(bsi, [filter,] k)
+  --------------------------------------------
+  returns the bitmap of the k rowids with the largest values, of the rows
+  in the filter bitmap if one is given. the slices are walked from the
+  highest bit down: rows having the bit are taken as long as they fit in k,
+  otherwise the search narrows to them. ties at the cut off are broken by
+  the smallest rowids
 
-/*
-static void roaringCreatePFinal(sqlite3_context *context){
-  RoaringContext *rc;
-  int nOut, nSize;
-  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
-  nSize = (int )roaring_bitmap_size_in_bytes(rc->rb);
-  sqlite3_result_pointer(context, rc->rb, "rbitmap", roaringFreeFunc);  
+  example: SELECT rb_bsi_topk(bsi, :region, 10) FROM revenue_index;
+*********************************************/
+static void roaringBsiTopkFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  RoaringBsi *p;
+  RoaringView v;
+  roaring_bitmap_t *pTop = NULL, *pTie, *pTake;
+  sqlite3_int64 k = sqlite3_value_int64(argv[argc - 1]);
+  uint64_t nTop = 0, n;
+  uint32_t x;
+  if( sqlite3_value_type(argv[argc - 1]) != SQLITE_INTEGER || k < 0 ){
+    sqlite3_result_error(context, "invalid argument", -1);
+    return;
+  }
+  if( (p = roaringBsiArgInit(context, argv)) == NULL ) return;
+  memset(&v, 0, sizeof(v));
+  if( argc == 3 && !roaringArgInit(context, argv, 1, &v) ){
+    roaringArgRelease(context, 1, &v);
+    roaringBsiArgRelease(context, p);
+    sqlite3_result_error(context, "invalid bitmap", -1);
+    return;
+  }
+  // pTop holds the rows known to be in, pTie the candidates for the rest
+  pTie = v.rb ? roaring_bitmap_and(p->pExist, v.rb) : roaring_bitmap_copy(p->pExist);
+  if( argc == 3 ) roaringArgRelease(context, 1, &v);
+  if( pTie != NULL && roaring_bitmap_get_cardinality(pTie) > (uint64_t)k ){
+    pTop = roaring_bitmap_create();
+    for(int i = p->nSlice - 1; i >= 0 && pTop != NULL && nTop < (uint64_t)k; i--){
+      n = nTop + roaring_bitmap_and_cardinality(pTie, p->aSlice[i]);
+      if( n > (uint64_t)k ){
+        roaring_bitmap_and_inplace(pTie, p->aSlice[i]);
+        continue;
+      }
+      pTake = roaring_bitmap_and(pTie, p->aSlice[i]);
+      if( pTake == NULL ){
+        roaring_bitmap_free(pTop);
+        pTop = NULL;
+        break;
+      }
+      roaring_bitmap_or_inplace(pTop, pTake);
+      roaring_bitmap_free(pTake);
+      roaring_bitmap_andnot_inplace(pTie, p->aSlice[i]);
+      nTop = n;
+    }
+    if( pTop != NULL && nTop < (uint64_t)k && roaring_bitmap_select(pTie, (uint32_t)(k - nTop - 1), &x) ){
+      if( x < UINT32_MAX ) roaring_bitmap_remove_range_closed(pTie, x + 1, UINT32_MAX);
+      roaring_bitmap_or_inplace(pTop, pTie);
+    }
+    roaring_bitmap_free(pTie);
+    pTie = pTop;
+  }
+  roaringResult(context, pTie, argc == 3 && roaringValuePointer(argv[1]) != NULL);
+  roaringBsiArgRelease(context, p);
 }
-*/
+
 /*********************************************
-  rb_add(bitmap, element)
+  rb_each(bitmap)
   --------------------------------------------
-  adds an element to the bitmap and returns the new bitmap
+  table valued function that returns the elements of the bitmap one row
+  at a time. the rows come from an iterator so the elements are never
+  materialized, blobs are iterated in place and only the container under
+  the cursor is read
+
+  constraints on value (=, >, >=, <, <=, BETWEEN) and on the hidden rank
+  column (the 1 based position of the element) are pushed down, the cursor
+  seeks to the first matching element instead of scanning from the start
+
+  example: SELECT value FROM rb_each(bitmap) WHERE value > 1000 LIMIT 10
+           SELECT value FROM rb_each(bitmap) WHERE rank > 100 LIMIT 10
 *********************************************/
-static void roaringAddFunc(
-  sqlite3_context *context,
+#define ROARING_EACH_VALUE  0
+#define ROARING_EACH_BITMAP 1
+#define ROARING_EACH_RANK   2
+
+/*
+  idxNum holds one 4 bit operator per argument slot, the arguments are
+  passed to xFilter in slot order
+*/
+#define ROARING_EACH_SLOT_BITMAP     0
+#define ROARING_EACH_SLOT_VALUE_MIN  1
+#define ROARING_EACH_SLOT_VALUE_MAX  2
+#define ROARING_EACH_SLOT_RANK_MIN   3
+#define ROARING_EACH_SLOT_RANK_MAX   4
+#define ROARING_EACH_NSLOT           5
+
+#define ROARING_EACH_OP_EQ 1
+#define ROARING_EACH_OP_GT 2
+#define ROARING_EACH_OP_GE 3
+#define ROARING_EACH_OP_LT 4
+#define ROARING_EACH_OP_LE 5
+
+typedef struct RoaringEachVtab RoaringEachVtab;
+struct RoaringEachVtab {
+  sqlite3_vtab base;
+  int b64;                         // set for rb64_each
+};
+
+/*
+  the value ranges to visit in iteration order, in 64bit mode values above
+  INT64_MAX show up as negative integers so a SQL range can map to two
+*/
+typedef struct RoaringEachRanges RoaringEachRanges;
+struct RoaringEachRanges {
+  int nRange;
+  int iRange;
+  uint64_t aMin[2];
+  uint64_t aMax[2];
+  sqlite3_int64 iRankMin;
+  sqlite3_int64 iRankMax;
+};
+
+typedef struct RoaringEachCursor RoaringEachCursor;
+struct RoaringEachCursor {
+  sqlite3_vtab_cursor base;
+  RoaringView v;                   // pointer values and frozen blobs
+  roaring_uint32_iterator_t it;
+  RoaringHeader h;                 // other blobs, read in place by hit
+  RoaringHeaderIterator hit;
+  int bHeader;                     // iterating hit rather than it
+  int bEof;
+  uint32_t iValue;                 // current element
+  RoaringEachRanges r;
+  sqlite3_int64 iRowid;            // 0 until it is needed
+};
+
+typedef struct Roaring64EachCursor Roaring64EachCursor;
+struct Roaring64EachCursor {
+  sqlite3_vtab_cursor base;
+  roaring64_bitmap_t *rb;
+  int bShared;                     // rb belongs to a pointer value
+  int bEof;
+  roaring64_iterator_t *it;
+  RoaringEachRanges r;
+  sqlite3_int64 iRowid;            // 0 until it is needed
+};
+
+static int roaringEachConnect(
+  sqlite3 *db,
+  void *pAux,
   int argc,
-  sqlite3_value **argv
+  const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
 ){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
-  roaring_bitmap_t *r = roaring_bitmap_deserialize_safe(pIn, nIn);
-  if( r == NULL ){
-    sqlite3_result_error(context, "invalid bitmap", -1);
-    return;
+  RoaringEachVtab *pNew;
+  int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(value, bitmap HIDDEN, rank HIDDEN)");
+  if( rc==SQLITE_OK ){
+    pNew = sqlite3_malloc(sizeof(*pNew));
+    if( pNew==0 ) return SQLITE_NOMEM;
+    memset(pNew, 0, sizeof(*pNew));
+    pNew->b64 = pAux!=0;
+    *ppVtab = &pNew->base;
+    sqlite3_vtab_config(db, SQLITE_VTAB_INNOCUOUS);
+  }
+  return rc;
+}
+
+static int roaringEachDisconnect(sqlite3_vtab *pVtab){
+  sqlite3_free(pVtab);
+  return SQLITE_OK;
+}
+
+/*
+  the bitmap argument is required and gets passed to xFilter, value and rank
+  bounds are passed along as well but are not omitted so SQLite still checks
+  them, the cursor only has to return a superset of the matching rows
+*/
+static int roaringEachBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *pIdxInfo){
+  int aIdx[ROARING_EACH_NSLOT];
+  int aOp[ROARING_EACH_NSLOT];
+  int idxNum = 0;
+  int nArg = 0;
+  double cost = 1000;
+  const struct sqlite3_index_constraint *pConstraint = pIdxInfo->aConstraint;
+  memset(aOp, 0, sizeof(aOp));
+  for(int i=0; i < pIdxInfo->nConstraint; i++, pConstraint++){
+    int op, slot;
+    switch( pConstraint->op ){
+      case SQLITE_INDEX_CONSTRAINT_EQ: op = ROARING_EACH_OP_EQ; break;
+      case SQLITE_INDEX_CONSTRAINT_GT: op = ROARING_EACH_OP_GT; break;
+      case SQLITE_INDEX_CONSTRAINT_GE: op = ROARING_EACH_OP_GE; break;
+      case SQLITE_INDEX_CONSTRAINT_LT: op = ROARING_EACH_OP_LT; break;
+      case SQLITE_INDEX_CONSTRAINT_LE: op = ROARING_EACH_OP_LE; break;
+      default: continue;
+    }
+    if( pConstraint->iColumn==ROARING_EACH_BITMAP ){
+      if( op!=ROARING_EACH_OP_EQ ) continue;
+      if( !pConstraint->usable ) return SQLITE_CONSTRAINT;
+      slot = ROARING_EACH_SLOT_BITMAP;
+    }else if( !pConstraint->usable ){
+      continue;
+    }else if( pConstraint->iColumn==ROARING_EACH_VALUE ){
+      slot = op>=ROARING_EACH_OP_LT ? ROARING_EACH_SLOT_VALUE_MAX : ROARING_EACH_SLOT_VALUE_MIN;
+    }else if( pConstraint->iColumn==ROARING_EACH_RANK ){
+      slot = op>=ROARING_EACH_OP_LT ? ROARING_EACH_SLOT_RANK_MAX : ROARING_EACH_SLOT_RANK_MIN;
+    }else{
+      continue;
+    }
+    // an equality bounds both sides so it beats any other lower bound
+    if( aOp[slot]==0 || op==ROARING_EACH_OP_EQ ){
+      aOp[slot] = op;
+      aIdx[slot] = i;
+    }
+  }
+  if( aOp[ROARING_EACH_SLOT_BITMAP]==0 ){
+    // no bitmap, the scan returns no rows
+    pIdxInfo->idxNum = 0;
+    pIdxInfo->estimatedCost = (double)2147483647;
+    return SQLITE_OK;
+  }
+  for(int slot=0; slot < ROARING_EACH_NSLOT; slot++){
+    if( aOp[slot]==0 ) continue;
+    pIdxInfo->aConstraintUsage[aIdx[slot]].argvIndex = ++nArg;
+    idxNum |= aOp[slot] << (slot*4);
+    if( slot>ROARING_EACH_SLOT_BITMAP ) cost /= aOp[slot]==ROARING_EACH_OP_EQ ? 100 : 4;
+  }
+  pIdxInfo->aConstraintUsage[aIdx[ROARING_EACH_SLOT_BITMAP]].omit = 1;
+  pIdxInfo->idxNum = idxNum;
+  pIdxInfo->estimatedCost = cost;
+  // rb64_each rows are in unsigned order which is not the SQL order
+  if( !((RoaringEachVtab*)pVtab)->b64
+   && pIdxInfo->nOrderBy==1
+   && pIdxInfo->aOrderBy[0].iColumn==ROARING_EACH_VALUE
+   && pIdxInfo->aOrderBy[0].desc==0
+  ){
+    pIdxInfo->orderByConsumed = 1;
+  }
+  return SQLITE_OK;
+}
+
+/*
+  narrows [*pMin, *pMax] by a single comparison, returns 0 if nothing can
+  match. non integer operands give a range that is never narrower than the
+  exact one since SQLite checks the rows again
+*/
+static int roaringEachBound(
+  sqlite3_value *pVal,
+  int op,
+  sqlite3_int64 *pMin,
+  sqlite3_int64 *pMax
+){
+  sqlite3_int64 iMin, iMax;
+  switch( sqlite3_value_type(pVal) ){
+    case SQLITE_INTEGER: {
+      iMin = iMax = sqlite3_value_int64(pVal);
+      if( op==ROARING_EACH_OP_GT ){
+        if( iMin==INT64_MAX ) return 0;
+        iMin++;
+      }else if( op==ROARING_EACH_OP_LT ){
+        if( iMax==INT64_MIN ) return 0;
+        iMax--;
+      }
+      break;
+    }
+    case SQLITE_FLOAT: {
+      double d = sqlite3_value_double(pVal);
+      if( d!=d ) return 0;
+      if( d <= -9.2e18 ){
+        iMin = iMax = INT64_MIN;
+      }else if( d >= 9.2e18 ){
+        iMin = iMax = INT64_MAX;
+      }else{
+        iMin = iMax = (sqlite3_int64)d;
+        if( (double)iMin > d ) iMin--;
+        if( (double)iMax < d ) iMax++;
+      }
+      break;
+    }
+    case SQLITE_NULL:
+      return 0;
+    default:
+      // integers sort before text and blobs
+      if( op==ROARING_EACH_OP_LT || op==ROARING_EACH_OP_LE ) return 1;
+      return 0;
+  }
+  if( op!=ROARING_EACH_OP_LT && op!=ROARING_EACH_OP_LE && iMin > *pMin ) *pMin = iMin;
+  if( op!=ROARING_EACH_OP_GT && op!=ROARING_EACH_OP_GE && iMax < *pMax ) *pMax = iMax;
+  return *pMin <= *pMax;
+}
+
+/*
+  turns the pushed down constraints into unsigned value ranges no larger
+  than nMaxValue, returns 0 if no row can match
+*/
+static int roaringEachRangesInit(
+  RoaringEachRanges *r,
+  int idxNum,
+  sqlite3_value **argv,
+  uint64_t nMaxValue
+){
+  sqlite3_int64 iMin = INT64_MIN, iMax = INT64_MAX;
+  int iArg = 1;
+  memset(r, 0, sizeof(*r));
+  r->iRankMin = 1;
+  r->iRankMax = INT64_MAX;
+  for(int slot=ROARING_EACH_SLOT_VALUE_MIN; slot < ROARING_EACH_NSLOT; slot++){
+    int op = (idxNum >> (slot*4)) & 0xf;
+    if( op==0 ) continue;
+    if( slot<=ROARING_EACH_SLOT_VALUE_MAX ){
+      if( !roaringEachBound(argv[iArg++], op, &iMin, &iMax) ) return 0;
+    }else{
+      if( !roaringEachBound(argv[iArg++], op, &r->iRankMin, &r->iRankMax) ) return 0;
+    }
+  }
+  if( r->iRankMax < 1 ) return 0;
+  if( iMax >= 0 ){
+    r->aMin[r->nRange] = iMin < 0 ? 0 : (uint64_t)iMin;
+    r->aMax[r->nRange] = (uint64_t)iMax < nMaxValue ? (uint64_t)iMax : nMaxValue;
+    if( r->aMin[r->nRange] <= r->aMax[r->nRange] ) r->nRange++;
+  }
+  if( iMin < 0 && nMaxValue > INT64_MAX ){
+    r->aMin[r->nRange] = (uint64_t)iMin;
+    r->aMax[r->nRange] = (uint64_t)(iMax < 0 ? iMax : -1);
+    r->nRange++;
+  }
+  return r->nRange > 0;
+}
+
+static int roaringEachOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor){
+  RoaringEachCursor *pCur;
+  pCur = sqlite3_malloc(sizeof(*pCur));
+  if( pCur==0 ) return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur));
+  pCur->bEof = 1;
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+static void roaringEachReset(RoaringEachCursor *pCur){
+  roaringViewFree(&pCur->v);
+  pCur->it.has_value = false;
+  pCur->bHeader = 0;
+  pCur->bEof = 1;
+  pCur->iRowid = 0;
+}
+
+static int roaringEachClose(sqlite3_vtab_cursor *cur){
+  RoaringEachCursor *pCur = (RoaringEachCursor*)cur;
+  roaringEachReset(pCur);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+static int roaringEachCorrupt(RoaringEachCursor *pCur){
+  sqlite3_vtab *pVtab = pCur->base.pVtab;
+  pCur->bEof = 1;
+  sqlite3_free(pVtab->zErrMsg);
+  pVtab->zErrMsg = sqlite3_mprintf("invalid bitmap");
+  return SQLITE_ERROR;
+}
+
+/*
+  moves to the first element >= x, or to the next element if bNext is set.
+  1 with the element in iValue, 0 at the end and -1 if the blob is not valid
+*/
+static int roaringEachMove(RoaringEachCursor *pCur, uint32_t x, int bNext){
+  int rc;
+  if( pCur->bHeader ){
+    if( bNext ){
+      rc = roaringHeaderIteratorAdvance(&pCur->hit);
+    }else{
+      rc = roaringHeaderIteratorMove(&pCur->hit, x);
+    }
+    pCur->iValue = pCur->hit.current_value;
+    return rc;
+  }
+  if( bNext ){
+    rc = roaring_uint32_iterator_advance(&pCur->it);
+  }else{
+    rc = roaring_uint32_iterator_move_equalorlarger(&pCur->it, x);
+  }
+  pCur->iValue = pCur->it.current_value;
+  return rc;
+}
+
+/*
+  moves to the first element >= x that falls in one of the remaining ranges
+*/
+static int roaringEachSeek(RoaringEachCursor *pCur, uint64_t x){
+  RoaringEachRanges *r = &pCur->r;
+  int rc;
+  pCur->iRowid = 0;
+  while( r->iRange < r->nRange ){
+    if( x < r->aMin[r->iRange] ) x = r->aMin[r->iRange];
+    if( x <= r->aMax[r->iRange] ){
+      rc = roaringEachMove(pCur, (uint32_t)x, 0);
+      if( rc < 0 ) return roaringEachCorrupt(pCur);
+      if( rc > 0 && pCur->iValue <= r->aMax[r->iRange] ){
+        pCur->bEof = 0;
+        return SQLITE_OK;
+      }
+    }
+    r->iRange++;
+  }
+  pCur->bEof = 1;
+  return SQLITE_OK;
+}
+
+static sqlite3_int64 roaringEachRowid(RoaringEachCursor *pCur){
+  uint64_t rank;
+  if( pCur->iRowid==0 ){
+    if( pCur->bHeader ){
+      // the container of the element was read already, this can't fail
+      roaringHeaderRank(&pCur->h, pCur->iValue, &rank);
+      pCur->iRowid = (sqlite3_int64)rank;
+    }else{
+      pCur->iRowid = (sqlite3_int64) roaring_bitmap_rank(pCur->v.rb, pCur->iValue);
+    }
+  }
+  return pCur->iRowid;
+}
+
+static int roaringEachNext(sqlite3_vtab_cursor *cur){
+  RoaringEachCursor *pCur = (RoaringEachCursor*)cur;
+  int rc = roaringEachMove(pCur, 0, 1);
+  if( rc < 0 ) return roaringEachCorrupt(pCur);
+  if( rc==0 ){
+    pCur->bEof = 1;
+    return SQLITE_OK;
   }
-  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
-    sqlite3_result_error(context, "invalid argument", -1);
-    return;
+  if( pCur->iRowid ) pCur->iRowid++;
+  if( pCur->iValue > pCur->r.aMax[pCur->r.iRange] ){
+    pCur->r.iRange++;
+    return roaringEachSeek(pCur, pCur->iValue);
   }
-  roaring_bitmap_add(r, sqlite3_value_int(argv[1]));
-  int nSize = (int) roaring_bitmap_size_in_bytes(r);
-  char *pOut = sqlite3_malloc(nSize);
-  int nOut = (int) roaring_bitmap_serialize(r, pOut);
-  roaring_bitmap_free(r);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  return SQLITE_OK;
 }
 
-static void roaring64AddFunc(
+static int roaringEachColumn(
+  sqlite3_vtab_cursor *cur,
   sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
+  int i
 ){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
-  roaring64_bitmap_t *r = roaring64_bitmap_portable_deserialize_safe(pIn, nIn);
-  if( r == NULL ){
-    sqlite3_result_error(context, "invalid bitmap", -1);
-    return;
-  }
-  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
-    sqlite3_result_error(context, "invalid argument", -1);
-    return;
+  RoaringEachCursor *pCur = (RoaringEachCursor*)cur;
+  if( i==ROARING_EACH_VALUE ){
+    sqlite3_result_int64(context, pCur->iValue);
+  }else if( i==ROARING_EACH_RANK ){
+    sqlite3_result_int64(context, roaringEachRowid(pCur));
   }
-  roaring64_bitmap_add(r, sqlite3_value_int64(argv[1]));
-  int nSize = (int) roaring64_bitmap_portable_size_in_bytes(r);
-  char *pOut = sqlite3_malloc(nSize);
-  int nOut = (int) roaring64_bitmap_portable_serialize(r, pOut);
-  roaring64_bitmap_free(r);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  return SQLITE_OK;
 }
 
+static int roaringEachRowidFunc(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid){
+  // rowids are the 1 based positions of the elements, same as rank
+  *pRowid = roaringEachRowid((RoaringEachCursor*)cur);
+  return SQLITE_OK;
+}
 
-/*********************************************
-  rb_remove(bitmap, element)
-  --------------------------------------------
-  removes an element from a bitmap and returns the new bitmap
-*********************************************/
-static void roaringRemoveFunc(
-  sqlite3_context *context,
+static int roaringEachEof(sqlite3_vtab_cursor *cur){
+  RoaringEachCursor *pCur = (RoaringEachCursor*)cur;
+  if( pCur->bEof ) return 1;
+  return pCur->r.iRankMax!=INT64_MAX && roaringEachRowid(pCur) > pCur->r.iRankMax;
+}
+
+/*
+  sets up the scan of the bitmap argument. blobs are not copied: the
+  argument stays in its register until the next xFilter, so the header
+  and frozen views point straight into it
+*/
+static int roaringEachView(RoaringEachCursor *pCur, sqlite3_value *pVal){
+  const char *pIn;
+  int nIn;
+  if( roaringValuePointer(pVal)==NULL ){
+    pIn = (const char*)sqlite3_value_blob(pVal);
+    nIn = sqlite3_value_bytes(pVal);
+    if( nIn < 1 || pIn[0]!=ROARING_SERIALIZATION_FROZEN ){
+      if( !roaringHeaderInit(&pCur->h, pIn, nIn) ) return roaringEachCorrupt(pCur);
+      pCur->bHeader = 1;
+      roaringHeaderIteratorInit(&pCur->hit, &pCur->h);
+      return SQLITE_OK;
+    }
+  }
+  if( !roaringValueView(&pCur->v, pVal) ) return roaringEachCorrupt(pCur);
+  roaring_iterator_init(pCur->v.rb, &pCur->it);
+  return SQLITE_OK;
+}
+
+static int roaringEachFilter(
+  sqlite3_vtab_cursor *cur,
+  int idxNum,
+  const char *idxStr,
   int argc,
   sqlite3_value **argv
 ){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
-  roaring_bitmap_t *r = roaring_bitmap_deserialize_safe(pIn, nIn);
-  if( r == NULL ){
-    sqlite3_result_error(context, "invalid bitmap", -1);
-    return;
+  RoaringEachCursor *pCur = (RoaringEachCursor*)cur;
+  uint32_t x = 0;
+  int rc;
+  roaringEachReset(pCur);
+  if( idxNum==0 ) return SQLITE_OK;
+  if( sqlite3_value_type(argv[0])==SQLITE_NULL && roaringValuePointer(argv[0])==NULL ){
+    return SQLITE_OK;
   }
-  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
-    sqlite3_result_error(context, "invalid argument", -1);
-    return;
+  if( !roaringEachRangesInit(&pCur->r, idxNum, argv, UINT32_MAX) ){
+    return SQLITE_OK;
   }
-  roaring_bitmap_remove(r, sqlite3_value_int(argv[1]));
-  int nSize = (int) roaring_bitmap_size_in_bytes(r);
-  char *pOut = sqlite3_malloc(nSize);
-  int nOut = (int) roaring_bitmap_serialize(r, pOut);
-  roaring_bitmap_free(r);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  rc = roaringEachView(pCur, argv[0]);
+  if( rc!=SQLITE_OK ) return rc;
+  if( pCur->r.iRankMin > 1 ){
+    if( pCur->r.iRankMin - 1 > UINT32_MAX ) return SQLITE_OK;
+    if( pCur->bHeader ){
+      rc = roaringHeaderSelect(&pCur->h, (uint64_t)(pCur->r.iRankMin - 1), &x);
+      if( rc < 0 ) return roaringEachCorrupt(pCur);
+    }else{
+      rc = roaring_bitmap_select(pCur->v.rb, (uint32_t)(pCur->r.iRankMin - 1), &x);
+    }
+    if( rc==0 ) return SQLITE_OK;
+  }
+  return roaringEachSeek(pCur, x);
 }
 
-static void roaring64RemoveFunc(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
-  roaring64_bitmap_t *r = roaring64_bitmap_portable_deserialize_safe(pIn, nIn);
-  if( r == NULL ){
-    sqlite3_result_error(context, "invalid bitmap", -1);
-    return;
+static int roaring64EachOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor){
+  Roaring64EachCursor *pCur;
+  pCur = sqlite3_malloc(sizeof(*pCur));
+  if( pCur==0 ) return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur));
+  pCur->bEof = 1;
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+static void roaring64EachReset(Roaring64EachCursor *pCur){
+  if( pCur->it!=NULL ) roaring64_iterator_free(pCur->it);
+  if( pCur->rb!=NULL && !pCur->bShared ) roaring64_bitmap_free(pCur->rb);
+  pCur->it = NULL;
+  pCur->rb = NULL;
+  pCur->bShared = 0;
+  pCur->bEof = 1;
+  pCur->iRowid = 0;
+}
+
+static int roaring64EachClose(sqlite3_vtab_cursor *cur){
+  Roaring64EachCursor *pCur = (Roaring64EachCursor*)cur;
+  roaring64EachReset(pCur);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+static void roaring64EachSeek(Roaring64EachCursor *pCur, uint64_t x){
+  RoaringEachRanges *r = &pCur->r;
+  pCur->iRowid = 0;
+  while( r->iRange < r->nRange ){
+    if( x < r->aMin[r->iRange] ) x = r->aMin[r->iRange];
+    if( x <= r->aMax[r->iRange]
+     && roaring64_iterator_move_equalorlarger(pCur->it, x)
+     && roaring64_iterator_value(pCur->it) <= r->aMax[r->iRange]
+    ){
+      pCur->bEof = 0;
+      return;
+    }
+    r->iRange++;
   }
-  if( sqlite3_value_type(argv[1])!=SQLITE_INTEGER ){
-    sqlite3_result_error(context, "invalid argument", -1);
-    return;
+  pCur->bEof = 1;
+}
+
+static sqlite3_int64 roaring64EachRowid(Roaring64EachCursor *pCur){
+  if( pCur->iRowid==0 ){
+    pCur->iRowid = (sqlite3_int64) roaring64_bitmap_rank(pCur->rb, roaring64_iterator_value(pCur->it));
   }
-  roaring64_bitmap_remove(r, sqlite3_value_int64(argv[1]));
-  int nSize = (int) roaring64_bitmap_portable_size_in_bytes(r);
-  char *pOut = sqlite3_malloc(nSize);
-  int nOut = (int) roaring64_bitmap_portable_serialize(r, pOut);
-  roaring64_bitmap_free(r);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  return pCur->iRowid;
 }
 
-/*********************************************
-  rb_and_length(bitmap1, bitmap2)
-  --------------------------------------------
-  and the second bitmap with the first one (first one is modified) and returns the length of the result
-*********************************************/
-static void roaringAndLengthFunc(
+static int roaring64EachNext(sqlite3_vtab_cursor *cur){
+  Roaring64EachCursor *pCur = (Roaring64EachCursor*)cur;
+  if( !roaring64_iterator_advance(pCur->it) ){
+    pCur->bEof = 1;
+    return SQLITE_OK;
+  }
+  if( pCur->iRowid ) pCur->iRowid++;
+  if( roaring64_iterator_value(pCur->it) > pCur->r.aMax[pCur->r.iRange] ){
+    pCur->r.iRange++;
+    roaring64EachSeek(pCur, roaring64_iterator_value(pCur->it));
+  }
+  return SQLITE_OK;
+}
+
+static int roaring64EachColumn(
+  sqlite3_vtab_cursor *cur,
   sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
+  int i
 ){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring_bitmap_t *r1 = roaring_bitmap_deserialize_safe(pIn1, nIn1);
-  roaring_bitmap_t *r2 = roaring_bitmap_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
+  Roaring64EachCursor *pCur = (Roaring64EachCursor*)cur;
+  if( i==ROARING_EACH_VALUE ){
+    sqlite3_result_int64(context, (sqlite3_int64) roaring64_iterator_value(pCur->it));
+  }else if( i==ROARING_EACH_RANK ){
+    sqlite3_result_int64(context, roaring64EachRowid(pCur));
   }
-  int nOut = (int) roaring_bitmap_and_cardinality(r1, r2);
-  roaring_bitmap_free(r1);  
-  roaring_bitmap_free(r2);  
-  sqlite3_result_int(context, nOut);
+  return SQLITE_OK;
 }
 
-static void roaring64AndLengthFunc(
-  sqlite3_context *context,
+static int roaring64EachRowidFunc(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid){
+  *pRowid = roaring64EachRowid((Roaring64EachCursor*)cur);
+  return SQLITE_OK;
+}
+
+static int roaring64EachEof(sqlite3_vtab_cursor *cur){
+  Roaring64EachCursor *pCur = (Roaring64EachCursor*)cur;
+  if( pCur->bEof ) return 1;
+  return pCur->r.iRankMax!=INT64_MAX && roaring64EachRowid(pCur) > pCur->r.iRankMax;
+}
+
+static int roaring64EachFilter(
+  sqlite3_vtab_cursor *cur,
+  int idxNum,
+  const char *idxStr,
   int argc,
   sqlite3_value **argv
 ){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring64_bitmap_t *r1 = roaring64_bitmap_portable_deserialize_safe(pIn1, nIn1);
-  roaring64_bitmap_t *r2 = roaring64_bitmap_portable_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
+  Roaring64EachCursor *pCur = (Roaring64EachCursor*)cur;
+  uint64_t x = 0;
+  roaring64EachReset(pCur);
+  if( idxNum==0 ) return SQLITE_OK;
+  pCur->rb = roaring64ValuePointer(argv[0]);
+  if( pCur->rb!=NULL ){
+    pCur->bShared = 1;
+  }else if( sqlite3_value_type(argv[0])==SQLITE_NULL ){
+    return SQLITE_OK;
+  }else{
+    pCur->rb = roaring64ValueDeserialize(argv[0]);
   }
-  int nOut = (int) roaring64_bitmap_and_cardinality(r1, r2);
-  roaring64_bitmap_free(r1);  
-  roaring64_bitmap_free(r2);  
-  sqlite3_result_int64(context, nOut);
+  if( pCur->rb==NULL ){
+    sqlite3_free(cur->pVtab->zErrMsg);
+    cur->pVtab->zErrMsg = sqlite3_mprintf("invalid bitmap");
+    return SQLITE_ERROR;
+  }
+  if( !roaringEachRangesInit(&pCur->r, idxNum, argv, UINT64_MAX) ){
+    return SQLITE_OK;
+  }
+  if( pCur->r.iRankMin > 1
+   && !roaring64_bitmap_select(pCur->rb, (uint64_t)(pCur->r.iRankMin - 1), &x)
+  ){
+    return SQLITE_OK;
+  }
+  pCur->it = roaring64_iterator_create(pCur->rb);
+  if( pCur->it==NULL ) return SQLITE_NOMEM;
+  roaring64EachSeek(pCur, x);
+  return SQLITE_OK;
+}
+
+static sqlite3_module roaringEachModule = {
+  0,                         /* iVersion */
+  0,                         /* xCreate */
+  roaringEachConnect,        /* xConnect */
+  roaringEachBestIndex,      /* xBestIndex */
+  roaringEachDisconnect,     /* xDisconnect */
+  0,                         /* xDestroy */
+  roaringEachOpen,           /* xOpen - open a cursor */
+  roaringEachClose,          /* xClose - close a cursor */
+  roaringEachFilter,         /* xFilter - configure scan constraints */
+  roaringEachNext,           /* xNext - advance a cursor */
+  roaringEachEof,            /* xEof - check for end of scan */
+  roaringEachColumn,         /* xColumn - read data */
+  roaringEachRowidFunc,      /* xRowid - read data */
+};
+
+static sqlite3_module roaring64EachModule = {
+  0,                         /* iVersion */
+  0,                         /* xCreate */
+  roaringEachConnect,        /* xConnect */
+  roaringEachBestIndex,      /* xBestIndex */
+  roaringEachDisconnect,     /* xDisconnect */
+  0,                         /* xDestroy */
+  roaring64EachOpen,         /* xOpen - open a cursor */
+  roaring64EachClose,        /* xClose - close a cursor */
+  roaring64EachFilter,       /* xFilter - configure scan constraints */
+  roaring64EachNext,         /* xNext - advance a cursor */
+  roaring64EachEof,          /* xEof - check for end of scan */
+  roaring64EachColumn,       /* xColumn - read data */
+  roaring64EachRowidFunc,    /* xRowid - read data */
+};
+
+/*
+  helpers for the virtual tables that keep their data in shadow tables
+*/
+static int roaringVtabError(sqlite3_vtab *pVtab, int rc, const char *zFmt, ...){
+  va_list ap;
+  va_start(ap, zFmt);
+  sqlite3_free(pVtab->zErrMsg);
+  pVtab->zErrMsg = sqlite3_vmprintf(zFmt, ap);
+  va_end(ap);
+  return rc;
+}
+
+static int roaringVtabExec(sqlite3_vtab *pVtab, sqlite3 *db, const char *zFmt, ...){
+  va_list ap;
+  char *zSql;
+  int rc;
+  va_start(ap, zFmt);
+  zSql = sqlite3_vmprintf(zFmt, ap);
+  va_end(ap);
+  if( zSql == NULL ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(db, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  if( rc != SQLITE_OK ) roaringVtabError(pVtab, rc, "%s", sqlite3_errmsg(db));
+  return rc;
 }
 
+/*
+  statements on a shadow table are prepared on first use, zFmt gets the
+  schema and the virtual table name
+*/
+static int roaringVtabPrepare(
+  sqlite3_vtab *pVtab,
+  sqlite3 *db,
+  sqlite3_stmt **ppStmt,
+  const char *zFmt,
+  const char *zDb,
+  const char *zName
+){
+  char *zSql;
+  int rc;
+  if( *ppStmt != NULL ) return SQLITE_OK;
+  zSql = sqlite3_mprintf(zFmt, zDb, zName);
+  if( zSql == NULL ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v3(db, zSql, -1, SQLITE_PREPARE_PERSISTENT, ppStmt, 0);
+  sqlite3_free(zSql);
+  if( rc != SQLITE_OK ) roaringVtabError(pVtab, rc, "%s", sqlite3_errmsg(db));
+  return rc;
+}
 
 /*********************************************
-  rb_and_many(bitmap1, bitmap2, bitmap3, ...)
+  roaring_index(table, column)
   --------------------------------------------
-  Bitwise AND all bitmaps and return the result
+  virtual table with one bitmap of rowids per distinct value of a column.
+  the bitmaps are stored run optimized in the shadow table <name>_data,
+  triggers on the table send every change to the virtual table where it is
+  applied to a bitmap in memory. dirty bitmaps are written back when a
+  statement savepoint opens and on commit, instead of once per row. NULL
+  values are not indexed and rowids have to fit in 32 bits
+
+  INSERT INTO <name>(op) VALUES ('rebuild') rebuilds the index from the
+  table
+
+  example: CREATE VIRTUAL TABLE books_genre USING roaring_index(books, genre)
+           SELECT bitmap FROM books_genre WHERE value = 'poetry'
 *********************************************/
+#define ROARING_INDEX_VALUE  0
+#define ROARING_INDEX_BITMAP 1
+#define ROARING_INDEX_OP     2
+#define ROARING_INDEX_ID     3
 
-static void roaringAndManyFunc(  
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  roaring_bitmap_t *rfinal;
-  roaring_bitmap_t *r;
-  for(int i=0; i < argc; i++){
-    if(sqlite3_value_type(argv[i])!=SQLITE_BLOB){
-      continue;
-    }
-    r = roaring_bitmap_deserialize_safe(sqlite3_value_blob(argv[i]), sqlite3_value_bytes(argv[i]));     
-    if( r == NULL){
-      sqlite3_result_error(context, "invalid bitmap(s)", -1);
-      return;
+#define ROARING_INDEX_SLOTS 64
+
+// roaringIndexGet flags
+#define ROARING_INDEX_READ   1     // look the value up in the shadow table
+#define ROARING_INDEX_CREATE 2     // create an empty bitmap if there is none
+
+typedef struct RoaringIndexEntry RoaringIndexEntry;
+struct RoaringIndexEntry {
+  sqlite3_value *pValue;           // copy of the indexed value
+  roaring_bitmap_t *rb;            // rowids with that value
+  int bDirty;                      // rb differs from the shadow table
+  int bSeen;                       // used by roaringIndexFilter
+  unsigned int iHash;
+  RoaringIndexEntry *pNext;        // hash chain
+};
+
+typedef struct RoaringIndexVtab RoaringIndexVtab;
+struct RoaringIndexVtab {
+  sqlite3_vtab base;
+  sqlite3 *db;
+  char *zDb;                       // schema of the virtual table
+  char *zName;                     // name of the virtual table
+  char *zTable;                    // indexed table
+  char *zColumn;                   // indexed column
+  int nEntry;
+  int nSlot;                       // size of aSlot, a power of two
+  RoaringIndexEntry **aSlot;       // bitmaps in memory by value
+  int nDirty;                      // entries not written back yet
+  sqlite3_int64 iDataVersion;      // PRAGMA data_version the entries match
+  sqlite3_stmt *pVersion;          // PRAGMA data_version
+  sqlite3_stmt *pRead;             // SELECT bitmap FROM data WHERE value = ?
+  sqlite3_stmt *pWrite;            // INSERT OR REPLACE INTO data VALUES (?, ?)
+  sqlite3_stmt *pDelete;           // DELETE FROM data WHERE value = ?
+  sqlite3_stmt *pScan;             // SELECT value FROM data
+  sqlite3_value *pReplaced;        // value of the row an insert may replace
+  sqlite3_int64 iReplaced;         // and its rowid
+};
+
+typedef struct RoaringIndexCursor RoaringIndexCursor;
+struct RoaringIndexCursor {
+  sqlite3_vtab_cursor base;
+  int nValue;
+  int nAlloc;
+  int iValue;
+  sqlite3_value **apValue;         // values visited by the scan
+};
+
+/*
+  numbers that compare equal in SQL (1 and 1.0) hash the same
+*/
+static unsigned int roaringIndexHash(sqlite3_value *pVal){
+  unsigned int h = 2166136261u;
+  const unsigned char *z = NULL;
+  int n = 0;
+  sqlite3_int64 i;
+  double r;
+  switch( sqlite3_value_type(pVal) ){
+    case SQLITE_FLOAT:
+      r = sqlite3_value_double(pVal);
+      if( !(r >= -9223372036854775808.0 && r < 9223372036854775808.0) || r != (double)(sqlite3_int64)r ){
+        z = (const unsigned char*)&r;
+        n = sizeof(r);
+        break;
+      }
+      i = (sqlite3_int64)r;
+      z = (const unsigned char*)&i;
+      n = sizeof(i);
+      break;
+    case SQLITE_INTEGER:
+      i = sqlite3_value_int64(pVal);
+      z = (const unsigned char*)&i;
+      n = sizeof(i);
+      break;
+    case SQLITE_TEXT:
+      z = sqlite3_value_text(pVal);
+      n = sqlite3_value_bytes(pVal);
+      h ^= 't';
+      break;
+    default:
+      z = sqlite3_value_blob(pVal);
+      n = sqlite3_value_bytes(pVal);
+      h ^= 'b';
+      break;
+  }
+  for(int k = 0; k < n; k++){
+    h = (h ^ z[k]) * 16777619u;
+  }
+  return h;
+}
+
+static int roaringIndexEqual(sqlite3_value *a, sqlite3_value *b){
+  int ta = sqlite3_value_type(a);
+  int tb = sqlite3_value_type(b);
+  int n;
+  if( (ta == SQLITE_INTEGER || ta == SQLITE_FLOAT) && (tb == SQLITE_INTEGER || tb == SQLITE_FLOAT) ){
+    if( ta == SQLITE_INTEGER && tb == SQLITE_INTEGER ){
+      return sqlite3_value_int64(a) == sqlite3_value_int64(b);
     }
-    if(rfinal == NULL){
-      rfinal = roaring_bitmap_copy(r);
-    } else {
-      roaring_bitmap_and_inplace(rfinal, r);
-      roaring_bitmap_free(r);
+    return sqlite3_value_double(a) == sqlite3_value_double(b);
+  }
+  if( ta != tb ) return 0;
+  if( ta == SQLITE_TEXT ){
+    n = sqlite3_value_bytes(a);
+    return n == sqlite3_value_bytes(b) && memcmp(sqlite3_value_text(a), sqlite3_value_text(b), n) == 0;
+  }
+  n = sqlite3_value_bytes(a);
+  return n == sqlite3_value_bytes(b) && (n == 0 || memcmp(sqlite3_value_blob(a), sqlite3_value_blob(b), n) == 0);
+}
+
+static int roaringIndexPrepare(RoaringIndexVtab *p, sqlite3_stmt **ppStmt, const char *zFmt){
+  return roaringVtabPrepare(&p->base, p->db, ppStmt, zFmt, p->zDb, p->zName);
+}
+
+static void roaringIndexClear(RoaringIndexVtab *p){
+  for(int i = 0; i < p->nSlot; i++){
+    RoaringIndexEntry *pEntry, *pNext;
+    for(pEntry = p->aSlot[i]; pEntry; pEntry = pNext){
+      pNext = pEntry->pNext;
+      sqlite3_value_free(pEntry->pValue);
+      roaring_bitmap_free(pEntry->rb);
+      sqlite3_free(pEntry);
     }
+    p->aSlot[i] = NULL;
   }
-  if(rfinal == NULL){
-    rfinal = roaring_bitmap_create();
+  p->nEntry = 0;
+  p->nDirty = 0;
+  sqlite3_value_free(p->pReplaced);
+  p->pReplaced = NULL;
+}
+
+static RoaringIndexEntry *roaringIndexFind(RoaringIndexVtab *p, sqlite3_value *pVal, unsigned int iHash){
+  RoaringIndexEntry *pEntry = p->aSlot[iHash & (p->nSlot - 1)];
+  for(; pEntry; pEntry = pEntry->pNext){
+    if( pEntry->iHash == iHash && roaringIndexEqual(pEntry->pValue, pVal) ) return pEntry;
   }
-  int nSize = (int )roaring_bitmap_size_in_bytes(rfinal);
-  char *pOut = sqlite3_malloc(nSize);
-  int nOut = (int) roaring_bitmap_serialize(rfinal, pOut);
-  roaring_bitmap_free(rfinal);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free); 
+  return NULL;
 }
 
-static void roaring64AndManyFunc(  
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  roaring64_bitmap_t *rfinal;
-  roaring64_bitmap_t *r;
-  for(int i=0; i < argc; i++){
-    if(sqlite3_value_type(argv[i])!=SQLITE_BLOB){
-      continue;
+static int roaringIndexInsert(RoaringIndexVtab *p, RoaringIndexEntry *pEntry){
+  RoaringIndexEntry **pp;
+  if( p->nEntry >= p->nSlot ){
+    int nSlot = p->nSlot * 2;
+    RoaringIndexEntry **aSlot = sqlite3_malloc64(sizeof(*aSlot) * nSlot);
+    if( aSlot == NULL ) return SQLITE_NOMEM;
+    memset(aSlot, 0, sizeof(*aSlot) * nSlot);
+    for(int i = 0; i < p->nSlot; i++){
+      RoaringIndexEntry *q, *pNext;
+      for(q = p->aSlot[i]; q; q = pNext){
+        pNext = q->pNext;
+        pp = &aSlot[q->iHash & (nSlot - 1)];
+        q->pNext = *pp;
+        *pp = q;
+      }
     }
-    r = roaring64_bitmap_portable_deserialize_safe(sqlite3_value_blob(argv[i]), sqlite3_value_bytes(argv[i]));     
-    if( r == NULL){
-      sqlite3_result_error(context, "invalid bitmap(s)", -1);
-      return;
+    sqlite3_free(p->aSlot);
+    p->aSlot = aSlot;
+    p->nSlot = nSlot;
+  }
+  pp = &p->aSlot[pEntry->iHash & (p->nSlot - 1)];
+  pEntry->pNext = *pp;
+  *pp = pEntry;
+  p->nEntry++;
+  return SQLITE_OK;
+}
+
+/*
+  in memory bitmap of a value, *ppEntry is left NULL when the value has no
+  bitmap and ROARING_INDEX_CREATE isn't set
+*/
+static int roaringIndexGet(
+  RoaringIndexVtab *p,
+  sqlite3_value *pVal,
+  int flags,
+  RoaringIndexEntry **ppEntry
+){
+  unsigned int iHash = roaringIndexHash(pVal);
+  RoaringIndexEntry *pEntry = roaringIndexFind(p, pVal, iHash);
+  roaring_bitmap_t *rb = NULL;
+  int rc = SQLITE_OK;
+  *ppEntry = pEntry;
+  if( pEntry != NULL ) return SQLITE_OK;
+  if( flags & ROARING_INDEX_READ ){
+    rc = roaringIndexPrepare(p, &p->pRead, "SELECT bitmap FROM \"%w\".\"%w_data\" WHERE value = ?");
+    if( rc != SQLITE_OK ) return rc;
+    sqlite3_bind_value(p->pRead, 1, pVal);
+    if( sqlite3_step(p->pRead) == SQLITE_ROW ){
+      rb = roaringDeserialize(sqlite3_column_blob(p->pRead, 0), sqlite3_column_bytes(p->pRead, 0));
+      if( rb == NULL ) rc = SQLITE_CORRUPT_VTAB;
     }
-    if(rfinal == NULL){
-      rfinal = roaring64_bitmap_copy(r);
-    } else {
-      roaring64_bitmap_and_inplace(rfinal, r);
-      roaring64_bitmap_free(r);
+    rc = sqlite3_reset(p->pRead) == SQLITE_OK ? rc : sqlite3_reset(p->pRead);
+    sqlite3_bind_null(p->pRead, 1);
+    if( rc != SQLITE_OK ){
+      roaring_bitmap_free(rb);
+      return rc;
     }
   }
-  if(rfinal == NULL){
-    rfinal = roaring64_bitmap_create();
+  if( rb == NULL && !(flags & ROARING_INDEX_CREATE) ) return SQLITE_OK;
+  if( rb == NULL && (rb = roaring_bitmap_create()) == NULL ) return SQLITE_NOMEM;
+  pEntry = sqlite3_malloc(sizeof(*pEntry));
+  if( pEntry == NULL ){
+    roaring_bitmap_free(rb);
+    return SQLITE_NOMEM;
   }
-  int nSize = (int) roaring64_bitmap_portable_size_in_bytes(rfinal);
-  char *pOut = sqlite3_malloc(nSize);
-  int nOut = (int) roaring64_bitmap_portable_serialize(rfinal, pOut);
-  roaring64_bitmap_free(rfinal);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free); 
+  memset(pEntry, 0, sizeof(*pEntry));
+  pEntry->pValue = sqlite3_value_dup(pVal);
+  pEntry->rb = rb;
+  pEntry->iHash = iHash;
+  if( pEntry->pValue == NULL || roaringIndexInsert(p, pEntry) != SQLITE_OK ){
+    sqlite3_value_free(pEntry->pValue);
+    roaring_bitmap_free(rb);
+    sqlite3_free(pEntry);
+    return SQLITE_NOMEM;
+  }
+  *ppEntry = pEntry;
+  return SQLITE_OK;
 }
 
+/*
+  writes the dirty bitmaps back to the shadow table, empty ones are deleted
+*/
+static int roaringIndexFlush(RoaringIndexVtab *p){
+  int rc = SQLITE_OK;
+  if( p->nDirty == 0 ) return SQLITE_OK;
+  rc = roaringIndexPrepare(p, &p->pWrite, "INSERT OR REPLACE INTO \"%w\".\"%w_data\"(value, bitmap) VALUES (?, ?)");
+  if( rc == SQLITE_OK ) rc = roaringIndexPrepare(p, &p->pDelete, "DELETE FROM \"%w\".\"%w_data\" WHERE value = ?");
+  for(int i = 0; i < p->nSlot && rc == SQLITE_OK; i++){
+    RoaringIndexEntry *pEntry;
+    for(pEntry = p->aSlot[i]; pEntry && rc == SQLITE_OK; pEntry = pEntry->pNext){
+      sqlite3_stmt *pStmt;
+      if( !pEntry->bDirty ) continue;
+      if( roaring_bitmap_is_empty(pEntry->rb) ){
+        pStmt = p->pDelete;
+        sqlite3_bind_value(pStmt, 1, pEntry->pValue);
+      }else{
+        size_t nOut;
+        char *pOut;
+        roaring_bitmap_run_optimize(pEntry->rb);
+        nOut = roaring_bitmap_size_in_bytes(pEntry->rb);
+        pOut = sqlite3_malloc64(nOut);
+        if( pOut == NULL ){
+          rc = SQLITE_NOMEM;
+          break;
+        }
+        nOut = roaring_bitmap_serialize(pEntry->rb, pOut);
+        pStmt = p->pWrite;
+        sqlite3_bind_value(pStmt, 1, pEntry->pValue);
+        sqlite3_bind_blob64(pStmt, 2, pOut, nOut, sqlite3_free);
+      }
+      sqlite3_step(pStmt);
+      rc = sqlite3_reset(pStmt);
+      sqlite3_clear_bindings(pStmt);
+      if( rc == SQLITE_OK ){
+        pEntry->bDirty = 0;
+        p->nDirty--;
+      }
+    }
+  }
+  if( rc != SQLITE_OK && p->base.zErrMsg == NULL ){
+    roaringVtabError(&p->base, rc, "%s", sqlite3_errmsg(p->db));
+  }
+  return rc;
+}
 
-/*********************************************
-  rb_or_many(bitmap1, bitmap2, bitmap3, ...)
-  --------------------------------------------
-  Bitwise OR all bitmaps and return the result
-*********************************************/
+/*
+  drops the bitmaps in memory when another connection changed the database
+*/
+static int roaringIndexValidate(RoaringIndexVtab *p){
+  sqlite3_int64 iVersion = 0;
+  int rc = roaringIndexPrepare(p, &p->pVersion, "PRAGMA \"%w\".data_version");
+  if( rc != SQLITE_OK ) return rc;
+  if( sqlite3_step(p->pVersion) == SQLITE_ROW ){
+    iVersion = sqlite3_column_int64(p->pVersion, 0);
+  }
+  rc = sqlite3_reset(p->pVersion);
+  if( rc == SQLITE_OK && iVersion != p->iDataVersion ){
+    if( p->nDirty == 0 ) roaringIndexClear(p);
+    p->iDataVersion = iVersion;
+  }
+  return rc;
+}
 
-static void roaringOrManyFunc(  
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  roaring_bitmap_t *rfinal;
-  roaring_bitmap_t *r;
-  rfinal = roaring_bitmap_create();
-  for(int i=0; i < argc; i++){
-    if(sqlite3_value_type(argv[i])!=SQLITE_BLOB){
-      continue;
+/*
+  reads the whole indexed column into fresh bitmaps and writes them back
+*/
+static int roaringIndexRebuild(RoaringIndexVtab *p){
+  sqlite3_stmt *pStmt = NULL;
+  char *zSql;
+  int rc;
+  roaringIndexClear(p);
+  rc = roaringVtabExec(&p->base, p->db, "DELETE FROM \"%w\".\"%w_data\"", p->zDb, p->zName);
+  if( rc != SQLITE_OK ) return rc;
+  zSql = sqlite3_mprintf("SELECT rowid, \"%w\" FROM \"%w\".\"%w\" WHERE \"%w\" IS NOT NULL",
+    p->zColumn, p->zDb, p->zTable, p->zColumn);
+  if( zSql == NULL ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &pStmt, 0);
+  sqlite3_free(zSql);
+  while( rc == SQLITE_OK && sqlite3_step(pStmt) == SQLITE_ROW ){
+    RoaringIndexEntry *pEntry;
+    sqlite3_int64 iRowid = sqlite3_column_int64(pStmt, 0);
+    if( iRowid < 0 || iRowid > UINT32_MAX ){
+      rc = roaringVtabError(&p->base, SQLITE_ERROR, "rowid %lld of %s doesn't fit in a bitmap", iRowid, p->zTable);
+      break;
     }
-    r = roaring_bitmap_deserialize_safe(sqlite3_value_blob(argv[i]), sqlite3_value_bytes(argv[i]));     
-    if( r == NULL){
-      sqlite3_result_error(context, "invalid bitmap(s)", -1);
-      return;
+    rc = roaringIndexGet(p, sqlite3_column_value(pStmt, 1), ROARING_INDEX_CREATE, &pEntry);
+    if( rc != SQLITE_OK ) break;
+    roaring_bitmap_add(pEntry->rb, (uint32_t)iRowid);
+    if( !pEntry->bDirty ){
+      pEntry->bDirty = 1;
+      p->nDirty++;
     }
-    roaring_bitmap_or_inplace(rfinal, r);
-    roaring_bitmap_free(r);
   }
-  int nSize = (int )roaring_bitmap_size_in_bytes(rfinal);
-  char *pOut = sqlite3_malloc(nSize);
-  int nOut = (int) roaring_bitmap_serialize(rfinal, pOut);
-  roaring_bitmap_free(rfinal);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free); 
+  if( pStmt != NULL ){
+    int rc2 = sqlite3_finalize(pStmt);
+    if( rc == SQLITE_OK ) rc = rc2;
+  }
+  if( rc != SQLITE_OK ){
+    if( p->base.zErrMsg == NULL ) roaringVtabError(&p->base, rc, "%s", sqlite3_errmsg(p->db));
+    roaringIndexClear(p);
+    return rc;
+  }
+  return roaringIndexFlush(p);
 }
 
-static void roaring64OrManyFunc(  
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  roaring64_bitmap_t *rfinal;
-  roaring64_bitmap_t *r;
-  rfinal = roaring64_bitmap_create();
-  for(int i=0; i < argc; i++){
-    if(sqlite3_value_type(argv[i])!=SQLITE_BLOB){
-      continue;
-    }
-    r = roaring64_bitmap_portable_deserialize_safe(sqlite3_value_blob(argv[i]), sqlite3_value_bytes(argv[i]));     
-    if( r == NULL){
-      sqlite3_result_error(context, "invalid bitmap(s)", -1);
-      return;
+/*
+  strips the quotes of an identifier passed as a module argument
+*/
+static char *roaringIndexDequote(const char *z){
+  size_t n = strlen(z);
+  char *zOut = sqlite3_malloc64(n + 1);
+  char q = z[0];
+  size_t j = 0;
+  if( zOut == NULL ) return NULL;
+  if( q == '[' ) q = ']';
+  if( q != '"' && q != '\'' && q != '`' && q != ']' ){
+    memcpy(zOut, z, n + 1);
+    return zOut;
+  }
+  for(size_t i = 1; i < n; i++){
+    if( z[i] == q ){
+      if( z[i + 1] != q ) break;
+      i++;
     }
-    roaring64_bitmap_or_inplace(rfinal, r);
-    roaring64_bitmap_free(r);
+    zOut[j++] = z[i];
+  }
+  zOut[j] = 0;
+  return zOut;
+}
+
+/*
+  the triggers on the indexed table are named after the virtual table.
+  INSERT OR REPLACE doesn't fire the delete trigger unless recursive_triggers
+  is on, so the row an insert is about to replace is sent as 'replace' and
+  only removed when the 'add' for its rowid follows (an ignored insert or an
+  upsert never sends one). the insert trigger also fires for a NULL value,
+  which isn't indexed but may still replace a row
+*/
+static int roaringIndexCreateTriggers(RoaringIndexVtab *p){
+  int rc = roaringVtabExec(&p->base, p->db,
+    "CREATE TRIGGER \"%w\".\"%w_insert\" AFTER INSERT ON \"%w\" BEGIN"
+    " INSERT INTO \"%w\"(op, value, id) VALUES ('add', new.\"%w\", new.rowid); END",
+    p->zDb, p->zName, p->zTable, p->zName, p->zColumn);
+  if( rc == SQLITE_OK ){
+    rc = roaringVtabExec(&p->base, p->db,
+      "CREATE TRIGGER \"%w\".\"%w_replace\" BEFORE INSERT ON \"%w\" BEGIN"
+      " INSERT INTO \"%w\"(op, value, id) SELECT 'replace', \"%w\", rowid FROM \"%w\""
+      " WHERE rowid = new.rowid AND \"%w\" IS NOT NULL; END",
+      p->zDb, p->zName, p->zTable, p->zName, p->zColumn, p->zTable, p->zColumn);
+  }
+  if( rc == SQLITE_OK ){
+    rc = roaringVtabExec(&p->base, p->db,
+      "CREATE TRIGGER \"%w\".\"%w_delete\" AFTER DELETE ON \"%w\" WHEN old.\"%w\" IS NOT NULL BEGIN"
+      " INSERT INTO \"%w\"(op, value, id) VALUES ('remove', old.\"%w\", old.rowid); END",
+      p->zDb, p->zName, p->zTable, p->zColumn, p->zName, p->zColumn);
   }
-  int nSize = (int )roaring64_bitmap_portable_size_in_bytes(rfinal);
-  char *pOut = sqlite3_malloc(nSize);
-  int nOut = (int) roaring64_bitmap_portable_serialize(rfinal, pOut);
-  roaring64_bitmap_free(rfinal);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free); 
+  if( rc == SQLITE_OK ){
+    rc = roaringVtabExec(&p->base, p->db,
+      "CREATE TRIGGER \"%w\".\"%w_update\" AFTER UPDATE ON \"%w\""
+      " WHEN old.\"%w\" IS NOT new.\"%w\" OR old.rowid IS NOT new.rowid BEGIN"
+      " INSERT INTO \"%w\"(op, value, id) SELECT 'remove', old.\"%w\", old.rowid WHERE old.\"%w\" IS NOT NULL;"
+      " INSERT INTO \"%w\"(op, value, id) SELECT 'add', new.\"%w\", new.rowid WHERE new.\"%w\" IS NOT NULL; END",
+      p->zDb, p->zName, p->zTable, p->zColumn, p->zColumn,
+      p->zName, p->zColumn, p->zColumn, p->zName, p->zColumn, p->zColumn);
+  }
+  return rc;
 }
 
+static int roaringIndexDropTriggers(RoaringIndexVtab *p){
+  return roaringVtabExec(&p->base, p->db,
+    "DROP TRIGGER IF EXISTS \"%w\".\"%w_insert\";"
+    "DROP TRIGGER IF EXISTS \"%w\".\"%w_replace\";"
+    "DROP TRIGGER IF EXISTS \"%w\".\"%w_delete\";"
+    "DROP TRIGGER IF EXISTS \"%w\".\"%w_update\";",
+    p->zDb, p->zName, p->zDb, p->zName, p->zDb, p->zName, p->zDb, p->zName);
+}
 
-/*********************************************
-  rb_and(bitmap1, bitmap2)
-  --------------------------------------------
-  and the second bitmap with the first one (first one is modified) and returns the first bitmap
-*********************************************/
-static void roaringAndFunc(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring_bitmap_t *r1 = roaring_bitmap_deserialize_safe(pIn1, nIn1);
-  roaring_bitmap_t *r2 = roaring_bitmap_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
-  }
-  roaring_bitmap_and_inplace(r1, r2);
-  int nOut, nSize;
-  nSize = (int) roaring_bitmap_size_in_bytes(r1);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int) roaring_bitmap_serialize(r1, pOut);
-  roaring_bitmap_free(r1);  
-  roaring_bitmap_free(r2);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+static int roaringIndexDisconnect(sqlite3_vtab *pVtab){
+  RoaringIndexVtab *p = (RoaringIndexVtab*)pVtab;
+  roaringIndexClear(p);
+  sqlite3_finalize(p->pVersion);
+  sqlite3_finalize(p->pRead);
+  sqlite3_finalize(p->pWrite);
+  sqlite3_finalize(p->pDelete);
+  sqlite3_finalize(p->pScan);
+  sqlite3_free(p->aSlot);
+  sqlite3_free(p->zDb);
+  sqlite3_free(p->zName);
+  sqlite3_free(p->zTable);
+  sqlite3_free(p->zColumn);
+  sqlite3_free(p);
+  return SQLITE_OK;
 }
 
-static void roaring64AndFunc(
-  sqlite3_context *context,
+static int roaringIndexConnect(
+  sqlite3 *db,
+  void *pAux,
   int argc,
-  sqlite3_value **argv
+  const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
 ){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring64_bitmap_t *r1 = roaring64_bitmap_portable_deserialize_safe(pIn1, nIn1);
-  roaring64_bitmap_t *r2 = roaring64_bitmap_portable_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
+  RoaringIndexVtab *p;
+  int rc;
+  if( argc != 5 ){
+    *pzErr = sqlite3_mprintf("roaring_index needs a table and a column");
+    return SQLITE_ERROR;
   }
-  roaring64_bitmap_and_inplace(r1, r2);
-  int nOut, nSize;
-  nSize = (int) roaring64_bitmap_portable_size_in_bytes(r1);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int) roaring64_bitmap_portable_serialize(r1, pOut);
-  roaring64_bitmap_free(r1);  
-  roaring64_bitmap_free(r2);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  rc = sqlite3_declare_vtab(db, "CREATE TABLE x(value, bitmap, op HIDDEN, id HIDDEN)");
+  if( rc != SQLITE_OK ) return rc;
+  // written to by the triggers on the table, which trusted_schema=OFF only
+  // allows for innocuous virtual tables. it changes nothing but its own data
+  sqlite3_vtab_config(db, SQLITE_VTAB_INNOCUOUS);
+  p = sqlite3_malloc(sizeof(*p));
+  if( p == NULL ) return SQLITE_NOMEM;
+  memset(p, 0, sizeof(*p));
+  p->db = db;
+  p->iDataVersion = -1;
+  p->nSlot = ROARING_INDEX_SLOTS;
+  p->aSlot = sqlite3_malloc64(sizeof(*p->aSlot) * p->nSlot);
+  p->zDb = sqlite3_mprintf("%s", argv[1]);
+  p->zName = sqlite3_mprintf("%s", argv[2]);
+  p->zTable = roaringIndexDequote(argv[3]);
+  p->zColumn = roaringIndexDequote(argv[4]);
+  if( p->aSlot == NULL || p->zDb == NULL || p->zName == NULL || p->zTable == NULL || p->zColumn == NULL ){
+    roaringIndexDisconnect(&p->base);
+    return SQLITE_NOMEM;
+  }
+  memset(p->aSlot, 0, sizeof(*p->aSlot) * p->nSlot);
+  *ppVtab = &p->base;
+  return SQLITE_OK;
 }
 
-/*********************************************
-  rb_not(bitmap1, bitmap2)
-  --------------------------------------------
-  and the second bitmap with the first one (first one is modified) and returns the first bitmap
-*********************************************/
-static void roaringNotFunc(
-  sqlite3_context *context,
+/*
+  creates the shadow table, the triggers that keep the index up to date
+  and builds it from the rows already in the table
+*/
+static int roaringIndexCreate(
+  sqlite3 *db,
+  void *pAux,
   int argc,
-  sqlite3_value **argv
+  const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
 ){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring_bitmap_t *r1 = roaring_bitmap_deserialize_safe(pIn1, nIn1);
-  roaring_bitmap_t *r2 = roaring_bitmap_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
+  RoaringIndexVtab *p;
+  int rc = roaringIndexConnect(db, pAux, argc, argv, ppVtab, pzErr);
+  if( rc != SQLITE_OK ) return rc;
+  p = (RoaringIndexVtab*)*ppVtab;
+  rc = roaringVtabExec(&p->base, p->db, "CREATE TABLE \"%w\".\"%w_data\"(value PRIMARY KEY, bitmap BLOB)", p->zDb, p->zName);
+  if( rc == SQLITE_OK ) rc = roaringIndexCreateTriggers(p);
+  if( rc == SQLITE_OK ) rc = roaringIndexRebuild(p);
+  if( rc != SQLITE_OK ){
+    *pzErr = sqlite3_mprintf("%s", p->base.zErrMsg ? p->base.zErrMsg : sqlite3_errstr(rc));
+    roaringIndexDisconnect(&p->base);
+    *ppVtab = NULL;
   }
-  roaring_bitmap_andnot_inplace(r1, r2);
-  int nOut, nSize;
-  nSize = (int) roaring_bitmap_size_in_bytes(r1);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int) roaring_bitmap_serialize(r1, pOut);
-  roaring_bitmap_free(r1);  
-  roaring_bitmap_free(r2);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  return rc;
 }
 
-static void roaring64NotFunc(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring64_bitmap_t *r1 = roaring64_bitmap_portable_deserialize_safe(pIn1, nIn1);
-  roaring64_bitmap_t *r2 = roaring64_bitmap_portable_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
-  }
-  roaring64_bitmap_andnot_inplace(r1, r2);
-  int64_t nOut, nSize;
-  nSize = (int64_t) roaring64_bitmap_portable_size_in_bytes(r1);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int64_t) roaring64_bitmap_portable_serialize(r1, pOut);
-  roaring64_bitmap_free(r1);  
-  roaring64_bitmap_free(r2);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+static int roaringIndexDestroy(sqlite3_vtab *pVtab){
+  RoaringIndexVtab *p = (RoaringIndexVtab*)pVtab;
+  int rc = roaringIndexDropTriggers(p);
+  if( rc == SQLITE_OK ) rc = roaringVtabExec(&p->base, p->db, "DROP TABLE IF EXISTS \"%w\".\"%w_data\"", p->zDb, p->zName);
+  if( rc != SQLITE_OK ) return rc;
+  return roaringIndexDisconnect(pVtab);
 }
 
-/*********************************************
-  rb_not_length(bitmap1, bitmap2)
-  --------------------------------------------
-  and the second bitmap with the first one (first one is modified) and returns the first bitmap
-*********************************************/
-static void roaringNotLengthFunc(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring_bitmap_t *r1 = roaring_bitmap_deserialize_safe(pIn1, nIn1);
-  roaring_bitmap_t *r2 = roaring_bitmap_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
+static int roaringIndexRename(sqlite3_vtab *pVtab, const char *zNew){
+  RoaringIndexVtab *p = (RoaringIndexVtab*)pVtab;
+  char *zName;
+  int rc = roaringIndexFlush(p);
+  if( rc != SQLITE_OK ) return rc;
+  if( (zName = sqlite3_mprintf("%s", zNew)) == NULL ) return SQLITE_NOMEM;
+  rc = roaringIndexDropTriggers(p);
+  if( rc == SQLITE_OK ){
+    rc = roaringVtabExec(&p->base, p->db, "ALTER TABLE \"%w\".\"%w_data\" RENAME TO \"%w_data\"", p->zDb, p->zName, zNew);
   }
-  int nOut = (int) roaring_bitmap_andnot_cardinality(r1, r2);
-  roaring_bitmap_free(r1);  
-  roaring_bitmap_free(r2);  
-  sqlite3_result_int(context, nOut);
-  //roaring_bitmap_and_inplace(r1, r2);
+  if( rc != SQLITE_OK ){
+    sqlite3_free(zName);
+    return rc;
+  }
+  sqlite3_free(p->zName);
+  p->zName = zName;
+  rc = roaringIndexCreateTriggers(p);
+  if( rc != SQLITE_OK ) return rc;
+  // the statements name the old shadow table
+  sqlite3_finalize(p->pRead);
+  sqlite3_finalize(p->pWrite);
+  sqlite3_finalize(p->pDelete);
+  sqlite3_finalize(p->pScan);
+  p->pRead = p->pWrite = p->pDelete = p->pScan = NULL;
+  return SQLITE_OK;
 }
 
-static void roaring64NotLengthFunc(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring64_bitmap_t *r1 = roaring64_bitmap_portable_deserialize_safe(pIn1, nIn1);
-  roaring64_bitmap_t *r2 = roaring64_bitmap_portable_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
-  }
-  int64_t nOut = (int64_t) roaring64_bitmap_andnot_cardinality(r1, r2);
-  roaring64_bitmap_free(r1);  
-  roaring64_bitmap_free(r2);  
-  sqlite3_result_int64(context, nOut);
-  //roaring_bitmap_and_inplace(r1, r2);
+static int roaringIndexShadowName(const char *zName){
+  return sqlite3_stricmp(zName, "data") == 0;
 }
 
-/*********************************************
-  rb_xor(bitmap1, bitmap2)
-  --------------------------------------------
-  and the second bitmap with the first one (first one is modified) and returns the first bitmap
-*********************************************/
-static void roaringXorFunc(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring_bitmap_t *r1 = roaring_bitmap_deserialize_safe(pIn1, nIn1);
-  roaring_bitmap_t *r2 = roaring_bitmap_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
+/*
+  value = ? is answered from the bitmap of that value, anything else scans
+  all the values
+*/
+static int roaringIndexBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *pIdxInfo){
+  for(int i = 0; i < pIdxInfo->nConstraint; i++){
+    const struct sqlite3_index_constraint *pCons = &pIdxInfo->aConstraint[i];
+    if( pCons->usable && pCons->iColumn == ROARING_INDEX_VALUE && pCons->op == SQLITE_INDEX_CONSTRAINT_EQ ){
+      pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+      pIdxInfo->aConstraintUsage[i].omit = 1;
+      pIdxInfo->idxNum = 1;
+      pIdxInfo->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+      pIdxInfo->estimatedCost = 1;
+      pIdxInfo->estimatedRows = 1;
+      return SQLITE_OK;
+    }
   }
-  roaring_bitmap_xor_inplace(r1, r2);
-  int nOut, nSize;
-  nSize = (int) roaring_bitmap_size_in_bytes(r1);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int) roaring_bitmap_serialize(r1, pOut);
-  roaring_bitmap_free(r1);  
-  roaring_bitmap_free(r2);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  pIdxInfo->idxNum = 0;
+  pIdxInfo->estimatedCost = 1000;
+  pIdxInfo->estimatedRows = 100;
+  return SQLITE_OK;
 }
 
-static void roaring64XorFunc(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring64_bitmap_t *r1 = roaring64_bitmap_portable_deserialize_safe(pIn1, nIn1);
-  roaring64_bitmap_t *r2 = roaring64_bitmap_portable_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
-  }
-  roaring64_bitmap_xor_inplace(r1, r2);
-  int64_t nOut, nSize;
-  nSize = (int64_t) roaring64_bitmap_portable_size_in_bytes(r1);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int64_t) roaring64_bitmap_portable_serialize(r1, pOut);
-  roaring64_bitmap_free(r1);  
-  roaring64_bitmap_free(r2);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+static int roaringIndexOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor){
+  RoaringIndexCursor *pCur = sqlite3_malloc(sizeof(*pCur));
+  if( pCur == NULL ) return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur));
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
 }
 
-/*********************************************
-  rb_xor_length(bitmap1, bitmap2)
-  --------------------------------------------
-  and the second bitmap with the first one (first one is modified) and returns the first bitmap
-*********************************************/
-static void roaringXorLengthFunc(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring_bitmap_t *r1 = roaring_bitmap_deserialize_safe(pIn1, nIn1);
-  roaring_bitmap_t *r2 = roaring_bitmap_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
+static void roaringIndexCursorReset(RoaringIndexCursor *pCur){
+  for(int i = 0; i < pCur->nValue; i++){
+    sqlite3_value_free(pCur->apValue[i]);
   }
-  int nOut = (int) roaring_bitmap_xor_cardinality(r1, r2);
-  roaring_bitmap_free(r1);  
-  roaring_bitmap_free(r2);  
-  sqlite3_result_int(context, nOut);
+  pCur->nValue = 0;
+  pCur->iValue = 0;
 }
 
-static void roaring64XorLengthFunc(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring64_bitmap_t *r1 = roaring64_bitmap_portable_deserialize_safe(pIn1, nIn1);
-  roaring64_bitmap_t *r2 = roaring64_bitmap_portable_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
-  }
-  int nOut = (int) roaring64_bitmap_xor_cardinality(r1, r2);
-  roaring64_bitmap_free(r1);  
-  roaring64_bitmap_free(r2);  
-  sqlite3_result_int64(context, nOut);
+static int roaringIndexClose(sqlite3_vtab_cursor *cur){
+  RoaringIndexCursor *pCur = (RoaringIndexCursor*)cur;
+  roaringIndexCursorReset(pCur);
+  sqlite3_free(pCur->apValue);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
 }
 
-/*********************************************
-  rb_or_length(bitmap1, bitmap2)
-  --------------------------------------------
-  or the second bitmap with the first one (first one is modified) and returns the length of the result
-*********************************************/
-static void roaringOrLengthFunc(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring_bitmap_t *r1 = roaring_bitmap_deserialize_safe(pIn1, nIn1);
-  roaring_bitmap_t *r2 = roaring_bitmap_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
+static int roaringIndexCursorAdd(RoaringIndexCursor *pCur, sqlite3_value *pVal){
+  if( pCur->nValue == pCur->nAlloc ){
+    int nAlloc = pCur->nAlloc ? pCur->nAlloc * 2 : 16;
+    sqlite3_value **apValue = sqlite3_realloc64(pCur->apValue, sizeof(*apValue) * nAlloc);
+    if( apValue == NULL ) return SQLITE_NOMEM;
+    pCur->apValue = apValue;
+    pCur->nAlloc = nAlloc;
   }
-  int nOut = (int) roaring_bitmap_or_cardinality(r1, r2);
-  roaring_bitmap_free(r1);  
-  roaring_bitmap_free(r2);  
-  sqlite3_result_int(context, nOut);
+  if( (pCur->apValue[pCur->nValue] = sqlite3_value_dup(pVal)) == NULL ) return SQLITE_NOMEM;
+  pCur->nValue++;
+  return SQLITE_OK;
 }
 
-static void roaring64OrLengthFunc(
-  sqlite3_context *context,
+/*
+  collects the values to visit, the stored ones are merged with those only
+  in memory and values whose bitmap became empty are skipped
+*/
+static int roaringIndexFilter(
+  sqlite3_vtab_cursor *cur,
+  int idxNum,
+  const char *idxStr,
   int argc,
   sqlite3_value **argv
 ){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring64_bitmap_t *r1 = roaring64_bitmap_portable_deserialize_safe(pIn1, nIn1);
-  roaring64_bitmap_t *r2 = roaring64_bitmap_portable_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
+  RoaringIndexCursor *pCur = (RoaringIndexCursor*)cur;
+  RoaringIndexVtab *p = (RoaringIndexVtab*)cur->pVtab;
+  RoaringIndexEntry *pEntry;
+  int rc = SQLITE_OK;
+  roaringIndexCursorReset(pCur);
+  if( p->nDirty == 0 ) rc = roaringIndexValidate(p);
+  if( rc != SQLITE_OK ) return rc;
+  if( idxNum == 1 ){
+    if( sqlite3_value_type(argv[0]) == SQLITE_NULL ) return SQLITE_OK;
+    rc = roaringIndexGet(p, argv[0], ROARING_INDEX_READ, &pEntry);
+    if( rc == SQLITE_OK && pEntry != NULL && !roaring_bitmap_is_empty(pEntry->rb) ){
+      rc = roaringIndexCursorAdd(pCur, argv[0]);
+    }
+    return rc;
   }
-  int nOut = (int) roaring64_bitmap_or_cardinality(r1, r2);
-  roaring64_bitmap_free(r1);  
-  roaring64_bitmap_free(r2);  
-  sqlite3_result_int(context, nOut);
+  rc = roaringIndexPrepare(p, &p->pScan, "SELECT value FROM \"%w\".\"%w_data\"");
+  while( rc == SQLITE_OK && sqlite3_step(p->pScan) == SQLITE_ROW ){
+    sqlite3_value *pVal = sqlite3_column_value(p->pScan, 0);
+    pEntry = roaringIndexFind(p, pVal, roaringIndexHash(pVal));
+    if( pEntry != NULL ){
+      pEntry->bSeen = 1;
+      if( roaring_bitmap_is_empty(pEntry->rb) ) continue;
+    }
+    rc = roaringIndexCursorAdd(pCur, pVal);
+  }
+  if( p->pScan != NULL ){
+    int rc2 = sqlite3_reset(p->pScan);
+    if( rc == SQLITE_OK ) rc = rc2;
+  }
+  for(int i = 0; i < p->nSlot; i++){
+    for(pEntry = p->aSlot[i]; pEntry; pEntry = pEntry->pNext){
+      if( rc == SQLITE_OK && !pEntry->bSeen && !roaring_bitmap_is_empty(pEntry->rb) ){
+        rc = roaringIndexCursorAdd(pCur, pEntry->pValue);
+      }
+      pEntry->bSeen = 0;
+    }
+  }
+  return rc;
 }
 
+static int roaringIndexNext(sqlite3_vtab_cursor *cur){
+  ((RoaringIndexCursor*)cur)->iValue++;
+  return SQLITE_OK;
+}
 
-/*********************************************
-  rb_or(bitmap1, bitmap2)
-  --------------------------------------------
-  or the second bitmap with the first one (first one is modified) and returns the first bitmap
-*********************************************/
-static void roaringOrFunc(
+static int roaringIndexEof(sqlite3_vtab_cursor *cur){
+  RoaringIndexCursor *pCur = (RoaringIndexCursor*)cur;
+  return pCur->iValue >= pCur->nValue;
+}
+
+static int roaringIndexColumn(
+  sqlite3_vtab_cursor *cur,
   sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
+  int i
 ){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring_bitmap_t *r1 = roaring_bitmap_deserialize_safe(pIn1, nIn1);
-  roaring_bitmap_t *r2 = roaring_bitmap_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
+  RoaringIndexCursor *pCur = (RoaringIndexCursor*)cur;
+  RoaringIndexVtab *p = (RoaringIndexVtab*)cur->pVtab;
+  RoaringIndexEntry *pEntry;
+  int rc;
+  switch( i ){
+    case ROARING_INDEX_VALUE:
+      sqlite3_result_value(context, pCur->apValue[pCur->iValue]);
+      break;
+    case ROARING_INDEX_BITMAP:
+      rc = roaringIndexGet(p, pCur->apValue[pCur->iValue], ROARING_INDEX_READ, &pEntry);
+      if( rc != SQLITE_OK ) return rc;
+      // stored bitmaps are run optimized already, there is no function user
+      // data here for roaringCompact
+      if( pEntry != NULL ) roaringResultBlob(context, pEntry->rb);
+      break;
   }
-  roaring_bitmap_or_inplace(r1, r2);
-  int nOut, nSize;
-  nSize = (int) roaring_bitmap_size_in_bytes(r1);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int) roaring_bitmap_serialize(r1, pOut);
-  roaring_bitmap_free(r1);  
-  roaring_bitmap_free(r2);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  return SQLITE_OK;
 }
 
-static void roaring64OrFunc(
-  sqlite3_context *context,
+static int roaringIndexRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid){
+  *pRowid = ((RoaringIndexCursor*)cur)->iValue + 1;
+  return SQLITE_OK;
+}
+
+/*
+  the triggers insert ('add' | 'remove', value, rowid) rows, which update
+  the bitmap of the value in memory
+*/
+static int roaringIndexUpdate(
+  sqlite3_vtab *pVtab,
   int argc,
-  sqlite3_value **argv
+  sqlite3_value **argv,
+  sqlite_int64 *pRowid
 ){
-  const unsigned char *pIn1;
-  unsigned int nIn1;  
-  const unsigned char *pIn2;
-  unsigned int nIn2;  
-  pIn1 = sqlite3_value_blob(argv[0]);
-  nIn1 = sqlite3_value_bytes(argv[0]);
-  pIn2 = sqlite3_value_blob(argv[1]);
-  nIn2 = sqlite3_value_bytes(argv[1]);
-  roaring64_bitmap_t *r1 = roaring64_bitmap_portable_deserialize_safe(pIn1, nIn1);
-  roaring64_bitmap_t *r2 = roaring64_bitmap_portable_deserialize_safe(pIn2, nIn2);
-  if( r1 == NULL || r2 == NULL){
-    sqlite3_result_error(context, "invalid bitmap(s)", -1);
-    return;
+  RoaringIndexVtab *p = (RoaringIndexVtab*)pVtab;
+  RoaringIndexEntry *pEntry;
+  sqlite3_value *pVal;
+  sqlite3_int64 iRowid;
+  const char *zOp;
+  int bAdd;
+  int rc;
+  if( argc == 1 || sqlite3_value_type(argv[0]) != SQLITE_NULL ){
+    return roaringVtabError(&p->base, SQLITE_ERROR, "%s is maintained from table %s", p->zName, p->zTable);
   }
-  roaring64_bitmap_or_inplace(r1, r2);
-  int nOut, nSize;
-  nSize = (int) roaring64_bitmap_portable_size_in_bytes(r1);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int) roaring64_bitmap_portable_serialize(r1, pOut);
-  roaring64_bitmap_free(r1);  
-  roaring64_bitmap_free(r2);  
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  zOp = (const char*)sqlite3_value_text(argv[2 + ROARING_INDEX_OP]);
+  if( zOp != NULL && sqlite3_stricmp(zOp, "rebuild") == 0 ){
+    return roaringIndexRebuild(p);
+  }
+  if( zOp != NULL && sqlite3_stricmp(zOp, "add") == 0 ){
+    bAdd = 1;
+  }else if( zOp != NULL && sqlite3_stricmp(zOp, "remove") == 0 ){
+    bAdd = 0;
+  }else if( zOp != NULL && sqlite3_stricmp(zOp, "replace") == 0 ){
+    sqlite3_value_free(p->pReplaced);
+    p->pReplaced = sqlite3_value_dup(argv[2 + ROARING_INDEX_VALUE]);
+    p->iReplaced = sqlite3_value_int64(argv[2 + ROARING_INDEX_ID]);
+    return p->pReplaced ? SQLITE_OK : SQLITE_NOMEM;
+  }else{
+    return roaringVtabError(&p->base, SQLITE_ERROR, "%s is maintained from table %s", p->zName, p->zTable);
+  }
+  iRowid = sqlite3_value_int64(argv[2 + ROARING_INDEX_ID]);
+  if( p->pReplaced != NULL ){
+    // the insert went through, so the row it conflicted with is gone
+    sqlite3_value *pReplaced = p->pReplaced;
+    p->pReplaced = NULL;
+    rc = SQLITE_OK;
+    if( bAdd && iRowid == p->iReplaced && iRowid >= 0 && iRowid <= UINT32_MAX ){
+      rc = roaringIndexGet(p, pReplaced, ROARING_INDEX_READ | ROARING_INDEX_CREATE, &pEntry);
+      if( rc == SQLITE_OK ){
+        roaring_bitmap_remove(pEntry->rb, (uint32_t)iRowid);
+        if( !pEntry->bDirty ){
+          pEntry->bDirty = 1;
+          p->nDirty++;
+        }
+      }
+    }
+    sqlite3_value_free(pReplaced);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  pVal = argv[2 + ROARING_INDEX_VALUE];
+  if( sqlite3_value_type(pVal) == SQLITE_NULL ) return SQLITE_OK;
+  if( sqlite3_value_type(argv[2 + ROARING_INDEX_ID]) != SQLITE_INTEGER || iRowid < 0 || iRowid > UINT32_MAX ){
+    return roaringVtabError(&p->base, SQLITE_ERROR, "rowid %lld of %s doesn't fit in a bitmap", iRowid, p->zTable);
+  }
+  rc = roaringIndexGet(p, pVal, ROARING_INDEX_READ | ROARING_INDEX_CREATE, &pEntry);
+  if( rc != SQLITE_OK ) return rc;
+  if( bAdd ){
+    roaring_bitmap_add(pEntry->rb, (uint32_t)iRowid);
+  }else{
+    roaring_bitmap_remove(pEntry->rb, (uint32_t)iRowid);
+  }
+  if( !pEntry->bDirty ){
+    pEntry->bDirty = 1;
+    p->nDirty++;
+  }
+  return SQLITE_OK;
+}
+
+static int roaringIndexBegin(sqlite3_vtab *pVtab){
+  return roaringIndexValidate((RoaringIndexVtab*)pVtab);
+}
+
+static int roaringIndexSync(sqlite3_vtab *pVtab){
+  return roaringIndexFlush((RoaringIndexVtab*)pVtab);
+}
+
+static int roaringIndexCommit(sqlite3_vtab *pVtab){
+  return SQLITE_OK;
+}
+
+/*
+  the dirty bitmaps are lost and the clean ones may have been written back
+  after the rollback point, all are read again from the shadow table
+*/
+static int roaringIndexRollback(sqlite3_vtab *pVtab){
+  roaringIndexClear((RoaringIndexVtab*)pVtab);
+  return SQLITE_OK;
+}
+
+/*
+  writing back when a savepoint opens leaves the shadow table to sqlite's
+  own savepoints
+*/
+static int roaringIndexSavepoint(sqlite3_vtab *pVtab, int iSavepoint){
+  return roaringIndexFlush((RoaringIndexVtab*)pVtab);
+}
+
+static int roaringIndexRelease(sqlite3_vtab *pVtab, int iSavepoint){
+  return SQLITE_OK;
+}
+
+static int roaringIndexRollbackTo(sqlite3_vtab *pVtab, int iSavepoint){
+  roaringIndexClear((RoaringIndexVtab*)pVtab);
+  return SQLITE_OK;
 }
 
+static sqlite3_module roaringIndexModule = {
+  3,                         /* iVersion */
+  roaringIndexCreate,        /* xCreate */
+  roaringIndexConnect,       /* xConnect */
+  roaringIndexBestIndex,     /* xBestIndex */
+  roaringIndexDisconnect,    /* xDisconnect */
+  roaringIndexDestroy,       /* xDestroy */
+  roaringIndexOpen,          /* xOpen - open a cursor */
+  roaringIndexClose,         /* xClose - close a cursor */
+  roaringIndexFilter,        /* xFilter - configure scan constraints */
+  roaringIndexNext,          /* xNext - advance a cursor */
+  roaringIndexEof,           /* xEof - check for end of scan */
+  roaringIndexColumn,        /* xColumn - read data */
+  roaringIndexRowid,         /* xRowid - read data */
+  roaringIndexUpdate,        /* xUpdate - apply trigger changes */
+  roaringIndexBegin,         /* xBegin */
+  roaringIndexSync,          /* xSync - write dirty bitmaps back */
+  roaringIndexCommit,        /* xCommit */
+  roaringIndexRollback,      /* xRollback */
+  0,                         /* xFindFunction */
+  roaringIndexRename,        /* xRename */
+  roaringIndexSavepoint,     /* xSavepoint */
+  roaringIndexRelease,       /* xRelease */
+  roaringIndexRollbackTo,    /* xRollbackTo */
+  roaringIndexShadowName,    /* xShadowName */
+};
+
 /*********************************************
-  rb_group_and(col)
+  roaring_chunked
   --------------------------------------------
-  and all the values in col
-  
-  example: SELECT rb_group_and(col) FROM table
+  virtual table of bitmaps that are stored one row per 2^16 chunk in the
+  shadow table <name>_chunk(id, key, chunk), where chunk is a serialized
+  bitmap of the values whose high 16 bits are key. adding a value rewrites
+  a single small row instead of the whole blob, replacing a bitmap only
+  writes the chunks that changed, a range of values reads only the chunks
+  in the range and the boolean ops only visit the chunks they can change
+
+  example: CREATE VIRTUAL TABLE segments USING roaring_chunked
+           INSERT INTO segments(id, bitmap) VALUES (1, rb_create(1, 2, 70000))
+           INSERT INTO segments(id, op, value) VALUES (1, 'add', 3)
+           SELECT bitmap FROM segments WHERE id = 1 AND value < 65536
 *********************************************/
+#define ROARING_CHUNKED_ID     0
+#define ROARING_CHUNKED_BITMAP 1
+#define ROARING_CHUNKED_OP     2
+#define ROARING_CHUNKED_VALUE  3
+#define ROARING_CHUNKED_FILTER 4
 
-static void roaringAndAllStep(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
+/*
+  idxNum holds one 4 bit operator (ROARING_EACH_OP_*) per argument slot, the
+  arguments are passed to xFilter in slot order
+*/
+#define ROARING_CHUNKED_SLOT_ID        0
+#define ROARING_CHUNKED_SLOT_VALUE_MIN 1
+#define ROARING_CHUNKED_SLOT_VALUE_MAX 2
+#define ROARING_CHUNKED_SLOT_FILTER    3
+#define ROARING_CHUNKED_NSLOT          4
 
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  //const unsigned char *pInAnd;
-  //unsigned int nInAnd;
-  RoaringContext *rc;
-  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
+typedef struct RoaringChunkedVtab RoaringChunkedVtab;
+struct RoaringChunkedVtab {
+  sqlite3_vtab base;
+  sqlite3 *db;
+  char *zDb;                       // schema of the virtual table
+  char *zName;                     // name of the virtual table
+  sqlite3_stmt *pGet;              // SELECT chunk WHERE id = ? AND key = ?
+  sqlite3_stmt *pPut;              // INSERT OR REPLACE (id, key, chunk)
+  sqlite3_stmt *pDel;              // DELETE WHERE id = ? AND key = ?
+  sqlite3_stmt *pRange;            // SELECT key, chunk WHERE id = ? AND key BETWEEN ? AND ?
+  sqlite3_stmt *pKeys;             // SELECT key WHERE id = ?
+};
 
-  if(rc->init == 0){
-    rc->init = 1;
-    rc->rb = roaring_bitmap_deserialize_safe(pIn, nIn);
-    if( rc->rb == NULL ){
-      sqlite3_result_error(context, "invalid bitmap", -1);
-      return;
-    }
-  }else{
-    roaring_bitmap_t *r = roaring_bitmap_deserialize_safe(pIn, nIn);
-    if( r == NULL ){
-      sqlite3_result_error(context, "invalid bitmap", -1);
-      return;
-    }
-    roaring_bitmap_and_inplace(rc->rb, r);
-    roaring_bitmap_free(r);
-  }
+typedef struct RoaringChunkedCursor RoaringChunkedCursor;
+struct RoaringChunkedCursor {
+  sqlite3_vtab_cursor base;
+  sqlite3_int64 iId;               // id of the current row
+  int bEof;
+  int bScan;                       // rows come from pIds, otherwise one id
+  sqlite3_stmt *pScan;             // SELECT id GROUP BY id
+  uint32_t iMin;                   // value range of the bitmaps
+  uint32_t iMax;
+  roaring_bitmap_t *pFilter;       // bitmaps are and'ed with this if set
+};
 
+static int roaringChunkedPrepare(RoaringChunkedVtab *p, sqlite3_stmt **ppStmt, const char *zFmt){
+  return roaringVtabPrepare(&p->base, p->db, ppStmt, zFmt, p->zDb, p->zName);
 }
 
+/*
+  key of the first chunk of the bitmap at or after iKey, returns 0 when
+  there is none
+*/
+static int roaringChunkNextKey(const roaring_bitmap_t *r, uint32_t iKey, uint32_t *piKey){
+  roaring_uint32_iterator_t it;
+  if( iKey > 0xFFFF ) return 0;
+  roaring_iterator_init(r, &it);
+  if( !roaring_uint32_iterator_move_equalorlarger(&it, iKey << 16) ) return 0;
+  *piKey = it.current_value >> 16;
+  return 1;
+}
 
-static void roaringAndAllFinal(sqlite3_context *context){
-  RoaringContext *rc;
-  int nOut, nSize;
-  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
-  if(rc->rb == NULL){
-    // no rb was created, must be an empty result set
-    rc->rb = roaring_bitmap_create();    
+/*
+  the values of the bitmap in chunk iKey
+*/
+static roaring_bitmap_t *roaringChunkOf(const roaring_bitmap_t *r, uint32_t iKey){
+  roaring_bitmap_t *pRange = roaring_bitmap_from_range((uint64_t)iKey << 16, ((uint64_t)iKey + 1) << 16, 1);
+  roaring_bitmap_t *pChunk = pRange ? roaring_bitmap_and(r, pRange) : NULL;
+  roaring_bitmap_free(pRange);
+  return pChunk;
+}
+
+/*
+  stored chunk iKey of bitmap iId, *ppChunk is NULL when there is none
+*/
+static int roaringChunkedGet(RoaringChunkedVtab *p, sqlite3_int64 iId, uint32_t iKey, roaring_bitmap_t **ppChunk){
+  int rc = roaringChunkedPrepare(p, &p->pGet, "SELECT chunk FROM \"%w\".\"%w_chunk\" WHERE id = ? AND key = ?");
+  *ppChunk = NULL;
+  if( rc != SQLITE_OK ) return rc;
+  sqlite3_bind_int64(p->pGet, 1, iId);
+  sqlite3_bind_int64(p->pGet, 2, iKey);
+  if( sqlite3_step(p->pGet) == SQLITE_ROW ){
+    *ppChunk = roaringDeserialize(sqlite3_column_blob(p->pGet, 0), sqlite3_column_bytes(p->pGet, 0));
+    if( *ppChunk == NULL ) rc = SQLITE_CORRUPT_VTAB;
   }
-  nSize = (int) roaring_bitmap_size_in_bytes(rc->rb);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int) roaring_bitmap_serialize(rc->rb, pOut);
-  roaring_bitmap_free(rc->rb); 
-  memset(rc, 0, sizeof(*rc)); 
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  if( sqlite3_reset(p->pGet) != SQLITE_OK ) rc = sqlite3_reset(p->pGet);
+  return rc;
 }
 
-static void roaring64AndAllStep(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
+/*
+  writes chunk iKey of bitmap iId, an empty chunk deletes the row
+*/
+static int roaringChunkedPut(RoaringChunkedVtab *p, sqlite3_int64 iId, uint32_t iKey, roaring_bitmap_t *pChunk){
+  sqlite3_stmt *pStmt;
+  int rc;
+  if( pChunk == NULL || roaring_bitmap_is_empty(pChunk) ){
+    rc = roaringChunkedPrepare(p, &p->pDel, "DELETE FROM \"%w\".\"%w_chunk\" WHERE id = ? AND key = ?");
+    if( rc != SQLITE_OK ) return rc;
+    pStmt = p->pDel;
+  }else{
+    size_t nOut;
+    char *pOut;
+    rc = roaringChunkedPrepare(p, &p->pPut, "INSERT OR REPLACE INTO \"%w\".\"%w_chunk\"(id, key, chunk) VALUES (?, ?, ?)");
+    if( rc != SQLITE_OK ) return rc;
+    roaring_bitmap_run_optimize(pChunk);
+    pOut = sqlite3_malloc64(roaring_bitmap_size_in_bytes(pChunk));
+    if( pOut == NULL ) return SQLITE_NOMEM;
+    nOut = roaring_bitmap_serialize(pChunk, pOut);
+    pStmt = p->pPut;
+    sqlite3_bind_blob64(pStmt, 3, pOut, nOut, sqlite3_free);
+  }
+  sqlite3_bind_int64(pStmt, 1, iId);
+  sqlite3_bind_int64(pStmt, 2, iKey);
+  sqlite3_step(pStmt);
+  rc = sqlite3_reset(pStmt);
+  sqlite3_clear_bindings(pStmt);
+  if( rc != SQLITE_OK ) roaringVtabError(&p->base, rc, "%s", sqlite3_errmsg(p->db));
+  return rc;
+}
 
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  //const unsigned char *pInAnd;
-  //unsigned int nInAnd;
-  Roaring64Context *rc;
-  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
+/*
+  the keys of the stored chunks of bitmap iId, collected before any of them
+  is written
+*/
+static int roaringChunkedKeys(RoaringChunkedVtab *p, sqlite3_int64 iId, roaring_bitmap_t *pKeys){
+  int rc = roaringChunkedPrepare(p, &p->pKeys, "SELECT key FROM \"%w\".\"%w_chunk\" WHERE id = ?");
+  if( rc != SQLITE_OK ) return rc;
+  sqlite3_bind_int64(p->pKeys, 1, iId);
+  while( sqlite3_step(p->pKeys) == SQLITE_ROW ){
+    roaring_bitmap_add(pKeys, (uint32_t)sqlite3_column_int64(p->pKeys, 0));
+  }
+  return sqlite3_reset(p->pKeys);
+}
 
-  if(rc->init == 0){
-    rc->init = 1;
-    rc->rb = roaring64_bitmap_portable_deserialize_safe(pIn, nIn);
-    if( rc->rb == NULL ){
-      sqlite3_result_error(context, "invalid bitmap", -1);
-      return;
+/*
+  bitmap iId restricted to [iMin, iMax] and to pFilter if set. with a filter
+  only the chunks of the filter are looked up, otherwise the chunks of the
+  range are read in key order
+*/
+static int roaringChunkedRead(
+  RoaringChunkedVtab *p,
+  sqlite3_int64 iId,
+  uint32_t iMin,
+  uint32_t iMax,
+  const roaring_bitmap_t *pFilter,
+  roaring_bitmap_t **pp
+){
+  roaring_bitmap_t *r = roaring_bitmap_create();
+  roaring_bitmap_t *pChunk;
+  int rc = SQLITE_OK;
+  *pp = NULL;
+  if( r == NULL ) return SQLITE_NOMEM;
+  if( pFilter != NULL ){
+    uint32_t iKey = iMin >> 16;
+    while( rc == SQLITE_OK && roaringChunkNextKey(pFilter, iKey, &iKey) && iKey <= (iMax >> 16) ){
+      rc = roaringChunkedGet(p, iId, iKey, &pChunk);
+      if( pChunk != NULL ){
+        roaring_bitmap_and_inplace(pChunk, pFilter);
+        roaring_bitmap_or_inplace(r, pChunk);
+        roaring_bitmap_free(pChunk);
+      }
+      iKey++;
     }
   }else{
-    roaring64_bitmap_t *r = roaring64_bitmap_portable_deserialize_safe(pIn, nIn);
-    if( r == NULL ){
-      sqlite3_result_error(context, "invalid bitmap", -1);
-      return;
+    rc = roaringChunkedPrepare(p, &p->pRange,
+      "SELECT chunk FROM \"%w\".\"%w_chunk\" WHERE id = ? AND key BETWEEN ? AND ? ORDER BY key");
+    if( rc == SQLITE_OK ){
+      sqlite3_bind_int64(p->pRange, 1, iId);
+      sqlite3_bind_int64(p->pRange, 2, iMin >> 16);
+      sqlite3_bind_int64(p->pRange, 3, iMax >> 16);
+      while( sqlite3_step(p->pRange) == SQLITE_ROW ){
+        pChunk = roaringDeserialize(sqlite3_column_blob(p->pRange, 0), sqlite3_column_bytes(p->pRange, 0));
+        if( pChunk == NULL ){
+          rc = SQLITE_CORRUPT_VTAB;
+          break;
+        }
+        roaring_bitmap_or_inplace(r, pChunk);
+        roaring_bitmap_free(pChunk);
+      }
+      if( sqlite3_reset(p->pRange) != SQLITE_OK ) rc = sqlite3_reset(p->pRange);
     }
-    roaring64_bitmap_and_inplace(rc->rb, r);
-    roaring64_bitmap_free(r);
   }
+  if( rc != SQLITE_OK ){
+    roaring_bitmap_free(r);
+    return rc;
+  }
+  // only the first and last chunk can hold values outside of the range
+  if( iMin > 0 ) roaring_bitmap_remove_range_closed(r, 0, iMin - 1);
+  if( iMax < UINT32_MAX ) roaring_bitmap_remove_range_closed(r, iMax + 1, UINT32_MAX);
+  *pp = r;
+  return SQLITE_OK;
+}
 
+static int roaringChunkedExists(RoaringChunkedVtab *p, sqlite3_int64 iId, int *pbExists){
+  int rc = roaringChunkedPrepare(p, &p->pKeys, "SELECT key FROM \"%w\".\"%w_chunk\" WHERE id = ?");
+  if( rc != SQLITE_OK ) return rc;
+  sqlite3_bind_int64(p->pKeys, 1, iId);
+  *pbExists = sqlite3_step(p->pKeys) == SQLITE_ROW;
+  return sqlite3_reset(p->pKeys);
 }
 
-static void roaring64AndAllFinal(sqlite3_context *context){
-  Roaring64Context *rc;
-  int64_t nOut, nSize;
-  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
-  if(rc->rb == NULL){
-    // no rb was created, must be an empty result set
-    rc->rb = roaring64_bitmap_create();    
+#define ROARING_CHUNKED_OP_REPLACE 0
+#define ROARING_CHUNKED_OP_OR      1
+#define ROARING_CHUNKED_OP_AND     2
+#define ROARING_CHUNKED_OP_XOR     3
+#define ROARING_CHUNKED_OP_NOT     4
+
+/*
+  combines bitmap iId with r chunk by chunk. or, xor and not visit the
+  chunks of r, and the stored chunks, replace visits both. only the chunks
+  that changed are written
+*/
+static int roaringChunkedApply(RoaringChunkedVtab *p, sqlite3_int64 iId, const roaring_bitmap_t *r, int op){
+  roaring_bitmap_t *pKeys = roaring_bitmap_create();
+  roaring_uint32_iterator_t it;
+  uint32_t iKey = 0;
+  int rc = SQLITE_OK;
+  if( pKeys == NULL ) return SQLITE_NOMEM;
+  if( op == ROARING_CHUNKED_OP_REPLACE || op == ROARING_CHUNKED_OP_AND ){
+    rc = roaringChunkedKeys(p, iId, pKeys);
   }
-  nSize = (int64_t) roaring64_bitmap_portable_size_in_bytes(rc->rb);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int64_t) roaring64_bitmap_portable_serialize(rc->rb, pOut);
-  roaring64_bitmap_free(rc->rb); 
-  memset(rc, 0, sizeof(*rc)); 
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  if( op != ROARING_CHUNKED_OP_AND ){
+    while( roaringChunkNextKey(r, iKey, &iKey) ){
+      roaring_bitmap_add(pKeys, iKey++);
+    }
+  }
+  for(roaring_iterator_init(pKeys, &it); rc == SQLITE_OK && it.has_value; roaring_uint32_iterator_advance(&it)){
+    roaring_bitmap_t *pOld, *pNew, *pChunk;
+    iKey = it.current_value;
+    rc = roaringChunkedGet(p, iId, iKey, &pOld);
+    if( rc != SQLITE_OK ) break;
+    if( pOld == NULL && op != ROARING_CHUNKED_OP_REPLACE && op != ROARING_CHUNKED_OP_OR && op != ROARING_CHUNKED_OP_XOR ){
+      continue;
+    }
+    pChunk = roaringChunkOf(r, iKey);
+    if( pChunk == NULL ){
+      roaring_bitmap_free(pOld);
+      rc = SQLITE_NOMEM;
+      break;
+    }
+    if( pOld == NULL || op == ROARING_CHUNKED_OP_REPLACE ){
+      pNew = pChunk;
+      pChunk = NULL;
+    }else if( op == ROARING_CHUNKED_OP_OR ){
+      pNew = roaring_bitmap_or(pOld, pChunk);
+    }else if( op == ROARING_CHUNKED_OP_AND ){
+      pNew = roaring_bitmap_and(pOld, pChunk);
+    }else if( op == ROARING_CHUNKED_OP_XOR ){
+      pNew = roaring_bitmap_xor(pOld, pChunk);
+    }else{
+      pNew = roaring_bitmap_andnot(pOld, pChunk);
+    }
+    if( pNew == NULL ){
+      rc = SQLITE_NOMEM;
+    }else if( pOld == NULL ? !roaring_bitmap_is_empty(pNew) : !roaring_bitmap_equals(pOld, pNew) ){
+      rc = roaringChunkedPut(p, iId, iKey, pNew);
+    }
+    roaring_bitmap_free(pOld);
+    roaring_bitmap_free(pNew);
+    roaring_bitmap_free(pChunk);
+  }
+  roaring_bitmap_free(pKeys);
+  return rc;
 }
 
+static int roaringChunkedDisconnect(sqlite3_vtab *pVtab){
+  RoaringChunkedVtab *p = (RoaringChunkedVtab*)pVtab;
+  sqlite3_finalize(p->pGet);
+  sqlite3_finalize(p->pPut);
+  sqlite3_finalize(p->pDel);
+  sqlite3_finalize(p->pRange);
+  sqlite3_finalize(p->pKeys);
+  sqlite3_free(p->zDb);
+  sqlite3_free(p->zName);
+  sqlite3_free(p);
+  return SQLITE_OK;
+}
 
-/*********************************************
-  rb_group_or(col)
-  --------------------------------------------
-  or all the values in col
-  
-  example: SELECT rb_group_or(col) FROM table
-*********************************************/
-static void roaringOrAllStep(
-  sqlite3_context *context,
+static int roaringChunkedConnect(
+  sqlite3 *db,
+  void *pAux,
   int argc,
-  sqlite3_value **argv
+  const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
 ){
-
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  //const unsigned char *pInAnd;
-  //unsigned int nInAnd;
-  RoaringContext *rc;
-  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
-  if(rc->init == 0){
-    rc->init = 1;
-    rc->rb = roaring_bitmap_create();
-  }
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
-  roaring_bitmap_t *r = roaring_bitmap_deserialize_safe(pIn, nIn);
-  if( r == NULL ){
-    sqlite3_result_error(context, "invalid bitmap", -1);
-    return;
+  RoaringChunkedVtab *p;
+  int rc;
+  if( argc != 3 ){
+    *pzErr = sqlite3_mprintf("roaring_chunked takes no arguments");
+    return SQLITE_ERROR;
   }
-  roaring_bitmap_or_inplace(rc->rb, r);
-  roaring_bitmap_free(r);
-}
-
-static void roaringOrAllFinal(sqlite3_context *context){
-  RoaringContext *rc;
-  int nOut, nSize;
-  rc = (RoaringContext*)sqlite3_aggregate_context(context, sizeof(*rc));
-  if(rc->rb == NULL){
-    // no rb was created, must be an empty result set
-    rc->rb = roaring_bitmap_create();    
+  rc = sqlite3_declare_vtab(db, "CREATE TABLE x(id INTEGER, bitmap, op HIDDEN, value HIDDEN, filter HIDDEN)");
+  if( rc != SQLITE_OK ) return rc;
+  p = sqlite3_malloc(sizeof(*p));
+  if( p == NULL ) return SQLITE_NOMEM;
+  memset(p, 0, sizeof(*p));
+  p->db = db;
+  p->zDb = sqlite3_mprintf("%s", argv[1]);
+  p->zName = sqlite3_mprintf("%s", argv[2]);
+  if( p->zDb == NULL || p->zName == NULL ){
+    roaringChunkedDisconnect(&p->base);
+    return SQLITE_NOMEM;
   }
-  nSize = (int) roaring_bitmap_size_in_bytes(rc->rb);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int) roaring_bitmap_serialize(rc->rb, pOut);
-  roaring_bitmap_free(rc->rb); 
-  memset(rc, 0, sizeof(*rc)); 
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  *ppVtab = &p->base;
+  return SQLITE_OK;
 }
 
-static void roaring64OrAllStep(
-  sqlite3_context *context,
+static int roaringChunkedCreate(
+  sqlite3 *db,
+  void *pAux,
   int argc,
-  sqlite3_value **argv
+  const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
 ){
-
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  //const unsigned char *pInAnd;
-  //unsigned int nInAnd;
-  Roaring64Context *rc;
-  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
-  if(rc->init == 0){
-    rc->init = 1;
-    rc->rb = roaring64_bitmap_create();
-  }
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
-  roaring64_bitmap_t *r = roaring64_bitmap_portable_deserialize_safe(pIn, nIn);
-  if( r == NULL ){
-    sqlite3_result_error(context, "invalid bitmap", -1);
-    return;
+  RoaringChunkedVtab *p;
+  int rc = roaringChunkedConnect(db, pAux, argc, argv, ppVtab, pzErr);
+  if( rc != SQLITE_OK ) return rc;
+  p = (RoaringChunkedVtab*)*ppVtab;
+  rc = roaringVtabExec(&p->base, db,
+    "CREATE TABLE \"%w\".\"%w_chunk\"(id INTEGER, key INTEGER, chunk BLOB, PRIMARY KEY (id, key)) WITHOUT ROWID",
+    p->zDb, p->zName);
+  if( rc != SQLITE_OK ){
+    *pzErr = sqlite3_mprintf("%s", p->base.zErrMsg);
+    roaringChunkedDisconnect(&p->base);
+    *ppVtab = NULL;
   }
-  roaring64_bitmap_or_inplace(rc->rb, r);
-  roaring64_bitmap_free(r);
+  return rc;
 }
 
-static void roaring64OrAllFinal(sqlite3_context *context){
-  Roaring64Context *rc;
-  int64_t nOut, nSize;
-  rc = (Roaring64Context*)sqlite3_aggregate_context(context, sizeof(*rc));
-  if(rc->rb == NULL){
-    // no rb was created, must be an empty result set
-    rc->rb = roaring64_bitmap_create();    
+static int roaringChunkedDestroy(sqlite3_vtab *pVtab){
+  RoaringChunkedVtab *p = (RoaringChunkedVtab*)pVtab;
+  int rc = roaringVtabExec(pVtab, p->db, "DROP TABLE IF EXISTS \"%w\".\"%w_chunk\"", p->zDb, p->zName);
+  if( rc != SQLITE_OK ) return rc;
+  return roaringChunkedDisconnect(pVtab);
+}
+
+static int roaringChunkedRename(sqlite3_vtab *pVtab, const char *zNew){
+  RoaringChunkedVtab *p = (RoaringChunkedVtab*)pVtab;
+  char *zName = sqlite3_mprintf("%s", zNew);
+  int rc;
+  if( zName == NULL ) return SQLITE_NOMEM;
+  rc = roaringVtabExec(pVtab, p->db, "ALTER TABLE \"%w\".\"%w_chunk\" RENAME TO \"%w_chunk\"", p->zDb, p->zName, zNew);
+  if( rc != SQLITE_OK ){
+    sqlite3_free(zName);
+    return rc;
   }
-  nSize = (int64_t) roaring64_bitmap_portable_size_in_bytes(rc->rb);
-  char *pOut = sqlite3_malloc(nSize);
-  nOut = (int64_t) roaring64_bitmap_portable_serialize(rc->rb, pOut);
-  roaring64_bitmap_free(rc->rb); 
-  memset(rc, 0, sizeof(*rc)); 
-  sqlite3_result_blob(context, pOut, nOut, sqlite3_free);  
+  sqlite3_free(p->zName);
+  p->zName = zName;
+  // the statements name the old shadow table
+  sqlite3_finalize(p->pGet);
+  sqlite3_finalize(p->pPut);
+  sqlite3_finalize(p->pDel);
+  sqlite3_finalize(p->pRange);
+  sqlite3_finalize(p->pKeys);
+  p->pGet = p->pPut = p->pDel = p->pRange = p->pKeys = NULL;
+  return SQLITE_OK;
 }
 
+static int roaringChunkedShadowName(const char *zName){
+  return sqlite3_stricmp(zName, "chunk") == 0;
+}
 
+/*
+  id = ? reads a single bitmap, value bounds and filter = ? are consumed by
+  the read since value and filter are parameters rather than columns. their
+  column values are NULL, so a plan that leaves one of them for sqlite to
+  check is refused
+*/
+static int roaringChunkedBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *pIdxInfo){
+  int aIdx[ROARING_CHUNKED_NSLOT];
+  int aOp[ROARING_CHUNKED_NSLOT];
+  int idxNum = 0;
+  int nArg = 0;
+  const struct sqlite3_index_constraint *pConstraint = pIdxInfo->aConstraint;
+  memset(aOp, 0, sizeof(aOp));
+  for(int i = 0; i < pIdxInfo->nConstraint; i++, pConstraint++){
+    int op, slot;
+    switch( pConstraint->op ){
+      case SQLITE_INDEX_CONSTRAINT_EQ: op = ROARING_EACH_OP_EQ; break;
+      case SQLITE_INDEX_CONSTRAINT_GT: op = ROARING_EACH_OP_GT; break;
+      case SQLITE_INDEX_CONSTRAINT_GE: op = ROARING_EACH_OP_GE; break;
+      case SQLITE_INDEX_CONSTRAINT_LT: op = ROARING_EACH_OP_LT; break;
+      case SQLITE_INDEX_CONSTRAINT_LE: op = ROARING_EACH_OP_LE; break;
+      default: continue;
+    }
+    if( pConstraint->iColumn == ROARING_CHUNKED_ID || pConstraint->iColumn == -1 ){
+      if( op != ROARING_EACH_OP_EQ || !pConstraint->usable ) continue;
+      slot = ROARING_CHUNKED_SLOT_ID;
+    }else if( pConstraint->iColumn == ROARING_CHUNKED_VALUE ){
+      if( !pConstraint->usable ) return SQLITE_CONSTRAINT;
+      slot = op >= ROARING_EACH_OP_LT ? ROARING_CHUNKED_SLOT_VALUE_MAX : ROARING_CHUNKED_SLOT_VALUE_MIN;
+    }else if( pConstraint->iColumn == ROARING_CHUNKED_FILTER ){
+      if( op != ROARING_EACH_OP_EQ ) continue;
+      if( !pConstraint->usable ) return SQLITE_CONSTRAINT;
+      slot = ROARING_CHUNKED_SLOT_FILTER;
+    }else{
+      continue;
+    }
+    if( aOp[slot] == 0 || op == ROARING_EACH_OP_EQ ){
+      aOp[slot] = op;
+      aIdx[slot] = i;
+    }
+  }
+  for(int slot = 0; slot < ROARING_CHUNKED_NSLOT; slot++){
+    if( aOp[slot] == 0 ) continue;
+    pIdxInfo->aConstraintUsage[aIdx[slot]].argvIndex = ++nArg;
+    pIdxInfo->aConstraintUsage[aIdx[slot]].omit = 1;
+    idxNum |= aOp[slot] << (slot*4);
+  }
+  pIdxInfo->idxNum = idxNum;
+  if( aOp[ROARING_CHUNKED_SLOT_ID] != 0 ){
+    pIdxInfo->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+    pIdxInfo->estimatedCost = 10;
+    pIdxInfo->estimatedRows = 1;
+  }else{
+    pIdxInfo->estimatedCost = 100000;
+  }
+  return SQLITE_OK;
+}
 
-typedef struct ArrayContext ArrayContext;
-struct ArrayContext {
-  unsigned init;
-  unsigned count;
-  int64_t *array;
-};
+static int roaringChunkedOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor){
+  RoaringChunkedCursor *pCur = sqlite3_malloc(sizeof(*pCur));
+  if( pCur == NULL ) return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur));
+  pCur->bEof = 1;
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
 
+static void roaringChunkedReset(RoaringChunkedCursor *pCur){
+  sqlite3_finalize(pCur->pScan);
+  pCur->pScan = NULL;
+  roaring_bitmap_free(pCur->pFilter);
+  pCur->pFilter = NULL;
+  pCur->bEof = 1;
+}
 
+static int roaringChunkedClose(sqlite3_vtab_cursor *cur){
+  RoaringChunkedCursor *pCur = (RoaringChunkedCursor*)cur;
+  roaringChunkedReset(pCur);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
 
-/*********************************************
-  rb_array(bitmap, limit=null, offset=0)
-  --------------------------------------------
-  returns the first limit elements starting from offset
-  if the limit is not provided or equal to -1 then all the entries are returned
-  if the offset is not set then elements will be returned starting from offset 0
-*********************************************/
-static void roaringArrayFunc(
-  sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
-){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
-  roaring_bitmap_t *r = roaring_bitmap_deserialize_safe(pIn, nIn);
-  if( r == NULL ){
-    sqlite3_result_error(context, "invalid bitmap", -1);
-    return;
+static int roaringChunkedNext(sqlite3_vtab_cursor *cur){
+  RoaringChunkedCursor *pCur = (RoaringChunkedCursor*)cur;
+  int rc;
+  if( pCur->pScan == NULL ){
+    pCur->bEof = 1;
+    return SQLITE_OK;
   }
-  int nSize = roaring_bitmap_get_cardinality(r);
-  uint32_t *ids;
-  ids = sqlite3_malloc(nSize * sizeof(uint32_t));
-  roaring_bitmap_to_uint32_array(r, ids);
-  roaring_bitmap_free(r); 
-  sqlite3_result_pointer(context, ids, "carray", (void*)roaringArrayFreeFunc);
+  rc = sqlite3_step(pCur->pScan);
+  if( rc == SQLITE_ROW ){
+    pCur->iId = sqlite3_column_int64(pCur->pScan, 0);
+    return SQLITE_OK;
+  }
+  pCur->bEof = 1;
+  return rc == SQLITE_DONE ? SQLITE_OK : rc;
 }
 
-
-static void roaring64ArrayFunc(
-  sqlite3_context *context,
+static int roaringChunkedFilter(
+  sqlite3_vtab_cursor *cur,
+  int idxNum,
+  const char *idxStr,
   int argc,
   sqlite3_value **argv
 ){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
-  roaring64_bitmap_t *r = roaring64_bitmap_portable_deserialize_safe(pIn, nIn);
-  if( r == NULL ){
-    sqlite3_result_error(context, "invalid bitmap", -1);
-    return;
+  RoaringChunkedCursor *pCur = (RoaringChunkedCursor*)cur;
+  RoaringChunkedVtab *p = (RoaringChunkedVtab*)cur->pVtab;
+  sqlite3_int64 iMin = 0, iMax = UINT32_MAX;
+  sqlite3_value *pId = NULL;
+  int iArg = 0;
+  int rc = SQLITE_OK;
+  int bExists = 0;
+  roaringChunkedReset(pCur);
+  if( (idxNum >> (ROARING_CHUNKED_SLOT_ID*4)) & 0xf ) pId = argv[iArg++];
+  for(int slot = ROARING_CHUNKED_SLOT_VALUE_MIN; slot <= ROARING_CHUNKED_SLOT_VALUE_MAX; slot++){
+    int op = (idxNum >> (slot*4)) & 0xf;
+    if( op == 0 ) continue;
+    if( !roaringEachBound(argv[iArg++], op, &iMin, &iMax) ) return SQLITE_OK;
   }
-  int nSize = roaring64_bitmap_get_cardinality(r);
-  uint64_t *ids;
-  ids = sqlite3_malloc(nSize * sizeof(uint64_t));
-  roaring64_bitmap_to_uint64_array(r, ids);
-  roaring64_bitmap_free(r); 
-  sqlite3_result_pointer(context, ids, "carray", (void*)roaring64ArrayFreeFunc);
+  pCur->iMin = (uint32_t)iMin;
+  pCur->iMax = (uint32_t)iMax;
+  if( (idxNum >> (ROARING_CHUNKED_SLOT_FILTER*4)) & 0xf ){
+    // filter = NULL matches nothing
+    if( sqlite3_value_type(argv[iArg]) == SQLITE_NULL && roaringValuePointer(argv[iArg]) == NULL ){
+      return SQLITE_OK;
+    }
+    pCur->pFilter = roaringValueDeserialize(argv[iArg]);
+    if( pCur->pFilter == NULL ) return roaringVtabError(&p->base, SQLITE_ERROR, "invalid bitmap");
+  }
+  if( pId != NULL ){
+    if( sqlite3_value_numeric_type(pId) != SQLITE_INTEGER ) return SQLITE_OK;
+    pCur->iId = sqlite3_value_int64(pId);
+    rc = roaringChunkedExists(p, pCur->iId, &bExists);
+    pCur->bEof = !bExists;
+    return rc;
+  }
+  rc = roaringVtabPrepare(&p->base, p->db, &pCur->pScan,
+    "SELECT id FROM \"%w\".\"%w_chunk\" GROUP BY id", p->zDb, p->zName);
+  if( rc != SQLITE_OK ) return rc;
+  pCur->bEof = 0;
+  return roaringChunkedNext(cur);
 }
 
+static int roaringChunkedEof(sqlite3_vtab_cursor *cur){
+  return ((RoaringChunkedCursor*)cur)->bEof;
+}
 
-/*********************************************
-  rb_count(bitmap)
-  --------------------------------------------
-  returns the cardinality of the bitmap
-*********************************************/
-static void roaringLengthFunc(
+static int roaringChunkedColumn(
+  sqlite3_vtab_cursor *cur,
   sqlite3_context *context,
-  int argc,
-  sqlite3_value **argv
+  int i
 ){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
-  roaring_bitmap_t *r = roaring_bitmap_deserialize_safe(pIn, nIn);
-  if( r == NULL ){
-    sqlite3_result_error(context, "invalid bitmap", -1);
-    return;
+  RoaringChunkedCursor *pCur = (RoaringChunkedCursor*)cur;
+  RoaringChunkedVtab *p = (RoaringChunkedVtab*)cur->pVtab;
+  roaring_bitmap_t *r;
+  int rc;
+  if( i == ROARING_CHUNKED_ID ){
+    sqlite3_result_int64(context, pCur->iId);
+  }else if( i == ROARING_CHUNKED_BITMAP ){
+    // an UPDATE that doesn't set the bitmap doesn't need to read it
+    if( sqlite3_vtab_nochange(context) ) return SQLITE_OK;
+    rc = roaringChunkedRead(p, pCur->iId, pCur->iMin, pCur->iMax, pCur->pFilter, &r);
+    if( rc != SQLITE_OK ) return rc;
+    roaringResultBlob(context, r);
+    roaring_bitmap_free(r);
   }
-  int nSize = roaring_bitmap_get_cardinality(r);
-  roaring_bitmap_free(r); 
-  sqlite3_result_int(context, nSize);
+  return SQLITE_OK;
 }
 
-static void roaring64LengthFunc(
-  sqlite3_context *context,
+static int roaringChunkedRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid){
+  *pRowid = ((RoaringChunkedCursor*)cur)->iId;
+  return SQLITE_OK;
+}
+
+/*
+  inserting a bitmap replaces the one with the same id, the op column turns
+  an insert into a change of a stored bitmap: 'add' and 'remove' a value,
+  or combine it with a bitmap using 'or', 'and', 'xor' or 'not' (and not)
+*/
+static int roaringChunkedUpdate(
+  sqlite3_vtab *pVtab,
   int argc,
-  sqlite3_value **argv
+  sqlite3_value **argv,
+  sqlite_int64 *pRowid
 ){
-  const unsigned char *pIn;
-  unsigned int nIn;  
-  pIn = sqlite3_value_blob(argv[0]);
-  nIn = sqlite3_value_bytes(argv[0]);
-  roaring64_bitmap_t *r = roaring64_bitmap_portable_deserialize_safe(pIn, nIn);
-  if( r == NULL ){
-    sqlite3_result_error(context, "invalid bitmap", -1);
-    return;
+  RoaringChunkedVtab *p = (RoaringChunkedVtab*)pVtab;
+  sqlite3_value *pBitmap;
+  sqlite3_int64 iId;
+  const char *zOp;
+  RoaringView v;
+  int op;
+  int rc;
+  if( argc == 1 ){
+    return roaringVtabExec(pVtab, p->db, "DELETE FROM \"%w\".\"%w_chunk\" WHERE id = %lld",
+      p->zDb, p->zName, sqlite3_value_int64(argv[0]));
   }
-  int64_t nSize = roaring64_bitmap_get_cardinality(r);
-  roaring64_bitmap_free(r); 
-  sqlite3_result_int64(context, nSize);
+  if( sqlite3_value_numeric_type(argv[2 + ROARING_CHUNKED_ID]) != SQLITE_INTEGER ){
+    return roaringVtabError(pVtab, SQLITE_MISMATCH, "id must be an integer");
+  }
+  iId = sqlite3_value_int64(argv[2 + ROARING_CHUNKED_ID]);
+  *pRowid = iId;
+  if( sqlite3_value_type(argv[0]) != SQLITE_NULL && sqlite3_value_int64(argv[0]) != iId ){
+    rc = roaringVtabExec(pVtab, p->db,
+      "DELETE FROM \"%w\".\"%w_chunk\" WHERE id = %lld;"
+      "UPDATE \"%w\".\"%w_chunk\" SET id = %lld WHERE id = %lld",
+      p->zDb, p->zName, iId, p->zDb, p->zName, iId, sqlite3_value_int64(argv[0]));
+    if( rc != SQLITE_OK ) return rc;
+  }
+  zOp = (const char*)sqlite3_value_text(argv[2 + ROARING_CHUNKED_OP]);
+  pBitmap = argv[2 + ROARING_CHUNKED_BITMAP];
+  if( zOp == NULL ){
+    if( sqlite3_value_nochange(pBitmap) ) return SQLITE_OK;
+    op = ROARING_CHUNKED_OP_REPLACE;
+  }else if( sqlite3_stricmp(zOp, "add") == 0 || sqlite3_stricmp(zOp, "remove") == 0 ){
+    sqlite3_int64 x = sqlite3_value_int64(argv[2 + ROARING_CHUNKED_VALUE]);
+    roaring_bitmap_t *pChunk;
+    int bChanged;
+    if( sqlite3_value_numeric_type(argv[2 + ROARING_CHUNKED_VALUE]) != SQLITE_INTEGER || x < 0 || x > UINT32_MAX ){
+      return roaringVtabError(pVtab, SQLITE_ERROR, "invalid argument");
+    }
+    rc = roaringChunkedGet(p, iId, (uint32_t)x >> 16, &pChunk);
+    if( rc != SQLITE_OK ) return rc;
+    if( pChunk == NULL && zOp[0] != 'a' && zOp[0] != 'A' ) return SQLITE_OK;
+    if( pChunk == NULL && (pChunk = roaring_bitmap_create()) == NULL ) return SQLITE_NOMEM;
+    if( zOp[0] == 'a' || zOp[0] == 'A' ){
+      bChanged = roaring_bitmap_add_checked(pChunk, (uint32_t)x);
+    }else{
+      bChanged = roaring_bitmap_remove_checked(pChunk, (uint32_t)x);
+    }
+    if( bChanged ) rc = roaringChunkedPut(p, iId, (uint32_t)x >> 16, pChunk);
+    roaring_bitmap_free(pChunk);
+    return rc;
+  }else if( sqlite3_stricmp(zOp, "or") == 0 ){
+    op = ROARING_CHUNKED_OP_OR;
+  }else if( sqlite3_stricmp(zOp, "and") == 0 ){
+    op = ROARING_CHUNKED_OP_AND;
+  }else if( sqlite3_stricmp(zOp, "xor") == 0 ){
+    op = ROARING_CHUNKED_OP_XOR;
+  }else if( sqlite3_stricmp(zOp, "not") == 0 ){
+    op = ROARING_CHUNKED_OP_NOT;
+  }else{
+    return roaringVtabError(pVtab, SQLITE_ERROR, "unknown op %s", zOp);
+  }
+  if( !roaringValueView(&v, pBitmap) ){
+    roaringViewFree(&v);
+    return roaringVtabError(pVtab, SQLITE_ERROR, "invalid bitmap");
+  }
+  rc = roaringChunkedApply(p, iId, v.rb, op);
+  roaringViewFree(&v);
+  return rc;
 }
 
+static sqlite3_module roaringChunkedModule = {
+  3,                         /* iVersion */
+  roaringChunkedCreate,      /* xCreate */
+  roaringChunkedConnect,     /* xConnect */
+  roaringChunkedBestIndex,   /* xBestIndex */
+  roaringChunkedDisconnect,  /* xDisconnect */
+  roaringChunkedDestroy,     /* xDestroy */
+  roaringChunkedOpen,        /* xOpen - open a cursor */
+  roaringChunkedClose,       /* xClose - close a cursor */
+  roaringChunkedFilter,      /* xFilter - configure scan constraints */
+  roaringChunkedNext,        /* xNext - advance a cursor */
+  roaringChunkedEof,         /* xEof - check for end of scan */
+  roaringChunkedColumn,      /* xColumn - read data */
+  roaringChunkedRowid,       /* xRowid - read data */
+  roaringChunkedUpdate,      /* xUpdate - write data */
+  0,                         /* xBegin */
+  0,                         /* xSync */
+  0,                         /* xCommit */
+  0,                         /* xRollback */
+  0,                         /* xFindFunction */
+  roaringChunkedRename,      /* xRename */
+  0,                         /* xSavepoint */
+  0,                         /* xRelease */
+  0,                         /* xRollbackTo */
+  roaringChunkedShadowName,  /* xShadowName */
+};
+
 #ifdef _WIN32
 __declspec(dllexport)
 #endif
@@ -1246,47 +8336,127 @@ int sqlite3_roaring_init(
   int rc = SQLITE_OK;
   SQLITE_EXTENSION_INIT2(pApi);
   int flags = SQLITE_UTF8 | SQLITE_INNOCUOUS | SQLITE_DETERMINISTIC;
+  RoaringConfig *pConfig;
+  roaringInitMemoryHook();
+  pConfig = sqlite3_malloc(sizeof(*pConfig));
+  if( pConfig == NULL ) return SQLITE_NOMEM;
+  memset(pConfig, 0, sizeof(*pConfig));
+  pConfig->nOptimizeMin = ROARING_OPTIMIZE_ALWAYS;
+  // the config lives as long as this function, i.e. until the connection closes
+  rc = sqlite3_create_function_v2(db, "rb_optimize_config", -1, SQLITE_UTF8 | SQLITE_DIRECTONLY, pConfig, roaringOptimizeConfigFunc, 0, 0, roaringConfigFree);
+  if( rc != SQLITE_OK ) return rc;
+  rc = sqlite3_create_function(db, "rb_cache_config", -1, SQLITE_UTF8 | SQLITE_DIRECTONLY, pConfig, roaringCacheConfigFunc, 0, 0);
+  if( rc != SQLITE_OK ) return rc;
   // Scalar SQL functions
-  rc = sqlite3_create_function(db, "rb_create", -1, flags, 0, roaringCreateFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb_count", 1, flags, 0, roaringLengthFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb_add", 2, flags, 0, roaringAddFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb_remove", 2, flags, 0, roaringRemoveFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb_and", 2, flags, 0, roaringAndFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb_or", 2, flags, 0, roaringOrFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb_not", 2, flags, 0, roaringNotFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb_xor", 2, flags, 0, roaringXorFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb_and_count", 2, flags, 0, roaringAndLengthFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb_or_count", 2, flags, 0, roaringOrLengthFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb_not_count", 2, flags, 0, roaringNotLengthFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb_xor_count", 2, flags, 0, roaringXorLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_create", -1, flags, pConfig, roaringCreateFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_from_json", 1, flags, pConfig, roaringFromJsonFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_from_carray", 2, flags, pConfig, roaringFromCarrayFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_from_int32_blob", 1, flags, pConfig, roaringFromBlobFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_count", 1, flags, pConfig, roaringLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_stats", 1, flags, pConfig, roaringStatsFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_add", 2, flags, pConfig, roaringAddFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_remove", 2, flags, pConfig, roaringRemoveFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_and", 2, flags, pConfig, roaringAndFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_or", 2, flags, pConfig, roaringOrFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_not", 2, flags, pConfig, roaringNotFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_xor", 2, flags, pConfig, roaringXorFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_and_count", 2, flags, pConfig, roaringAndLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_or_count", 2, flags, pConfig, roaringOrLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_not_count", 2, flags, pConfig, roaringNotLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_xor_count", 2, flags, pConfig, roaringXorLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_intersects", 2, flags, pConfig, roaringIntersectsFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_contains", 2, flags, pConfig, roaringContainsFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_contains_at", 4, SQLITE_UTF8 | SQLITE_DIRECTONLY, pConfig, roaringContainsAtFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_count_at", 3, SQLITE_UTF8 | SQLITE_DIRECTONLY, pConfig, roaringCountAtFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_contains_many", 2, flags, pConfig, roaringContainsManyFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_contains_many", 3, flags, pConfig, roaringContainsManyFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_min", 1, flags, pConfig, roaringMinFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_max", 1, flags, pConfig, roaringMaxFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_rank", 2, flags, pConfig, roaringRankFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_select", 2, flags, pConfig, roaringSelectFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_index_of", 2, flags, pConfig, roaringIndexOfFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_add_range", 3, flags, pConfig, roaringAddRangeFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_remove_range", 3, flags, pConfig, roaringRemoveRangeFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_clip", 3, flags, pConfig, roaringClipFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_range_count", 3, flags, pConfig, roaringRangeLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_intersects_range", 3, flags, pConfig, roaringIntersectsRangeFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_freeze", 1, flags, pConfig, roaringFreezeFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_ptr", 1, flags, pConfig, roaringPtrFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_cached", 3, flags, pConfig, roaringCachedPtrFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_cached", 4, flags, pConfig, roaringCachedPtrFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_blob", 1, flags, pConfig, roaringBlobFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_optimize", 1, flags, pConfig, roaringOptimizeFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_and_many", -1, flags, pConfig, roaringAndManyFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_or_many", -1, flags, pConfig, roaringOrManyFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_xor_many", -1, flags, pConfig, roaringXorManyFunc, 0, 0);
   // 64 bit versions
-  rc = sqlite3_create_function(db, "rb64_create", -1, flags, 0, roaring64CreateFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb64_count", 1, flags, 0, roaring64LengthFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb64_add", 2, flags, 0, roaring64AddFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb64_remove", 2, flags, 0, roaring64RemoveFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb64_and", 2, flags, 0, roaring64AndFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb64_or", 2, flags, 0, roaring64OrFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb64_not", 2, flags, 0, roaring64NotFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb64_xor", 2, flags, 0, roaring64XorFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb64_and_count", 2, flags, 0, roaring64AndLengthFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb64_or_count", 2, flags, 0, roaring64OrLengthFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb64_not_count", 2, flags, 0, roaring64NotLengthFunc, 0, 0);
-  rc = sqlite3_create_function(db, "rb64_xor_count", 2, flags, 0, roaring64XorLengthFunc, 0, 0);
-
-  //rc = sqlite3_create_function(db, "rb_and_many", -1, flags, 0, roaringAndManyFunc, 0, 0);
-  //rc = sqlite3_create_function(db, "rb_or_many", -1, flags, 0, roaringOrManyFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_create", -1, flags, pConfig, roaring64CreateFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_from_json", 1, flags, pConfig, roaring64FromJsonFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_from_carray", 2, flags, pConfig, roaring64FromCarrayFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_from_int64_blob", 1, flags, pConfig, roaring64FromBlobFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_count", 1, flags, pConfig, roaring64LengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_stats", 1, flags, pConfig, roaring64StatsFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_add", 2, flags, pConfig, roaring64AddFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_remove", 2, flags, pConfig, roaring64RemoveFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_and", 2, flags, pConfig, roaring64AndFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_or", 2, flags, pConfig, roaring64OrFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_not", 2, flags, pConfig, roaring64NotFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_xor", 2, flags, pConfig, roaring64XorFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_and_count", 2, flags, pConfig, roaring64AndLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_or_count", 2, flags, pConfig, roaring64OrLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_not_count", 2, flags, pConfig, roaring64NotLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_xor_count", 2, flags, pConfig, roaring64XorLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_intersects", 2, flags, pConfig, roaring64IntersectsFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_contains", 2, flags, pConfig, roaring64ContainsFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_contains_many", 2, flags, pConfig, roaring64ContainsManyFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_contains_many", 3, flags, pConfig, roaring64ContainsManyFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_min", 1, flags, pConfig, roaring64MinFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_max", 1, flags, pConfig, roaring64MaxFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_rank", 2, flags, pConfig, roaring64RankFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_select", 2, flags, pConfig, roaring64SelectFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_index_of", 2, flags, pConfig, roaring64IndexOfFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_add_range", 3, flags, pConfig, roaring64AddRangeFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_remove_range", 3, flags, pConfig, roaring64RemoveRangeFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_clip", 3, flags, pConfig, roaring64ClipFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_range_count", 3, flags, pConfig, roaring64RangeLengthFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_intersects_range", 3, flags, pConfig, roaring64IntersectsRangeFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_ptr", 1, flags, pConfig, roaring64PtrFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_cached", 3, flags, pConfig, roaring64CachedPtrFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_cached", 4, flags, pConfig, roaring64CachedPtrFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_blob", 1, flags, pConfig, roaring64BlobFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_optimize", 1, flags, pConfig, roaring64OptimizeFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_and_many", -1, flags, pConfig, roaring64AndManyFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_or_many", -1, flags, pConfig, roaring64OrManyFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_xor_many", -1, flags, pConfig, roaring64XorManyFunc, 0, 0);
+
   // aggregate SQL functions
-  rc = sqlite3_create_function(db, "rb_group_create", 1, flags, 0, 0, roaringCreateStep, roaringCreateFinal);
-  rc = sqlite3_create_function(db, "rb_group_and", 1, flags, 0, 0, roaringAndAllStep, roaringAndAllFinal);
-  rc = sqlite3_create_function(db, "rb_group_or", 1, flags, 0, 0, roaringOrAllStep, roaringOrAllFinal);
+  rc = sqlite3_create_window_function(db, "rb_group_create", 1, flags, pConfig, roaringCreateStep, roaringCreateFinal, roaringCreateValue, roaringCreateInverse, 0);
+  rc = sqlite3_create_function(db, "rb_group_and", 1, flags, pConfig, 0, roaringAndAllStep, roaringAndAllFinal);
+  rc = sqlite3_create_window_function(db, "rb_group_or", 1, flags, pConfig, roaringOrAllStep, roaringOrAllFinal, roaringOrAllValue, roaringOrAllInverse, 0);
   // 64 bit versions
-  rc = sqlite3_create_function(db, "rb64_group_create", 1, flags, 0, 0, roaring64CreateStep, roaring64CreateFinal);
-  rc = sqlite3_create_function(db, "rb64_group_and", 1, flags, 0, 0, roaring64AndAllStep, roaring64AndAllFinal);
-  rc = sqlite3_create_function(db, "rb64_group_or", 1, flags, 0, 0, roaring64OrAllStep, roaring64OrAllFinal);
+  rc = sqlite3_create_window_function(db, "rb64_group_create", 1, flags, pConfig, roaring64CreateStep, roaring64CreateFinal, roaring64CreateValue, roaring64CreateInverse, 0);
+  rc = sqlite3_create_function(db, "rb64_group_and", 1, flags, pConfig, 0, roaring64AndAllStep, roaring64AndAllFinal);
+  rc = sqlite3_create_window_function(db, "rb64_group_or", 1, flags, pConfig, roaring64OrAllStep, roaring64OrAllFinal, roaring64OrAllValue, roaring64OrAllInverse, 0);
 
   // carray based SQL functions (for conversion to a virtual table) 
-  rc = sqlite3_create_function(db, "rb_array", 1, flags, 0, roaringArrayFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_array", 1, flags, pConfig, roaringArrayFunc, 0, 0);
   // 64 bit version
-  rc = sqlite3_create_function(db, "rb64_array", 1, flags, 0, roaring64ArrayFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb64_array", 1, flags, pConfig, roaring64ArrayFunc, 0, 0);
+
+  // bit-sliced indexes
+  rc = sqlite3_create_function(db, "rb_bsi_build", 2, flags, pConfig, 0, roaringBsiBuildStep, roaringBsiBuildFinal);
+  rc = sqlite3_create_function(db, "rb_bsi_range", 3, flags, pConfig, roaringBsiRangeFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_bsi_range", 4, flags, pConfig, roaringBsiRangeFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_bsi_sum", 1, flags, pConfig, roaringBsiSumFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_bsi_sum", 2, flags, pConfig, roaringBsiSumFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_bsi_topk", 2, flags, pConfig, roaringBsiTopkFunc, 0, 0);
+  rc = sqlite3_create_function(db, "rb_bsi_topk", 3, flags, pConfig, roaringBsiTopkFunc, 0, 0);
+
+  // table valued functions
+  rc = sqlite3_create_module(db, "rb_each", &roaringEachModule, 0);
+  rc = sqlite3_create_module(db, "rb64_each", &roaring64EachModule, (void*)1);
+  // virtual tables
+  rc = sqlite3_create_module(db, "roaring_index", &roaringIndexModule, 0);
+  rc = sqlite3_create_module(db, "roaring_chunked", &roaringChunkedModule, 0);
   return rc;
 }
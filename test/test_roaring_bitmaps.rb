@@ -20,6 +20,69 @@ class TestRoaringBitmap < Minitest::Test
   end
   
 
+  def test_rb_from_json
+    result = DB.query_array("SELECT rb_count(rb_from_json('[5, 1, 3, 3]')), rb_count(rb_from_json('[]')), rb_range_count(rb_from_json('[10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 70000]'), 10, 19)").first
+    assert_equal [3, 0, 10], result
+  end
+
+  def test_rb64_from_json
+    result = DB.query_single_splat("SELECT rb64_count(rb64_from_json('[1, 5000000000, 1]'))")
+    assert_equal 2, result
+  end
+
+  def test_rb_from_int32_blob
+    result = DB.query_array("SELECT rb_count(rb_from_int32_blob(x'030000000100000070110100')), rb_max(rb_from_int32_blob(x'030000000100000070110100'))").first
+    assert_equal [3, 70000], result
+  end
+
+  def test_rb64_from_int64_blob
+    result = DB.query_single_splat("SELECT rb64_max(rb64_from_int64_blob(x'010000000000000000f2052a01000000'))")
+    assert_equal 5000000000, result
+  end
+
+  def test_rb_from_carray
+    result = DB.query_array("SELECT rb_count(rb_from_carray(rb_array(rb_create(1, 2, 70000)), 3)), rb64_count(rb64_from_carray(rb64_array(rb64_create(1, 5000000000)), 2))").first
+    assert_equal [3, 2], result
+  end
+
+  def test_rb_from_invalid
+    assert_raises do
+      DB.query_single_splat("SELECT rb_from_int32_blob(x'010203')")
+    end
+  end
+
+  def test_rb_stats
+    result = DB.query_array("WITH b AS (SELECT rb_add_range(rb_create(1, 70000), 200000, 299999) AS bm) SELECT json_extract(rb_stats(bm), '$.cardinality'), json_extract(rb_stats(bm), '$.n_run_containers'), json_extract(rb_stats(bm), '$.n_array_containers'), json_extract(rb_stats(bm), '$.max_value'), json_extract(rb_stats(rb_ptr(bm)), '$.n_run_containers'), json_extract(rb_stats(rb_create()), '$.min_value') FROM b").first
+    assert_equal [100002, 2, 2, 299999, 2, nil], result
+  end
+
+  def test_rb64_stats
+    result = DB.query_array("SELECT json_extract(rb64_stats(rb64_create(1, 5000000000)), '$.n_containers'), json_extract(rb64_stats(rb64_create(1, 5000000000)), '$.max_value')").first
+    assert_equal [2, 5000000000], result
+  end
+
+  def test_rb_count_container_layout
+    result = DB.query_single_splat("WITH RECURSIVE s(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM s WHERE x < 100000) SELECT rb_count(rb_group_create(x * 3)) FROM s")
+    assert_equal 100000, result
+  end
+
+  def test_rb64_count_many_buckets
+    result = DB.query_single_splat("SELECT rb64_count(rb64_create(1, 70000, 5000000000, 5000000001))")
+    assert_equal 4, result
+  end
+
+  def test_rb_count_invalid_bitmap
+    assert_raises do
+      DB.query_single_splat("SELECT rb_count(x'0204')")
+    end
+  end
+
+  def test_rb64_count_invalid_bitmap
+    assert_raises do
+      DB.query_single_splat("SELECT rb64_count(x'0100000000000000')")
+    end
+  end
+
   def test_rb_create_and_serialize
     id = DB.query_single_splat("INSERT INTO bitmaps VALUES (NULL, rb_create(4,5,6,7,8)) RETURNING id")
     result = DB.query_single_splat("DELETE FROM bitmaps WHERE id = ? RETURNING rb_count(bitmap) AS length", id)
@@ -46,6 +109,96 @@ class TestRoaringBitmap < Minitest::Test
     assert_equal 6, result
   end
 
+  def test_rb_and_many
+    result = DB.query_single_splat("SELECT rb_count(rb_and_many(rb_create(1,2,3,4), rb_create(2,3,4), NULL, rb_create(3,4,5)))")
+    assert_equal 2, result
+  end
+
+  def test_rb64_and_many
+    result = DB.query_single_splat("SELECT rb64_count(rb64_and_many(rb64_create(1,2,3,4), rb64_create(2,3,4), NULL, rb64_create(3,4,5)))")
+    assert_equal 2, result
+  end
+
+  def test_rb_or_many
+    result = DB.query_single_splat("SELECT rb_count(rb_or_many(rb_create(1,2), rb_create(2,3), rb_create(70000)))")
+    assert_equal 4, result
+  end
+
+  def test_rb64_or_many
+    result = DB.query_single_splat("SELECT rb64_count(rb64_or_many(rb64_create(1,2), rb64_create(2,3), rb64_create(5000000000)))")
+    assert_equal 4, result
+  end
+
+  def test_rb_xor_many
+    result = DB.query_single_splat("SELECT rb_count(rb_xor_many(rb_create(1,2), rb_create(2,3), rb_create(3,4)))")
+    assert_equal 2, result
+  end
+
+  def test_rb64_xor_many
+    result = DB.query_single_splat("SELECT rb64_count(rb64_xor_many(rb64_create(1,2), rb64_create(2,3), rb64_create(3,4)))")
+    assert_equal 2, result
+  end
+
+  def test_rb_optimize
+    values = (1..20).to_a.join(",")
+    DB.query_single_splat("SELECT rb_optimize_config('never')")
+    before = DB.query_single_splat("SELECT length(rb_create(#{values}))")
+    after = DB.query_single_splat("SELECT length(rb_optimize(rb_create(#{values})))")
+    count = DB.query_single_splat("SELECT rb_count(rb_optimize(rb_create(#{values})))")
+    DB.query_single_splat("SELECT rb_optimize_config('always')")
+    assert_operator after, :<, before
+    assert_equal 20, count
+  end
+
+  def test_rb64_optimize
+    values = (1..20).to_a.join(",")
+    DB.query_single_splat("SELECT rb_optimize_config('never')")
+    before = DB.query_single_splat("SELECT length(rb64_create(#{values}))")
+    after = DB.query_single_splat("SELECT length(rb64_optimize(rb64_create(#{values})))")
+    count = DB.query_single_splat("SELECT rb64_count(rb64_optimize(rb64_create(#{values})))")
+    DB.query_single_splat("SELECT rb_optimize_config('always')")
+    assert_operator after, :<, before
+    assert_equal 20, count
+  end
+
+  def test_rb_optimize_config
+    values = (1..20).to_a.join(",")
+    assert_equal "always", DB.query_single_splat("SELECT rb_optimize_config()")
+    optimized = DB.query_single_splat("SELECT length(rb_create(#{values}))")
+    assert_equal 1000, DB.query_single_splat("SELECT rb_optimize_config(1000)")
+    skipped = DB.query_single_splat("SELECT length(rb_create(#{values}))")
+    assert_equal "always", DB.query_single_splat("SELECT rb_optimize_config('always')")
+    assert_operator optimized, :<, skipped
+  end
+
+  def test_rb_cached
+    DB.execute("CREATE TABLE cached(id INTEGER PRIMARY KEY, bitmap BLOB)")
+    DB.execute("INSERT INTO cached VALUES (1, rb_create(1,2,3)), (2, rb_create(3,4,5,6))")
+    query = "SELECT rb_count(rb_cached('cached', id, bitmap)), rb_and_count(rb_cached('cached', id, bitmap), rb_create(3)) FROM cached ORDER BY id"
+    assert_equal [[3, 1], [4, 1]], DB.query_array(query)
+    assert_equal 1 << 20, DB.query_single_splat("SELECT rb_cache_config(1 << 20)")
+    assert_equal [[3, 1], [4, 1]], DB.query_array(query)
+    assert_equal [[3, 1], [4, 1]], DB.query_array(query)
+    DB.execute("UPDATE cached SET bitmap = rb_create(7,8,9) WHERE id = 1")
+    assert_equal [[3, 0], [4, 1]], DB.query_array(query)
+    assert_equal 6, DB.query_single_splat("SELECT rb_count(rb_or(rb_cached('Cached', id, bitmap), rb_create(1,2))) FROM cached WHERE id = 2")
+    # same sized bitmaps of two columns, with and without the column name
+    DB.execute("ALTER TABLE cached ADD COLUMN other BLOB")
+    DB.execute("UPDATE cached SET other = rb_create(4,5,6) WHERE id = 1")
+    assert_equal [7, 4, 7, 4], DB.query_array("SELECT rb_min(rb_cached('cached', id, bitmap)), rb_min(rb_cached('cached', id, other)), rb_min(rb_cached('main.cached', 'bitmap', id, bitmap)), rb_min(rb_cached('main.cached', 'other', id, other)) FROM cached WHERE id = 1").first
+    # a cache that holds a single bitmap, both arguments stay valid while the first is evicted
+    DB.query_single_splat("SELECT rb_cache_config(24)")
+    assert_equal [[3, 0], [4, 1]], DB.query_array(query)
+    assert_equal 0, DB.query_single_splat("SELECT rb_and_count(rb_cached('cached', 1, bitmap), rb_cached('cached', 2, (SELECT bitmap FROM cached WHERE id = 2))) FROM cached WHERE id = 1")
+    assert_equal 4, DB.query_single_splat("SELECT rb64_count(rb64_cached('cached', 1, rb64_create(1,2,3,4)))")
+    assert_equal 0, DB.query_single_splat("SELECT rb_cache_config('off')")
+    assert_equal [[3, 0], [4, 1]], DB.query_array(query)
+    assert_raises(Extralite::Error) { DB.query_single_splat("SELECT rb_cached('cached', NULL, rb_create(1))") }
+  ensure
+    DB.query_single_splat("SELECT rb_cache_config(0)")
+    DB.execute("DROP TABLE IF EXISTS cached")
+  end
+
   def test_rb_group_create
     result = DB.query_single_splat("SELECT rb_count(rb_group_create(value)) FROM JSON_EACH('[1,2,3,4,5]')")
     assert_equal 5, result
@@ -56,6 +209,22 @@ class TestRoaringBitmap < Minitest::Test
     assert_equal 5, result
   end
 
+  def test_rb_group_create_runs
+    values = "[7,8,9,3,70000,70001,70001,4,5,100,9]"
+    result = DB.query_single_splat("SELECT rb_xor_count(rb_group_create(value), rb_create(3,4,5,7,8,9,100,70000,70001)) FROM JSON_EACH('#{values}')")
+    assert_equal 0, result
+    result = DB.query_single_splat("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x < 100000) SELECT rb_count(rb_group_create(x)) FROM c")
+    assert_equal 100000, result
+  end
+
+  def test_rb64_group_create_runs
+    values = "[7,8,9,3,5000000000,5000000001,5000000001,4,5,100,9]"
+    result = DB.query_single_splat("SELECT rb64_xor_count(rb64_group_create(value), rb64_create(3,4,5,7,8,9,100,5000000000,5000000001)) FROM JSON_EACH('#{values}')")
+    assert_equal 0, result
+    result = DB.query_single_splat("WITH RECURSIVE c(x) AS (SELECT 4294967290 UNION ALL SELECT x+1 FROM c WHERE x < 4295067289) SELECT rb64_count(rb64_group_create(x)) FROM c")
+    assert_equal 100000, result
+  end
+
 
   def test_rb_add
     result = DB.query_single_splat("SELECT rb_count(rb_add(rb_create(1,2,3,4), 5))")
@@ -157,6 +326,115 @@ class TestRoaringBitmap < Minitest::Test
     assert_equal 6, result
   end
 
+  def test_rb_intersects
+    result = DB.query_array("SELECT rb_intersects(rb_create(1,2,3), rb_create(3,70000)), rb_intersects(rb_create(1,2,3), rb_create(70000)), rb_intersects(rb_create(1,2,3), rb_create(4,5)), rb_intersects(rb_freeze(rb_create(1,70000)), rb_create(70000))").first
+    assert_equal [1, 0, 0, 1], result
+  end
+
+  def test_rb64_intersects
+    result = DB.query_array("SELECT rb64_intersects(rb64_create(1,2,3), rb64_create(3,5000000000)), rb64_intersects(rb64_create(1,2,3), rb64_create(5000000000)), rb64_intersects(rb64_create(1,2,3), rb64_create(4,5)), rb64_intersects(rb64_ptr(rb64_create(1,5000000000)), rb64_create(5000000000))").first
+    assert_equal [1, 0, 0, 1], result
+  end
+
+  def test_rb_contains
+    result = DB.query_array("SELECT rb_contains(rb_create(1,2,70000), 70000), rb_contains(rb_create(1,2,70000), 3), rb_contains(rb_freeze(rb_create(1,2,3)), 2), rb_contains(rb_ptr(rb_create(1,2,3)), 4)").first
+    assert_equal [1, 0, 1, 0], result
+  end
+
+  def test_rb_contains_out_of_range
+    result = DB.query_array("SELECT rb_contains(rb_create(1), 4294967297), rb_contains(rb_create(4294967295), -1), rb_contains(rb_ptr(rb_create(4294967295)), -1), rb_contains(rb_create(4294967295), 4294967295)").first
+    assert_equal [0, 0, 0, 1], result
+  end
+
+  def test_rb_contains_containers
+    # bitset (multiples of 3) and run containers, probed from the serialized bytes
+    result = DB.query_array("WITH RECURSIVE s(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM s WHERE x < 300000), b AS (SELECT rb_group_create(x * 3) AS bitset, rb_group_create(x) FILTER (WHERE x % 1000 < 500) AS runs FROM s) SELECT rb_contains(bitset, 300), rb_contains(bitset, 301), rb_contains(runs, 250499), rb_contains(runs, 250500) FROM b").first
+    assert_equal [1, 0, 1, 0], result
+  end
+
+  def test_rb_contains_at
+    # array, run, bitset and frozen bitmaps read through incremental blob i/o
+    DB.execute("WITH RECURSIVE s(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM s WHERE x < 300000) INSERT INTO bitmaps(bitmap) SELECT rb_create(1,2,70000) UNION ALL SELECT rb_group_create(x) FILTER (WHERE x % 1000 < 500) FROM s UNION ALL SELECT rb_group_create(x * 3) FROM s UNION ALL SELECT rb_freeze(rb_group_create(x * 3) FILTER (WHERE x % 7 < 3)) FROM s")
+    result = DB.query_array("SELECT sum(rb_contains_at('bitmaps', 'bitmap', id, v) = rb_contains(bitmap, v)), sum(rb_count_at('bitmaps', 'bitmap', id) = rb_count(bitmap)) FROM bitmaps, (WITH RECURSIVE p(v) AS (SELECT 0 UNION ALL SELECT v + 4999 FROM p WHERE v < 900000) SELECT v FROM p)")
+    missing = assert_raises(Extralite::Error) { DB.query_single_splat("SELECT rb_count_at('bitmaps', 'bitmap', -1)") }
+    out_of_range = DB.query_array("SELECT rb_contains_at('bitmaps', 'bitmap', min(id), 4294967296), rb_contains_at('bitmaps', 'bitmap', min(id), -1) FROM bitmaps")
+    DB.execute("DELETE FROM bitmaps")
+    assert_equal [[4 * 182, 4 * 182]], result
+    assert_equal [[0, 0]], out_of_range
+    assert_match(/no such rowid/, missing.message)
+  end
+
+  def test_rb64_contains
+    result = DB.query_array("SELECT rb64_contains(rb64_create(1,5000000000), 5000000000), rb64_contains(rb64_create(1,5000000000), 705032704), rb64_contains(rb64_ptr(rb64_create(1,2)), 2)").first
+    assert_equal [1, 0, 1], result
+  end
+
+  def test_rb_contains_many
+    result = DB.query_array("SELECT rb_contains_many(rb_create(1,2,70000), '[70000, 2, 5, 2]'), rb_contains_many(rb_create(1,2,3), '[]'), rb_contains_many(rb_create(1,2,3), rb_array(rb_create(3,4,1)), 3), rb_contains_many(rb_freeze(rb_create(1,2,3)), '[3, 1]')").first
+    assert_equal [2, 0, 2, 2], result
+  end
+
+  def test_rb_contains_many_out_of_range
+    result = DB.query_array("SELECT rb_contains_many(rb_create(1), '[4294967297]'), rb_contains_many(rb_create(1,4294967295), '[1, -1, 4294967295, 4294967297]'), rb_contains_many(rb_freeze(rb_create(4294967295)), '[-1]')").first
+    assert_equal [0, 2, 0], result
+  end
+
+  def test_rb64_contains_many
+    result = DB.query_array("SELECT rb64_contains_many(rb64_create(1,5000000000), '[5000000000, 1, 7]'), rb64_contains_many(rb64_create(1,5000000000), rb64_array(rb64_create(1,5000000000)), 2)").first
+    assert_equal [2, 2], result
+  end
+
+  def test_rb_contains_many_invalid
+    assert_raises do
+      DB.query_single_splat("SELECT rb_contains_many(rb_create(1,2,3), '[1.5]')")
+    end
+  end
+
+  def test_rb_min_max
+    result = DB.query_array("SELECT rb_min(rb_create(7,3,70000)), rb_max(rb_create(7,3,70000)), rb_min(rb_create()), rb_max(rb_ptr(rb_create(1,2)))").first
+    assert_equal [3, 70000, nil, 2], result
+  end
+
+  def test_rb_rank_select_index_of
+    result = DB.query_array("WITH RECURSIVE s(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM s WHERE x < 100000), b AS (SELECT rb_group_create(x * 2) AS bm FROM s) SELECT rb_rank(bm, 1001), rb_select(bm, 499), rb_select(bm, 100000), rb_index_of(bm, 1000), rb_index_of(bm, 1001) FROM b").first
+    assert_equal [500, 1000, nil, 499, -1], result
+  end
+
+  def test_rb_rank_index_of_out_of_range
+    result = DB.query_array("SELECT rb_rank(rb_create(0,1,4294967295), -1), rb_rank(rb_create(0,1,4294967295), 4294967296), rb_index_of(rb_create(0,1,4294967295), 4294967296), rb_index_of(rb_freeze(rb_create(0,1,4294967295)), -4294967295), rb_index_of(rb_create(0,1,4294967295), 4294967295)").first
+    assert_equal [0, 3, -1, -1, 2], result
+  end
+
+  def test_rb64_min_max
+    result = DB.query_array("SELECT rb64_min(rb64_create(7,5000000000)), rb64_max(rb64_create(7,5000000000)), rb64_min(rb64_create())").first
+    assert_equal [7, 5000000000, nil], result
+  end
+
+  def test_rb64_rank_select_index_of
+    result = DB.query_array("SELECT rb64_rank(rb64_create(1,2,5000000000), 5000000000), rb64_select(rb64_create(1,2,5000000000), 2), rb64_index_of(rb64_create(1,2,5000000000), 2), rb64_index_of(rb64_create(1,2), 3)").first
+    assert_equal [3, 5000000000, 1, -1], result
+  end
+
+  def test_rb_add_remove_range
+    result = DB.query_array("SELECT rb_count(rb_add_range(rb_create(1), 100, 199)), rb_count(rb_remove_range(rb_add_range(rb_create(), 0, 99999), 10, 70009)), rb_count(rb_add_range(rb_create(1), 5, 1))").first
+    assert_equal [101, 30000, 1], result
+  end
+
+  def test_rb_range_count
+    result = DB.query_array("WITH b AS (SELECT rb_add_range(rb_create(), 1000, 199999) AS bm) SELECT rb_range_count(bm, 0, 1000), rb_range_count(bm, 100000, 300000), rb_range_count(rb_ptr(bm), 100000, 300000), rb_intersects_range(bm, 0, 999), rb_intersects_range(bm, 199999, 5000000000) FROM b").first
+    assert_equal [1, 100000, 100000, 0, 1], result
+  end
+
+  def test_rb_clip
+    result = DB.query_array("SELECT rb_count(rb_clip(rb_add_range(rb_create(), 0, 199999), 65536, 131071)), rb_min(rb_clip(rb_create(1, 5, 70000), 2, 70000)), rb_count(rb_clip(rb_create(1, 2), 3, 4))").first
+    assert_equal [65536, 5, 0], result
+  end
+
+  def test_rb64_ranges
+    result = DB.query_array("SELECT rb64_count(rb64_add_range(rb64_create(1), 4999999999, 5000000002)), rb64_count(rb64_remove_range(rb64_create(1, 5000000000, 9000000000), 0, 5000000000)), rb64_range_count(rb64_create(1, 5000000000, 9000000000), 2, 5000000000), rb64_intersects_range(rb64_create(1, 9000000000), 2, 8999999999), rb64_count(rb64_clip(rb64_create(1, 5000000000, 9000000000), 2, 9000000000))").first
+    assert_equal [5, 1, 1, 0, 2], result
+  end
+
   def test_rb_not
     result = DB.query_single_splat("SELECT rb_count(rb_not(rb_create(1,2,3,4), rb_create(2,6,7,8)))")
     assert_equal 3, result
@@ -189,6 +467,232 @@ class TestRoaringBitmap < Minitest::Test
   end
 
 
+  def test_rb_freeze
+    result = DB.query_single_splat("SELECT rb_count(rb_freeze(rb_create(1,2,3,70000)))")
+    assert_equal 4, result
+    # the frozen data is padded to start 8 bytes in
+    assert_equal "03" + "00" * 7, DB.query_single_splat("SELECT hex(substr(rb_freeze(rb_create(1)), 1, 8))")
+  end
+
+  def test_rb_freeze_read_only_functions
+    DB.execute("INSERT INTO bitmaps(bitmap) VALUES (rb_freeze(rb_create(1,2,3,4))), (rb_freeze(rb_create(2,6,7,8)))")
+    result = DB.query_array("SELECT rb_and_count(a.bitmap, b.bitmap), rb_or_count(a.bitmap, b.bitmap), rb_xor_count(a.bitmap, b.bitmap), rb_not_count(a.bitmap, b.bitmap) FROM bitmaps a, bitmaps b WHERE a.id < b.id")
+    DB.execute("DELETE FROM bitmaps")
+    assert_equal [[1, 7, 6, 3]], result
+  end
+
+  def test_rb_freeze_modify
+    result = DB.query_single_splat("SELECT rb_count(rb_add(rb_freeze(rb_create(1,2,3,4)), 5))")
+    assert_equal 5, result
+  end
+
+  def test_rb_freeze_array
+    result = DB.query_single_splat("SELECT sum(value) FROM carray(rb_array(rb_freeze(rb_create(1, 10, 100, 1000))), 4)")
+    assert_equal 1111, result
+  end
+
+  def test_rb_and_count_constant_argument
+    DB.execute("INSERT INTO bitmaps(bitmap) VALUES (rb_create(1,2,3,4)), (rb_create(4)), (rb_freeze(rb_create(4,7)))")
+    filter = DB.query_single_splat("SELECT rb_create(2,4,7)")
+    result = DB.query_splat("SELECT rb_and_count(bitmap, ?) FROM bitmaps ORDER BY id", filter)
+    frozen = DB.query_splat("SELECT rb_count(rb_or(rb_freeze(rb_create(9)), bitmap)) FROM bitmaps ORDER BY id")
+    DB.execute("DELETE FROM bitmaps")
+    assert_equal [2, 1, 2], result
+    assert_equal [5, 2, 3], frozen
+  end
+
+  def test_rb_and_count_growing_arguments
+    sets = [10, 1000, 20000, 100000, 30].map { |n| (0...n).map { |i| i * 37 % 5000000 } }
+    sets.each { |s| DB.execute("INSERT INTO bitmaps(bitmap) VALUES (rb_from_json(?))", "[#{s.join(",")}]") }
+    filter = (0...50000).map { |i| i * 11 }
+    result = DB.query_splat("SELECT rb_and_count(bitmap, rb_from_json(?)) FROM bitmaps ORDER BY id", "[#{filter.join(",")}]")
+    DB.execute("DELETE FROM bitmaps")
+    assert_equal sets.map { |s| (s & filter).size }, result
+  end
+
+  def test_rb64_and_count_constant_argument
+    DB.execute("INSERT INTO bitmaps(bitmap) VALUES (rb64_create(1,2,3,4)), (rb64_create(4)), (rb64_create(4,7))")
+    filter = DB.query_single_splat("SELECT rb64_create(2,4,7)")
+    result = DB.query_splat("SELECT rb64_and_count(?, bitmap) FROM bitmaps ORDER BY id", filter)
+    DB.execute("DELETE FROM bitmaps")
+    assert_equal [2, 1, 2], result
+  end
+
+  def test_rb_ptr
+    result = DB.query_single_splat("SELECT rb_count(rb_and(rb_or(rb_ptr(rb_create(1,2,3)), rb_create(4,5)), rb_create(1,5,9)))")
+    assert_equal 2, result
+  end
+
+  def test_rb64_ptr
+    result = DB.query_single_splat("SELECT rb64_count(rb64_and(rb64_or(rb64_ptr(rb64_create(1,2,3)), rb64_create(4,5)), rb64_create(1,5,9)))")
+    assert_equal 2, result
+  end
+
+  def test_rb_blob_leaves_pointer_unchanged
+    # rb_blob compacts a copy, the cached bitmap is still being iterated
+    values = (1..20).to_a.join(",")
+    DB.query_single_splat("SELECT rb_optimize_config('never')")
+    DB.execute("CREATE TABLE shared(id INTEGER PRIMARY KEY, bitmap BLOB)")
+    DB.execute("INSERT INTO shared VALUES (1, rb_create(#{values}))")
+    DB.query_single_splat("SELECT rb_optimize_config('always')")
+    DB.query_single_splat("SELECT rb_cache_config(1 << 20)")
+    result = DB.query_array("SELECT count(*), max(length(rb_blob(rb_cached('shared', 1 + 0 * e.value, s.bitmap)))) < length(s.bitmap) FROM shared AS s, rb_each(rb_cached('shared', 1, s.bitmap)) AS e")
+    assert_equal [[20, 1]], result
+  ensure
+    DB.query_single_splat("SELECT rb_optimize_config('always')")
+    DB.query_single_splat("SELECT rb_cache_config(0)")
+    DB.execute("DROP TABLE IF EXISTS shared")
+  end
+
+  def test_rb_ptr_is_null_without_rb_blob
+    result = DB.query_array("SELECT rb_add(rb_ptr(rb_create(1)), 2), rb_count(rb_blob(rb_add(rb_ptr(rb_create(1)), 2)))")
+    assert_equal [[nil, 2]], result
+  end
+
+  def test_rb64_ptr_is_null_without_rb64_blob
+    result = DB.query_array("SELECT rb64_add(rb64_ptr(rb64_create(1)), 2), rb64_count(rb64_blob(rb64_add(rb64_ptr(rb64_create(1)), 2)))")
+    assert_equal [[nil, 2]], result
+  end
+
+  def test_rb_bsi
+    DB.execute("CREATE TABLE prices(id INTEGER PRIMARY KEY, price INTEGER)")
+    DB.execute("INSERT INTO prices VALUES (1, 30), (2, -5), (3, 12), (4, NULL), (5, 30), (70000, 7)")
+    bsi = DB.query_single_splat("SELECT rb_bsi_build(id, price) FROM prices")
+    ranges = DB.query_array("SELECT (SELECT group_concat(value) FROM rb_each(rb_bsi_range(?1, '>=', 12))), (SELECT group_concat(value) FROM rb_each(rb_bsi_range(?1, '<', 7))), (SELECT group_concat(value) FROM rb_each(rb_bsi_range(?1, 'between', 0, 12))), (SELECT group_concat(value) FROM rb_each(rb_bsi_range(?1, '!=', 30)))", bsi).first
+    sums = DB.query_array("SELECT rb_bsi_sum(?1), rb_bsi_sum(?1, rb_create(2, 3, 4)), rb_bsi_sum(?1, rb_create(4))", bsi).first
+    topk = DB.query_array("SELECT (SELECT group_concat(value) FROM rb_each(rb_bsi_topk(?1, 1))), (SELECT group_concat(value) FROM rb_each(rb_bsi_topk(?1, rb_create(2, 3, 70000), 2)))", bsi).first
+    DB.execute("DROP TABLE prices")
+    assert_equal ["1,3,5", "2", "3,70000", "2,3,70000"], ranges
+    assert_equal [74, 7, nil], sums
+    assert_equal ["1", "3,70000"], topk
+    assert_raises(Extralite::Error) { DB.query_single_splat("SELECT rb_bsi_sum(rb_create(1))") }
+  end
+
+  def test_rb_bsi_sum_overflow
+    result = DB.query_array("SELECT rb_bsi_sum(rb_bsi_build(column1, column2)) FROM (VALUES (1, -9223372036854775808), (2, 9223372036854775807))").first
+    assert_equal [-1], result
+    result = DB.query_array("SELECT rb_bsi_sum(rb_bsi_build(column1, column2)) FROM (VALUES (1, -9223372036854775808), (2, 9223372036854775807), (3, 0), (4, -1))").first
+    assert_equal [-2], result
+    assert_raises(Extralite::Error) { DB.query_single_splat("SELECT rb_bsi_sum(rb_bsi_build(column1, column2)) FROM (VALUES (1, 9223372036854775807), (2, 1))") }
+    assert_raises(Extralite::Error) { DB.query_single_splat("SELECT rb_bsi_sum(rb_bsi_build(column1, column2)) FROM (VALUES (1, -9223372036854775808), (2, -1))") }
+  end
+
+  def test_rb_each
+    result = DB.query_splat("SELECT value FROM rb_each(rb_create(1000, 1, 10, 100, 70000))")
+    assert_equal [1, 10, 100, 1000, 70000], result
+  end
+
+  def test_rb64_each
+    result = DB.query_splat("SELECT value FROM rb64_each(rb64_create(1000, 1, 10, 100, 5000000000))")
+    assert_equal [1, 10, 100, 1000, 5000000000], result
+  end
+
+  def test_rb_each_limit
+    result = DB.query_single_splat("SELECT sum(value) FROM (SELECT value FROM rb_each(rb_freeze(rb_create(1, 2, 3, 4, 5))) LIMIT 3)")
+    assert_equal 6, result
+  end
+
+  def test_rb_each_range
+    result = DB.query_splat("SELECT value FROM rb_each(rb_create(1, 10, 100, 1000, 70000)) WHERE value > 10 AND value <= 1000")
+    assert_equal [100, 1000], result
+  end
+
+  def test_rb64_each_range
+    result = DB.query_splat("SELECT value FROM rb64_each(rb64_create(1, 10, 100, 1000, 5000000000)) WHERE value BETWEEN 100 AND 5000000000")
+    assert_equal [100, 1000, 5000000000], result
+  end
+
+  def test_rb_each_rank
+    result = DB.query_array("SELECT value, rank FROM rb_each(rb_create(1, 10, 100, 1000, 70000)) WHERE rank > 2 LIMIT 2")
+    assert_equal [[100, 3], [1000, 4]], result
+  end
+
+  def test_rb_each_containers
+    runs = DB.query_array("SELECT value, rank FROM rb_each(rb_optimize(rb_add_range(rb_create(5, 70000), 131072, 140000))) WHERE value > 70000 LIMIT 2")
+    bitset = DB.query_array("SELECT count(*), min(value), max(rank) FROM rb_each(rb_add_range(rb_create(5), 200000, 210000)) WHERE value >= 205000")
+    assert_equal [[131072, 3], [131073, 4]], runs
+    assert_equal [[5001, 205000, 10002]], bitset
+    assert_raises(Extralite::Error) { DB.query_splat("SELECT value FROM rb_each(x'0200')") }
+  end
+
+  def test_rb64_each_rank
+    result = DB.query_array("SELECT value, rank FROM rb64_each(rb64_create(1, 10, 100, 1000, 5000000000)) WHERE value >= 1000")
+    assert_equal [[1000, 4], [5000000000, 5]], result
+  end
+
+  def test_rb_each_join
+    DB.execute("INSERT INTO bitmaps(bitmap) VALUES (rb_create(1,2,3,4)), (rb_create(4)), (rb_create(4,7))")
+    result = DB.query_splat("SELECT count(*) FROM bitmaps, rb_each(bitmaps.bitmap) GROUP BY bitmaps.id ORDER BY bitmaps.id")
+    DB.execute("DELETE FROM bitmaps")
+    assert_equal [4, 1, 2], result
+  end
+
+  def test_roaring_index
+    DB.execute("CREATE TABLE books(id INTEGER PRIMARY KEY, genre TEXT)")
+    DB.execute("INSERT INTO books(genre) VALUES ('poetry'), ('drama'), ('poetry'), (NULL)")
+    DB.execute("CREATE VIRTUAL TABLE books_genre USING roaring_index(books, genre)")
+    query = "SELECT value, (SELECT group_concat(value) FROM rb_each(g.bitmap)) FROM books_genre AS g ORDER BY value"
+    assert_equal [["drama", "2"], ["poetry", "1,3"]], DB.query_array(query)
+    DB.execute("INSERT INTO books(genre) VALUES ('essay')")
+    DB.execute("UPDATE books SET genre = 'essay' WHERE id = 2")
+    DB.execute("DELETE FROM books WHERE id = 1")
+    assert_equal [["essay", "2,5"], ["poetry", "3"]], DB.query_array(query)
+    assert_equal 2, DB.query_single_splat("SELECT rb_count(bitmap) FROM books_genre WHERE value = 'essay'")
+    assert_nil DB.query_single_splat("SELECT bitmap FROM books_genre WHERE value = 'drama'")
+    assert_equal 2, DB.query_single_splat("SELECT count(*) FROM books_genre_data")
+    DB.execute("BEGIN")
+    DB.execute("DELETE FROM books")
+    assert_equal [], DB.query_array(query)
+    DB.execute("ROLLBACK")
+    assert_equal [["essay", "2,5"], ["poetry", "3"]], DB.query_array(query)
+    DB.execute("DROP TABLE books_genre")
+    DB.execute("INSERT INTO books(genre) VALUES ('drama')")
+    assert_equal 0, DB.query_single_splat("SELECT count(*) FROM sqlite_master WHERE name LIKE 'books_genre%'")
+    DB.execute("DROP TABLE books")
+  end
+
+  def test_roaring_index_replace
+    DB.execute("CREATE TABLE books(id INTEGER PRIMARY KEY, genre TEXT)")
+    DB.execute("CREATE VIRTUAL TABLE books_genre USING roaring_index(books, genre)")
+    DB.execute("INSERT INTO books VALUES (1, 'poetry'), (2, 'drama'), (3, 'drama')")
+    DB.execute("INSERT OR REPLACE INTO books VALUES (1, 'drama')")
+    DB.execute("INSERT OR REPLACE INTO books VALUES (3, NULL)")
+    DB.execute("INSERT OR IGNORE INTO books VALUES (2, 'poetry')")
+    DB.execute("INSERT INTO books VALUES (2, 'essay') ON CONFLICT(id) DO NOTHING")
+    query = "SELECT value, (SELECT group_concat(value) FROM rb_each(g.bitmap)) FROM books_genre AS g ORDER BY value"
+    assert_equal [["drama", "1,2"]], DB.query_array(query)
+    DB.execute("PRAGMA trusted_schema = OFF")
+    DB.execute("INSERT INTO books VALUES (4, 'essay')")
+    DB.execute("PRAGMA trusted_schema = ON")
+    assert_equal [["drama", "1,2"], ["essay", "4"]], DB.query_array(query)
+    DB.execute("DROP TABLE books_genre")
+    DB.execute("DROP TABLE books")
+  end
+
+  def test_roaring_chunked
+    DB.execute("CREATE VIRTUAL TABLE segments USING roaring_chunked")
+    DB.execute("INSERT INTO segments(id, bitmap) VALUES (1, rb_create(1, 2, 70000, 200000))")
+    query = "SELECT (SELECT group_concat(value) FROM rb_each(s.bitmap)) FROM segments AS s WHERE id = 1"
+    assert_equal "1,2,70000,200000", DB.query_single_splat(query)
+    assert_equal [[0, 2], [1, 1], [3, 1]], DB.query_array("SELECT key, rb_count(chunk) FROM segments_chunk ORDER BY key")
+    DB.execute("INSERT INTO segments(id, op, value) VALUES (1, 'add', 3), (1, 'remove', 200000)")
+    DB.execute("INSERT INTO segments(id, op, bitmap) VALUES (1, 'or', rb_create(4, 300000)), (1, 'not', rb_create(1))")
+    assert_equal "2,3,4,70000,300000", DB.query_single_splat(query)
+    assert_equal "3,4,70000", DB.query_single_splat(query + " AND value BETWEEN 3 AND 70000")
+    assert_equal "2,300000", DB.query_single_splat(query + " AND filter = rb_create(2, 5, 300000)")
+    # value and filter taken from a table joined after segments
+    DB.execute("CREATE TABLE f(b BLOB, x INTEGER)")
+    DB.execute("INSERT INTO f VALUES (rb_create(2, 300000), 100)")
+    assert_equal [[1, 2]], DB.query_array("SELECT s.id, rb_count(s.bitmap) FROM f, segments AS s WHERE s.id = 1 AND s.filter = f.b")
+    assert_equal [[1, 3]], DB.query_array("SELECT s.id, rb_count(s.bitmap) FROM segments AS s JOIN (SELECT 100 x) AS b WHERE s.id = 1 AND s.value < b.x")
+    DB.execute("DROP TABLE f")
+    DB.execute("UPDATE segments SET bitmap = rb_create(5) WHERE id = 1")
+    assert_equal [[0, 1]], DB.query_array("SELECT key, rb_count(chunk) FROM segments_chunk")
+    DB.execute("DELETE FROM segments WHERE id = 1")
+    assert_equal 0, DB.query_single_splat("SELECT count(*) FROM segments_chunk")
+    DB.execute("DROP TABLE segments")
+  end
+
   def test_rb_group_and
     DB.execute("INSERT INTO bitmaps(bitmap) VALUES (rb_create(1,2,3,4)), (rb_create(4)), (rb_create(4,7))")
     result = DB.query_single_splat("SELECT rb_count(rb_group_and(bitmap)) FROM bitmaps")
@@ -226,6 +730,54 @@ class TestRoaringBitmap < Minitest::Test
     assert_equal 5, result
   end
 
+  def test_rb_group_or_window
+    DB.execute("INSERT INTO bitmaps(bitmap) VALUES (rb_create(1,2)), (rb_create(2,3)), (rb_create(2)), (rb_create(4))")
+    result = DB.query_splat("SELECT rb_count(rb_group_or(bitmap) OVER (ORDER BY id ROWS 1 PRECEDING)) FROM bitmaps")
+    DB.execute("DELETE FROM bitmaps")
+    assert_equal [2, 3, 2, 2], result
+  end
+
+  def test_rb_group_or_window_following
+    DB.execute("INSERT INTO bitmaps(bitmap) VALUES (rb_create(1,2)), (rb_create(2,3)), (rb_create(2)), (rb_create(4))")
+    result = DB.query_splat("SELECT rb_count(rb_group_or(bitmap) OVER (ORDER BY id ROWS BETWEEN CURRENT ROW AND 1 FOLLOWING)) FROM bitmaps")
+    DB.execute("DELETE FROM bitmaps")
+    assert_equal [3, 2, 2, 1], result
+    # the rows ahead of the first frame are only kept up to a limit
+    query = "WITH RECURSIVE s(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM s WHERE x < ?) SELECT rb_count(rb_group_or(rb_create(x)) OVER (ORDER BY x ROWS BETWEEN CURRENT ROW AND UNBOUNDED FOLLOWING)) FROM s"
+    assert_equal [3, 2, 1], DB.query_splat(query, 3)
+    assert_raises(Extralite::Error) { DB.query_splat(query, 100) }
+  end
+
+  def test_rb64_group_or_window
+    DB.execute("INSERT INTO bitmaps(bitmap) VALUES (rb64_create(1,2)), (rb64_create(2,3)), (rb64_create(2)), (rb64_create(4))")
+    result = DB.query_splat("SELECT rb64_count(rb64_group_or(bitmap) OVER (ORDER BY id ROWS 1 PRECEDING)) FROM bitmaps")
+    DB.execute("DELETE FROM bitmaps")
+    assert_equal [2, 3, 2, 2], result
+  end
+
+  def test_rb_group_create_window
+    result = DB.query_splat("SELECT rb_count(rb_group_create(value) OVER (ORDER BY key ROWS 2 PRECEDING)) FROM JSON_EACH('[5,5,6,5,7,7,7]')")
+    assert_equal [1, 1, 2, 2, 3, 2, 1], result
+  end
+
+  def test_rb_group_create_window_compacts
+    # 0..999 arrive out of order, the last frame is serialized as a single run
+    result = DB.query_single_splat("WITH RECURSIVE s(x) AS (SELECT 0 UNION ALL SELECT x+1 FROM s WHERE x < 999) SELECT length(b) FROM (SELECT rb_group_create(x) OVER (ORDER BY (x * 7919) % 1000) AS b FROM s) WHERE rb_count(b) = 1000")
+    assert_operator result, :<, 100
+  end
+
+  def test_rb64_group_create_window
+    result = DB.query_splat("SELECT rb64_count(rb64_group_create(value) OVER (ORDER BY key ROWS 2 PRECEDING)) FROM JSON_EACH('[5,5,6,5,7,7,7]')")
+    assert_equal [1, 1, 2, 2, 3, 2, 1], result
+  end
+
+  def test_rb_group_or_bitsets
+    DB.execute("WITH RECURSIVE c(x) AS (SELECT 0 UNION ALL SELECT x+1 FROM c WHERE x < 9999) INSERT INTO bitmaps(bitmap) SELECT rb_create(x, x + 5000, x * 3) FROM c")
+    result = DB.query_single_splat("SELECT rb_count(rb_group_or(bitmap)) AS length FROM bitmaps")
+    DB.execute("DELETE FROM bitmaps")
+    assert_equal 20000, result
+  end
+
   def test_rb64_group_or
     DB.execute("INSERT INTO bitmaps(bitmap) VALUES (rb64_create(1,2,3,4)), (rb64_create(4)), (rb64_create(4,7))")
     result = DB.query_single_splat("SELECT rb64_count(rb64_group_or(bitmap)) AS length FROM bitmaps")